@@ -5,10 +5,12 @@
 #include <errno.h>
 #include <stdio.h>
 #include <unistd.h>
+#include <algorithm>
 #include <cstdint>
 
 #include "alsa_pool.h"
 #include "bmusb/bmusb.h"
+#include "flags.h"
 #include "timebase.h"
 
 using namespace std;
@@ -56,9 +58,19 @@ bool ALSAInput::open_device()
 	// Set format.
 	snd_pcm_hw_params_t *hw_params;
 	snd_pcm_hw_params_alloca(&hw_params);
-	if (!set_base_params(device.c_str(), pcm_handle, hw_params, &sample_rate)) {
+	snd_pcm_access_t access = SND_PCM_ACCESS_RW_INTERLEAVED;
+	if (global_flags.alsa_mmap_capture) {
+		RETURN_FALSE_ON_ERROR("snd_pcm_hw_params_any()", snd_pcm_hw_params_any(pcm_handle, hw_params));
+		if (snd_pcm_hw_params_test_access(pcm_handle, hw_params, SND_PCM_ACCESS_MMAP_INTERLEAVED) == 0) {
+			access = SND_PCM_ACCESS_MMAP_INTERLEAVED;
+		} else {
+			fprintf(stderr, "[%s] Device does not support mmap access, using regular reads.\n", device.c_str());
+		}
+	}
+	if (!set_base_params(device.c_str(), pcm_handle, hw_params, &sample_rate, access)) {
 		return false;
 	}
+	use_mmap = (access == SND_PCM_ACCESS_MMAP_INTERLEAVED);
 
 	RETURN_FALSE_ON_ERROR("snd_pcm_hw_params_set_channels()", snd_pcm_hw_params_set_channels(pcm_handle, hw_params, num_channels));
 
@@ -102,6 +114,7 @@ bool ALSAInput::open_device()
 		assert(false);
 	}
 	audio_format.sample_rate = sample_rate;
+	mmap_direct = use_mmap && snd_pcm_format_physical_width(chosen_format) == int(audio_format.bits_per_sample);
 	//printf("num_periods=%u period_size=%u buffer_frames=%u sample_rate=%u bits_per_sample=%d\n",
 	//	num_periods, unsigned(period_size), unsigned(buffer_frames), sample_rate, audio_format.bits_per_sample);
 
@@ -118,7 +131,7 @@ bool ALSAInput::open_device()
 	return true;
 }
 
-bool ALSAInput::set_base_params(const char *device_name, snd_pcm_t *pcm_handle, snd_pcm_hw_params_t *hw_params, unsigned *sample_rate)
+bool ALSAInput::set_base_params(const char *device_name, snd_pcm_t *pcm_handle, snd_pcm_hw_params_t *hw_params, unsigned *sample_rate, snd_pcm_access_t access)
 {
 	int err;
 	err = snd_pcm_hw_params_any(pcm_handle, hw_params);
@@ -126,7 +139,7 @@ bool ALSAInput::set_base_params(const char *device_name, snd_pcm_t *pcm_handle,
 		fprintf(stderr, "[%s] snd_pcm_hw_params_any(): %s\n", device_name, snd_strerror(err));
 		return false;
 	}
-	err = snd_pcm_hw_params_set_access(pcm_handle, hw_params, SND_PCM_ACCESS_RW_INTERLEAVED);
+	err = snd_pcm_hw_params_set_access(pcm_handle, hw_params, access);
 	if (err < 0) {
 		fprintf(stderr, "[%s] snd_pcm_hw_params_set_access(): %s\n", device_name, snd_strerror(err));
 		return false;
@@ -232,32 +245,86 @@ ALSAInput::CaptureEndReason ALSAInput::do_capture()
 		}
 		RETURN_ON_ERROR("snd_pcm_wait()", ret);
 
-		snd_pcm_sframes_t frames = snd_pcm_readi(pcm_handle, buffer.get(), buffer_frames);
+		const uint8_t *data = buffer.get();
+		snd_pcm_uframes_t mmap_offset = 0;
+		snd_pcm_sframes_t frames;
+		if (mmap_direct) {
+			frames = mmap_begin_read(&data, &mmap_offset);
+		} else if (use_mmap) {
+			frames = snd_pcm_mmap_readi(pcm_handle, buffer.get(), buffer_frames);
+		} else {
+			frames = snd_pcm_readi(pcm_handle, buffer.get(), buffer_frames);
+		}
 		if (frames == -EPIPE) {
 			fprintf(stderr, "[%s] ALSA overrun\n", device.c_str());
 			snd_pcm_prepare(pcm_handle);
 			snd_pcm_start(pcm_handle);
 			continue;
 		}
+		if (frames == 0 && mmap_direct) {
+			// Nothing to read after all.
+			continue;
+		}
 		if (frames == 0) {
 			fprintf(stderr, "snd_pcm_readi() returned 0\n");
 			break;
 		}
-		RETURN_ON_ERROR("snd_pcm_readi()", frames);
+		RETURN_ON_ERROR("reading from device", frames);
 
 		const int64_t prev_pts = frames_to_pts(num_frames_output);
 		const int64_t pts = frames_to_pts(num_frames_output + frames);
 		const steady_clock::time_point now = steady_clock::now();
-		bool success;
-		do {
+		for ( ;; ) {
 			if (should_quit.should_quit()) return CaptureEndReason::REQUESTED_QUIT;
-			success = audio_callback(buffer.get(), frames, audio_format, pts - prev_pts, now);
-		} while (!success);
+			if (audio_callback(data, frames, audio_format, pts - prev_pts, now)) {
+				break;
+			}
+			// The mixer is not keeping up; give it about a period
+			// before trying again, instead of spinning.
+			should_quit.sleep_for(duration<double>(double(pts - prev_pts) / TIMEBASE));
+		}
 		num_frames_output += frames;
+
+		if (mmap_direct) {
+			snd_pcm_sframes_t ret = snd_pcm_mmap_commit(pcm_handle, mmap_offset, frames);
+			if (ret == -EPIPE) {
+				// The card overwrote what we were reading; we've sent it on
+				// anyway, but there's not much we can do about that now.
+				fprintf(stderr, "[%s] ALSA overrun\n", device.c_str());
+				snd_pcm_prepare(pcm_handle);
+				snd_pcm_start(pcm_handle);
+				continue;
+			}
+			RETURN_ON_ERROR("snd_pcm_mmap_commit()", ret);
+		}
 	}
 	return CaptureEndReason::REQUESTED_QUIT;
 }
 
+snd_pcm_sframes_t ALSAInput::mmap_begin_read(const uint8_t **data, snd_pcm_uframes_t *offset)
+{
+	snd_pcm_sframes_t avail = snd_pcm_avail_update(pcm_handle);
+	if (avail <= 0) {
+		return avail;
+	}
+
+	// This gives at most the frames up to the end of the buffer;
+	// if the readable part wraps around, we get the rest the next time.
+	const snd_pcm_channel_area_t *areas;
+	snd_pcm_uframes_t frames = min<snd_pcm_uframes_t>(avail, buffer_frames);
+	int err = snd_pcm_mmap_begin(pcm_handle, &areas, offset, &frames);
+	if (err < 0) {
+		return err;
+	}
+
+	// With interleaved access, all channels share the same area,
+	// and each channel's first sample comes right after the previous one's.
+	const unsigned frame_bits = num_channels * audio_format.bits_per_sample;
+	assert(areas[0].first == 0 && areas[0].step == frame_bits);
+	*data = static_cast<const uint8_t *>(areas[0].addr) + *offset * frame_bits / 8;
+	return frames;
+}
+
 int64_t ALSAInput::frames_to_pts(uint64_t n) const
 {
 	return (n * TIMEBASE) / sample_rate;
@@ -19,17 +19,16 @@
 #include <string>
 #include <thread>
 
+#include "audio_input_backend.h"
 #include "bmusb/bmusb.h"
 #include "quittable_sleeper.h"
 
 class ALSAPool;
 
-class ALSAInput {
+class ALSAInput : public AudioInputBackend {
 public:
-	typedef std::function<bool(const uint8_t *data, unsigned num_samples, bmusb::AudioFormat audio_format, int64_t frame_length, std::chrono::steady_clock::time_point ts)> audio_callback_t;
-
 	ALSAInput(const char *device, unsigned sample_rate, unsigned num_channels, audio_callback_t audio_callback, ALSAPool *parent_pool, unsigned internal_dev_index);
-	~ALSAInput();
+	~ALSAInput() override;
 
 	// If not called before start_capture_thread(), the capture thread
 	// will call it until it succeeds.
@@ -38,16 +37,17 @@ public:
 	// Not valid before the device has been successfully opened.
 	// NOTE: Might very well be different from the sample rate given to the
 	// constructor, since the card might not support the one you wanted.
-	unsigned get_sample_rate() const { return sample_rate; }
+	unsigned get_sample_rate() const override { return sample_rate; }
 
-	void start_capture_thread();
-	void stop_capture_thread();
+	void start_capture_thread() override;
+	void stop_capture_thread() override;
 
 	// Set access, sample rate and format parameters on the given ALSA PCM handle.
 	// Returns the computed parameter set and the chosen sample rate. Note that
 	// sample_rate is an in/out parameter; you send in the desired rate,
 	// and ALSA picks one as close to that as possible.
-	static bool set_base_params(const char *device_name, snd_pcm_t *pcm_handle, snd_pcm_hw_params_t *hw_params, unsigned *sample_rate);
+	static bool set_base_params(const char *device_name, snd_pcm_t *pcm_handle, snd_pcm_hw_params_t *hw_params, unsigned *sample_rate,
+	                            snd_pcm_access_t access = SND_PCM_ACCESS_RW_INTERLEAVED);
 
 private:
 	void capture_thread_func();
@@ -60,6 +60,11 @@ private:
 	};
 	CaptureEndReason do_capture();
 
+	// For mmap capture: Points <data> straight at the next readable frames
+	// in the sound card's buffer, and returns how many there are (or a
+	// negative error code). They must be given back with snd_pcm_mmap_commit().
+	snd_pcm_sframes_t mmap_begin_read(const uint8_t **data, snd_pcm_uframes_t *offset);
+
 	std::string device;
 	unsigned sample_rate, num_channels, num_periods;
 	snd_pcm_uframes_t period_size;
@@ -67,6 +72,14 @@ private:
 	bmusb::AudioFormat audio_format;
 	audio_callback_t audio_callback;
 
+	// If set (--alsa-mmap-capture, and the device supports it), we read
+	// directly out of the sound card's buffer instead of copying into <buffer>
+	// first. This only works if the samples are laid out the way add_audio()
+	// wants them (e.g. not for 24-bit samples in 32-bit containers);
+	// if not, <use_mmap> is still set, but we read with snd_pcm_mmap_readi().
+	bool use_mmap = false;
+	bool mmap_direct = false;
+
 	snd_pcm_t *pcm_handle = nullptr;
 	std::thread capture_thread;
 	QuittableSleeper should_quit;
@@ -2,14 +2,26 @@
 
 #include <alsa/asoundlib.h>
 #include <errno.h>
+#include <pthread.h>
+#include <sched.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
 #include <vector>
 
+#include "metrics.h"
+
 using namespace std;
+using namespace std::chrono;
 
 namespace {
 
+// If the writer thread gets more than this many periods behind (about 85 ms),
+// it throws away the oldest audio instead of adding more latency.
+constexpr unsigned max_queued_periods = 8;
+
 void die_on_error(const char *func_name, int err)
 {
 	if (err < 0) {
@@ -53,44 +65,117 @@ ALSAOutput::ALSAOutput(int sample_rate, int num_channels)
 
 	die_on_error("snd_pcm_nonblock", snd_pcm_nonblock(pcm_handle, 1));
 	die_on_error("snd_pcm_prepare()", snd_pcm_prepare(pcm_handle));
+
+	// Room for a quarter of a second, which is a lot more than the writer
+	// thread will keep around; write() should never find the ring full
+	// unless the writer thread isn't getting to run at all.
+	ring.resize(sample_rate / 4 * num_channels);
+	period_buffer.reset(new float[period_size * num_channels]);
+
+	global_metrics.add("alsa_output_queue_length_samples", &metric_alsa_output_queue_length_samples, Metrics::TYPE_GAUGE);
+	global_metrics.add("alsa_output_dropped_samples", &metric_alsa_output_dropped_samples);
+	global_metrics.add("alsa_output_recoveries", &metric_alsa_output_recoveries);
+
+	writer_thread = thread(&ALSAOutput::writer_thread_func, this);
+}
+
+ALSAOutput::~ALSAOutput()
+{
+	should_quit.quit();
+	writer_thread.join();
+	snd_pcm_close(pcm_handle);
+
+	global_metrics.remove("alsa_output_queue_length_samples");
+	global_metrics.remove("alsa_output_dropped_samples");
+	global_metrics.remove("alsa_output_recoveries");
 }
 
 void ALSAOutput::write(const vector<float> &samples)
 {
-	buffer.insert(buffer.end(), samples.begin(), samples.end());
+	// Only whole samples go into the ring. (We are the only writer,
+	// so the free space can only grow between here and the write.)
+	const size_t room_samples = ring.free_space() / num_channels;
+	const size_t num_samples = min<size_t>(samples.size() / num_channels, room_samples);
+	ring.write(samples.data(), num_samples * num_channels);
+	if (num_samples < samples.size() / num_channels) {
+		metric_alsa_output_dropped_samples += samples.size() / num_channels - num_samples;
+	}
+}
+
+void ALSAOutput::writer_thread_func()
+{
+	pthread_setname_np(pthread_self(), "ALSA_Output");
 
-try_again:
-	int periods_to_write = buffer.size() / (period_size * num_channels);
-	if (periods_to_write == 0) {
-		return;
+	sched_param param;
+	memset(&param, 0, sizeof(param));
+	param.sched_priority = 1;
+	if (sched_setscheduler(0, SCHED_RR, &param) == -1) {
+		fprintf(stderr, "couldn't set realtime priority for ALSA output thread: %s\n", strerror(errno));
 	}
 
-	int ret = snd_pcm_writei(pcm_handle, buffer.data(), periods_to_write * period_size);
-	if (ret == -EPIPE) {
-		fprintf(stderr, "warning: snd_pcm_writei() reported underrun\n");
-		snd_pcm_recover(pcm_handle, ret, 1);
-		goto try_again;
-	} else if (ret == -EAGAIN) {
-		ret = 0;
-	} else if (ret < 0) {
-		fprintf(stderr, "error: snd_pcm_writei() returned '%s'\n", snd_strerror(ret));
-		exit(1);
-	} else if (ret > 0) {
-		buffer.erase(buffer.begin(), buffer.begin() + ret * num_channels);
+	const size_t period_floats = period_size * num_channels;
+	const duration<double> period_duration(double(period_size) / sample_rate);
+	while (!should_quit.should_quit()) {
+		size_t queued_samples = ring.size() / num_channels;
+		if (queued_samples >= period_size * max_queued_periods) {
+			// The sound card isn't keeping up with us (or has stopped);
+			// keep only the newest period.
+			const size_t samples_to_drop = queued_samples - period_size;
+			fprintf(stderr, "warning: ALSA overrun, dropping some audio (%d ms)\n",
+				int(samples_to_drop * 1000 / sample_rate));
+			ring.consume(samples_to_drop * num_channels);
+			metric_alsa_output_dropped_samples += samples_to_drop;
+			queued_samples -= samples_to_drop;
+		}
+		metric_alsa_output_queue_length_samples = queued_samples;
+
+		if (queued_samples < period_size) {
+			// Wait for the mixer to produce more. If this goes on for long
+			// enough, the card will underrun, and write_period() will
+			// recover once there is audio again.
+			should_quit.sleep_for(period_duration / 2);
+			continue;
+		}
+
+		ring.read(period_buffer.get(), period_floats);
+		write_period();
 	}
+}
 
-	if (buffer.size() >= period_size * num_channels) {  // Still more to write.
-		if (ret == 0) {
-			if (buffer.size() >= period_size * num_channels * 8) {
-				// OK, almost 100 ms. Giving up.
-				fprintf(stderr, "warning: ALSA overrun, dropping some audio (%d ms)\n",
-					int(buffer.size() * 1000 / (num_channels * sample_rate)));
-				buffer.clear();
+void ALSAOutput::write_period()
+{
+	const float *data = period_buffer.get();
+	snd_pcm_uframes_t frames_left = period_size;
+	while (frames_left > 0 && !should_quit.should_quit()) {
+		snd_pcm_sframes_t ret = snd_pcm_writei(pcm_handle, data, frames_left);
+		if (ret == -EAGAIN) {
+			// The card's buffer is full; wait for room (but not forever,
+			// so that we can notice if we are asked to quit).
+			snd_pcm_wait(pcm_handle, /*timeout=*/100);
+			continue;
+		}
+		if (ret < 0) {
+			// Underrun (-EPIPE), suspend (-ESTRPIPE) or similar.
+			if (ret == -EPIPE) {
+				fprintf(stderr, "warning: snd_pcm_writei() reported underrun\n");
+			} else {
+				fprintf(stderr, "warning: snd_pcm_writei() returned '%s', trying to recover\n", snd_strerror(ret));
 			}
-		} else if (ret > 0) {
-			// Not a completely failure (effectively a short write),
-			// possibly due to a signal.
-			goto try_again;
+			++metric_alsa_output_recoveries;
+			int err = snd_pcm_recover(pcm_handle, ret, /*silent=*/1);
+			if (err < 0) {
+				// Drop this period, and give the card some time before the next one.
+				fprintf(stderr, "error: snd_pcm_recover() returned '%s'\n", snd_strerror(err));
+				metric_alsa_output_dropped_samples += frames_left;
+				should_quit.sleep_for(milliseconds(100));
+				return;
+			}
+			continue;
 		}
+
+		// Possibly a short write (e.g. due to a signal).
+		data += ret * num_channels;
+		frames_left -= ret;
 	}
 }
+
@@ -2,25 +2,56 @@
 #define _ALSA_OUTPUT_H 1
 
 // Extremely minimalistic ALSA output. Will not resample to fit
-// sound card clock, will not care much about over- or underflows
-// (so it will not block), will not care about A/V sync.
+// sound card clock, will not care about A/V sync.
 //
 // This means that if you run it for long enough, clocks will
 // probably drift out of sync enough to make a little pop.
+//
+// write() only puts the samples into a ring buffer, and never blocks;
+// a separate (realtime-priority, if allowed) thread takes them from there
+// and talks to the sound card, recovering from underruns and the like
+// on its own. If the card falls behind, the oldest audio is dropped,
+// so that a slow or glitchy monitoring device cannot hold up the mixer.
 
 #include <alsa/asoundlib.h>
+#include <atomic>
+#include <memory>
+#include <thread>
 #include <vector>
 
+#include "quittable_sleeper.h"
+#include "ring_buffer.h"
+
 class ALSAOutput {
 public:
 	ALSAOutput(int sample_rate, int num_channels);
+	~ALSAOutput();
+
+	// Interleaved samples. Only one thread can call this.
 	void write(const std::vector<float> &samples);
 
 private:
+	void writer_thread_func();
+
+	// Writes one period from <period_buffer>, waiting for room
+	// in the sound card's buffer if needed.
+	void write_period();
+
 	snd_pcm_t *pcm_handle;
-	std::vector<float> buffer;
 	snd_pcm_uframes_t period_size;
 	int sample_rate, num_channels;
+
+	// Written to by write(), and read by the writer thread.
+	RingBuffer<float> ring;
+
+	std::thread writer_thread;
+	QuittableSleeper should_quit;
+	std::unique_ptr<float[]> period_buffer;  // Only touched by the writer thread.
+
+	// Metrics.
+	std::atomic<int64_t> metric_alsa_output_queue_length_samples{0};
+	std::atomic<int64_t> metric_alsa_output_dropped_samples{0};
+	std::atomic<int64_t> metric_alsa_output_recoveries{0};
 };
 
 #endif  // !defined(_ALSA_OUTPUT_H)
@@ -8,6 +8,7 @@
 #include <poll.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <sys/eventfd.h>
 #include <sys/inotify.h>
 #include <unistd.h>
@@ -17,10 +18,13 @@
 #include <iterator>
 #include <memory>
 #include <ratio>
+#include <string>
 
 #include "alsa_input.h"
 #include "audio_mixer.h"
 #include "defs.h"
+#include "file_audio_input.h"
+#include "flags.h"
 #include "input_mapping.h"
 #include "state.pb.h"
 
@@ -294,6 +298,48 @@ void ALSAPool::init()
 {
 	inotify_thread = thread(&ALSAPool::inotify_thread_func, this);
 	enumerate_devices();
+
+	for (const string &spec : global_flags.file_audio_inputs) {
+		FileAudioInput::Params params;
+		if (!FileAudioInput::parse_spec(spec, &params) ||
+		    !FileAudioInput::probe(&params)) {
+			fprintf(stderr, "Could not add file audio input '%s'.\n", spec.c_str());
+			exit(1);
+		}
+		add_file_device(params);
+	}
+}
+
+void ALSAPool::add_file_device(const FileAudioInput::Params &params)
+{
+	unsigned internal_dev_index;
+	string address, display_name;
+	{
+		lock_guard<mutex> lock(mu);
+		const unsigned file_index = num_file_devices++;
+		address = "file:" + to_string(file_index);
+		const string name = "File input " + to_string(file_index);
+		const string &info = params.filename;
+
+		file_devices[address] = params;
+		internal_dev_index = find_free_device_index(name, info, params.num_channels, address);
+		devices[internal_dev_index].address = address;
+		devices[internal_dev_index].name = name;
+		devices[internal_dev_index].info = info;
+		devices[internal_dev_index].num_channels = params.num_channels;
+		// Note: Purposefully does not overwrite held.
+
+		display_name = devices[internal_dev_index].display_name();
+	}
+
+	fprintf(stderr, "%s: Added %s (%u Hz, %u channels, %u bits).\n", address.c_str(),
+		params.filename.c_str(), params.sample_rate, params.num_channels, params.bits_per_sample);
+
+	reset_device(internal_dev_index);  // Restarts it if it is held (ie., we just replaced a dead card).
+
+	DeviceSpec spec{InputSourceType::ALSA_INPUT, internal_dev_index};
+	global_audio_mixer->set_display_name(spec, display_name);
+	global_audio_mixer->trigger_state_changed_callback();
 }
 
 void ALSAPool::inotify_thread_func()
@@ -399,7 +445,12 @@ void ALSAPool::reset_device(unsigned index)
 	} else {
 		// TODO: Put on a background thread instead of locking?
 		auto callback = bind(&AudioMixer::add_audio, global_audio_mixer, DeviceSpec{InputSourceType::ALSA_INPUT, index}, _1, _2, _3, _4, _5);
-		inputs[index].reset(new ALSAInput(device->address.c_str(), OUTPUT_FREQUENCY, device->num_channels, callback, this, index));
+		auto file_it = file_devices.find(device->address);
+		if (file_it != file_devices.end()) {
+			inputs[index].reset(new FileAudioInput(file_it->second, callback, this, index));
+		} else {
+			inputs[index].reset(new ALSAInput(device->address.c_str(), OUTPUT_FREQUENCY, device->num_channels, callback, this, index));
+		}
 		inputs[index]->start_capture_thread();
 	}
 	device->input = inputs[index].get();
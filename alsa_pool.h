@@ -9,11 +9,16 @@
 #include <unordered_map>
 #include <vector>
 
+#include "file_audio_input.h"
+
 class ALSAInput;
+class AudioInputBackend;
 class DeviceSpecProto;
 
 // The class dealing with the collective of all ALSA cards in the system.
 // In particular, it deals with enumeration of cards, and hotplug of new ones.
+// It can also hold file-backed stand-ins for sound cards (see FileAudioInput),
+// which are treated just like hotplugged cards.
 class ALSAPool {
 public:
 	ALSAPool();
@@ -52,10 +57,10 @@ public:
 			DEAD
 		} state = State::EMPTY;
 
-		std::string address;  // E.g. “hw:0,0”.
+		std::string address;  // E.g. “hw:0,0”, or “file:0” for file inputs.
 		std::string name, info;
 		unsigned num_channels;
-		ALSAInput *input = nullptr;  // nullptr iff EMPTY or DEAD.
+		AudioInputBackend *input = nullptr;  // nullptr iff EMPTY or DEAD.
 
 		// Whether the AudioMixer is interested in this card or not.
 		// “Interested” could mean either of two things: Either it is part of
@@ -70,6 +75,10 @@ public:
 
 	void init();
 
+	// Add a file input as if it were a newly plugged-in sound card.
+	// The parameters must have been through FileAudioInput::probe().
+	void add_file_device(const FileAudioInput::Params &params);
+
 	// Get the list of all current devices. Note that this will implicitly mark
 	// all of the returned devices as held, since the input mapping UI needs
 	// some kind of stability when the user is to choose. Thus, when you are done
@@ -90,11 +99,11 @@ public:
 	// Note: The card must be held.
 	Device::State get_card_state(unsigned index);
 
-	// Only for ALSAInput.
+	// Only for the input backends (ALSAInput and FileAudioInput).
 	void set_card_state(unsigned index, Device::State state);
 
 	// Just a short form for taking <mu> and then moving the card to
-	// EMPTY or DEAD state. Only for ALSAInput and for internal use.
+	// EMPTY or DEAD state. Only for the input backends and for internal use.
 	void free_card(unsigned index);
 
 	// Create a new card, mark it immediately as DEAD and hold it.
@@ -109,7 +118,12 @@ public:
 private:
 	mutable std::mutex mu;
 	std::vector<Device> devices;  // Under mu.
-	std::vector<std::unique_ptr<ALSAInput>> inputs;  // Under mu, corresponds 1:1 to devices.
+	std::vector<std::unique_ptr<AudioInputBackend>> inputs;  // Under mu, corresponds 1:1 to devices.
+
+	// Keyed on device address (e.g. “file:0”). Devices with an address
+	// in here are captured with FileAudioInput instead of ALSAInput.
+	std::unordered_map<std::string, FileAudioInput::Params> file_devices;  // Under mu.
+	unsigned num_file_devices = 0;  // Under mu.
 
 	// Keyed on device address (e.g. “hw:0,0”). If there's an entry here,
 	// it means we already have a thread doing retries, so we shouldn't
@@ -0,0 +1,255 @@
+#include "audio_conversion.h"
+
+#include <assert.h>
+#include <endian.h>
+#include <string.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_KERNELS 1
+#endif
+
+using namespace std;
+
+namespace {
+
+// The conversion of a single sample. <src> points to the first byte of
+// the sample; 24-bit is expanded to 32-bit by repeating the top byte
+// in the bottom, so that full scale maps to (almost) exactly 1.0.
+
+inline float convert_fixed16(const uint8_t *src)
+{
+	int16_t s;
+	memcpy(&s, src, sizeof(s));
+	return int16_t(le16toh(s)) * (1.0f / 32768.0f);
+}
+
+inline float convert_fixed24(const uint8_t *src)
+{
+	uint32_t s1 = src[0];
+	uint32_t s2 = src[1];
+	uint32_t s3 = src[2];
+	uint32_t s = s1 | (s1 << 8) | (s2 << 16) | (s3 << 24);
+	return int(s) * (1.0f / 2147483648.0f);
+}
+
+inline float convert_fixed32(const uint8_t *src)
+{
+	int32_t s;
+	memcpy(&s, src, sizeof(s));
+	return int32_t(le32toh(s)) * (1.0f / 2147483648.0f);
+}
+
+template<unsigned bytes_per_sample>
+inline float convert_one(const uint8_t *src);
+
+template<>
+inline float convert_one<2>(const uint8_t *src) { return convert_fixed16(src); }
+template<>
+inline float convert_one<3>(const uint8_t *src) { return convert_fixed24(src); }
+template<>
+inline float convert_one<4>(const uint8_t *src) { return convert_fixed32(src); }
+
+template<unsigned bytes_per_sample>
+void convert_plain(float *dst, size_t out_num_channels,
+                   const uint8_t *src, const unsigned *in_channels, size_t in_num_channels,
+                   size_t num_samples)
+{
+	const size_t in_stride = bytes_per_sample * in_num_channels;
+	for (size_t i = 0; i < num_samples; ++i) {
+		for (size_t j = 0; j < out_num_channels; ++j) {
+			*dst++ = convert_one<bytes_per_sample>(src + in_channels[j] * bytes_per_sample);
+		}
+		src += in_stride;
+	}
+}
+
+#ifdef HAVE_X86_KERNELS
+
+// The SIMD versions vectorize over the output stream as a whole (sample by
+// sample, channel by channel), not over channels within one sample, so that
+// e.g. stereo picked out of 16 channels also gets full-width vectors.
+// We make a table of byte offsets into the input for a block of
+// <block_samples> samples, chosen so that the block is a whole number of
+// eight-float vectors, and then just move the base pointer along.
+//
+// All loads are 32-bit, so for 16- and 24-bit input, they read a few bytes
+// past the sample in question. This is harmless except at the very end of
+// the input, so we always leave at least one sample for the scalar tail.
+
+constexpr size_t max_block_floats = 64;  // 8 samples of up to 8 channels, or similar.
+
+struct GatherTable {
+	size_t block_samples;
+	size_t block_floats;
+	alignas(32) int32_t offsets[max_block_floats];
+};
+
+// Returns false if the block would be too large (very many output channels),
+// in which case the caller should just use the scalar path.
+bool make_gather_table(GatherTable *table, size_t out_num_channels,
+                       const unsigned *in_channels, size_t in_stride, unsigned bytes_per_sample)
+{
+	size_t block_samples = 1;
+	while ((block_samples * out_num_channels) % 8 != 0) {
+		++block_samples;
+	}
+	if (block_samples * out_num_channels > max_block_floats) {
+		return false;
+	}
+	table->block_samples = block_samples;
+	table->block_floats = block_samples * out_num_channels;
+	for (size_t k = 0; k < table->block_floats; ++k) {
+		size_t sample = k / out_num_channels, channel = k % out_num_channels;
+		table->offsets[k] = sample * in_stride + in_channels[channel] * bytes_per_sample;
+	}
+	return true;
+}
+
+// Turns four or eight little-endian words, loaded from the start of each
+// sample, into the same 32-bit signed integers that the scalar code gets.
+
+__attribute__((target("sse4.1")))
+inline __m128i expand_sse(__m128i w, unsigned bytes_per_sample)
+{
+	switch (bytes_per_sample) {
+	case 2:
+		return _mm_srai_epi32(_mm_slli_epi32(w, 16), 16);
+	case 3:
+		return _mm_or_si128(_mm_slli_epi32(w, 8), _mm_and_si128(w, _mm_set1_epi32(0xff)));
+	default:
+		return w;
+	}
+}
+
+__attribute__((target("avx2")))
+inline __m256i expand_avx2(__m256i w, unsigned bytes_per_sample)
+{
+	switch (bytes_per_sample) {
+	case 2:
+		return _mm256_srai_epi32(_mm256_slli_epi32(w, 16), 16);
+	case 3:
+		return _mm256_or_si256(_mm256_slli_epi32(w, 8), _mm256_and_si256(w, _mm256_set1_epi32(0xff)));
+	default:
+		return w;
+	}
+}
+
+inline uint32_t load_word(const uint8_t *src)
+{
+	uint32_t w;
+	memcpy(&w, src, sizeof(w));
+	return w;
+}
+
+template<unsigned bytes_per_sample>
+__attribute__((target("sse4.1")))
+void convert_sse41(float *dst, size_t out_num_channels,
+                   const uint8_t *src, const unsigned *in_channels, size_t in_num_channels,
+                   size_t num_samples)
+{
+	const size_t in_stride = bytes_per_sample * in_num_channels;
+	GatherTable table;
+	if (!make_gather_table(&table, out_num_channels, in_channels, in_stride, bytes_per_sample)) {
+		convert_plain<bytes_per_sample>(dst, out_num_channels, src, in_channels, in_num_channels, num_samples);
+		return;
+	}
+
+	const __m128 scale = _mm_set1_ps(bytes_per_sample == 2 ? (1.0f / 32768.0f) : (1.0f / 2147483648.0f));
+	size_t i = 0;
+	for ( ; i + table.block_samples < num_samples; i += table.block_samples) {
+		for (size_t k = 0; k < table.block_floats; k += 4) {
+			__m128i w = _mm_cvtsi32_si128(load_word(src + table.offsets[k]));
+			w = _mm_insert_epi32(w, load_word(src + table.offsets[k + 1]), 1);
+			w = _mm_insert_epi32(w, load_word(src + table.offsets[k + 2]), 2);
+			w = _mm_insert_epi32(w, load_word(src + table.offsets[k + 3]), 3);
+			__m128 f = _mm_mul_ps(_mm_cvtepi32_ps(expand_sse(w, bytes_per_sample)), scale);
+			_mm_storeu_ps(dst + k, f);
+		}
+		src += table.block_samples * in_stride;
+		dst += table.block_floats;
+	}
+	convert_plain<bytes_per_sample>(dst, out_num_channels, src, in_channels, in_num_channels, num_samples - i);
+}
+
+template<unsigned bytes_per_sample>
+__attribute__((target("avx2")))
+void convert_avx2(float *dst, size_t out_num_channels,
+                  const uint8_t *src, const unsigned *in_channels, size_t in_num_channels,
+                  size_t num_samples)
+{
+	const size_t in_stride = bytes_per_sample * in_num_channels;
+	GatherTable table;
+	if (!make_gather_table(&table, out_num_channels, in_channels, in_stride, bytes_per_sample)) {
+		convert_plain<bytes_per_sample>(dst, out_num_channels, src, in_channels, in_num_channels, num_samples);
+		return;
+	}
+
+	__m256i offsets[max_block_floats / 8];
+	for (size_t k = 0; k < table.block_floats; k += 8) {
+		offsets[k / 8] = _mm256_load_si256((const __m256i *)&table.offsets[k]);
+	}
+
+	const __m256 scale = _mm256_set1_ps(bytes_per_sample == 2 ? (1.0f / 32768.0f) : (1.0f / 2147483648.0f));
+	size_t i = 0;
+	for ( ; i + table.block_samples < num_samples; i += table.block_samples) {
+		for (size_t k = 0; k < table.block_floats; k += 8) {
+			__m256i w = _mm256_i32gather_epi32((const int *)src, offsets[k / 8], 1);
+			__m256 f = _mm256_mul_ps(_mm256_cvtepi32_ps(expand_avx2(w, bytes_per_sample)), scale);
+			_mm256_storeu_ps(dst + k, f);
+		}
+		src += table.block_samples * in_stride;
+		dst += table.block_floats;
+	}
+	convert_plain<bytes_per_sample>(dst, out_num_channels, src, in_channels, in_num_channels, num_samples - i);
+}
+
+#endif  // defined(HAVE_X86_KERNELS)
+
+typedef void ConvertFunc(float *dst, size_t out_num_channels,
+                         const uint8_t *src, const unsigned *in_channels, size_t in_num_channels,
+                         size_t num_samples);
+
+struct ConvertFuncs {
+	ConvertFunc *fixed16, *fixed24, *fixed32;
+};
+
+ConvertFuncs pick_convert_funcs()
+{
+#ifdef HAVE_X86_KERNELS
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		return ConvertFuncs{ convert_avx2<2>, convert_avx2<3>, convert_avx2<4> };
+	}
+	if (__builtin_cpu_supports("sse4.1")) {
+		return ConvertFuncs{ convert_sse41<2>, convert_sse41<3>, convert_sse41<4> };
+	}
+#endif
+	return ConvertFuncs{ convert_plain<2>, convert_plain<3>, convert_plain<4> };
+}
+
+}  // namespace
+
+void convert_fixed_to_fp32(float *dst, size_t out_num_channels,
+                           const uint8_t *src, const unsigned *in_channels, size_t in_num_channels,
+                           unsigned bits_per_sample, size_t num_samples)
+{
+	static const ConvertFuncs funcs = pick_convert_funcs();
+
+	for (size_t j = 0; j < out_num_channels; ++j) {
+		assert(in_channels[j] < in_num_channels);
+	}
+
+	switch (bits_per_sample) {
+	case 16:
+		funcs.fixed16(dst, out_num_channels, src, in_channels, in_num_channels, num_samples);
+		break;
+	case 24:
+		funcs.fixed24(dst, out_num_channels, src, in_channels, in_num_channels, num_samples);
+		break;
+	case 32:
+		funcs.fixed32(dst, out_num_channels, src, in_channels, in_num_channels, num_samples);
+		break;
+	default:
+		assert(false);
+	}
+}
@@ -0,0 +1,24 @@
+#ifndef _AUDIO_CONVERSION_H
+#define _AUDIO_CONVERSION_H 1
+
+// Conversion from the interleaved fixed-point PCM that comes in from
+// the capture cards (16-, 24- or 32-bit little-endian) to interleaved fp32.
+// All the wanted channels are picked out in a single pass over the input,
+// instead of walking the entire (possibly 16-channel) capture buffer once
+// per channel.
+//
+// There are SSE4.1 and AVX2 versions, chosen at runtime depending on what
+// the CPU supports; the plain C++ fallback gives bit-exact the same output.
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Extracts the input channels given in <in_channels> (<out_num_channels>
+// of them, each less than <in_num_channels>) into <dst>, which will hold
+// <num_samples> * <out_num_channels> floats. Output channel i is taken
+// from input channel in_channels[i]. <bits_per_sample> must be 16, 24 or 32.
+void convert_fixed_to_fp32(float *dst, size_t out_num_channels,
+                           const uint8_t *src, const unsigned *in_channels, size_t in_num_channels,
+                           unsigned bits_per_sample, size_t num_samples);
+
+#endif  // !defined(_AUDIO_CONVERSION_H)
@@ -17,6 +17,7 @@ extern "C" {
 #include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <algorithm>
 #include <memory>
 #include <string>
 #include <vector>
@@ -69,6 +70,11 @@ AudioEncoder::AudioEncoder(const string &codec_name, int bit_rate, const AVOutpu
 	}
 
 	audio_frame = av_frame_alloc();
+	if (ctx->frame_size != 0) {
+		prepare_audio_frame(ctx->frame_size);
+		frame_buffer.resize(ctx->frame_size * 2);
+		audio_queue.resize(ctx->frame_size * 2 * 2);
+	}
 }
 
 AudioEncoder::~AudioEncoder()
@@ -90,33 +96,62 @@ void AudioEncoder::encode_audio(const vector<float> &audio, int64_t audio_pts)
 
 	int64_t sample_offset = audio_queue.size();
 
-	audio_queue.insert(audio_queue.end(), audio.begin(), audio.end());
-	size_t sample_num;
-	for (sample_num = 0;
-	     sample_num + ctx->frame_size * 2 <= audio_queue.size();
-	     sample_num += ctx->frame_size * 2) {
+	if (audio_queue.free_space() < audio.size()) {
+		// Only happens the first time, or if we start getting more audio at a time.
+		audio_queue.resize(audio_queue.size() + audio.size());
+	}
+	audio_queue.write(audio.data(), audio.size());
+
+	const size_t floats_per_frame = ctx->frame_size * 2;
+	for (size_t sample_num = 0;
+	     audio_queue.size() >= floats_per_frame;
+	     sample_num += floats_per_frame) {
+		// Encode straight out of the ring buffer if we can.
+		const float *data;
+		if (audio_queue.peek_span(&data) < floats_per_frame) {
+			audio_queue.peek(frame_buffer.data(), floats_per_frame);
+			data = frame_buffer.data();
+		}
 		int64_t adjusted_audio_pts = audio_pts + (int64_t(sample_num) - sample_offset) * TIMEBASE / (OUTPUT_FREQUENCY * 2);
-		encode_audio_one_frame(&audio_queue[sample_num],
+		encode_audio_one_frame(data,
 		                       ctx->frame_size,
 		                       adjusted_audio_pts);
+		audio_queue.consume(floats_per_frame);
 	}
-	audio_queue.erase(audio_queue.begin(), audio_queue.begin() + sample_num);
 
 	last_pts = audio_pts + audio.size() * TIMEBASE / (OUTPUT_FREQUENCY * 2);
 }
 
-void AudioEncoder::encode_audio_one_frame(const float *audio, size_t num_samples, int64_t audio_pts)
+void AudioEncoder::prepare_audio_frame(size_t num_samples)
 {
-	audio_frame->pts = audio_pts;
+	if (num_samples > audio_frame_capacity) {
+		av_frame_unref(audio_frame);
+		audio_frame->nb_samples = num_samples;
+		audio_frame->channel_layout = AV_CH_LAYOUT_STEREO;
+		audio_frame->format = ctx->sample_fmt;
+		audio_frame->sample_rate = OUTPUT_FREQUENCY;
+		if (av_frame_get_buffer(audio_frame, 0) < 0) {
+			fprintf(stderr, "Could not allocate %ld samples.\n", num_samples);
+			exit(1);
+		}
+		audio_frame_capacity = num_samples;
+	} else {
+		// Normally, the codec is done with the frame by the time we have
+		// received all the packets it can give us, so this does nothing.
+		// If not, it makes a new copy, which is still the full size.
+		audio_frame->nb_samples = audio_frame_capacity;
+		if (av_frame_make_writable(audio_frame) < 0) {
+			fprintf(stderr, "Could not allocate %ld samples.\n", audio_frame_capacity);
+			exit(1);
+		}
+	}
 	audio_frame->nb_samples = num_samples;
-	audio_frame->channel_layout = AV_CH_LAYOUT_STEREO;
-	audio_frame->format = ctx->sample_fmt;
-	audio_frame->sample_rate = OUTPUT_FREQUENCY;
+}
 
-	if (av_samples_alloc(audio_frame->data, nullptr, 2, num_samples, ctx->sample_fmt, 0) < 0) {
-		fprintf(stderr, "Could not allocate %ld samples.\n", num_samples);
-		exit(1);
-	}
+void AudioEncoder::encode_audio_one_frame(const float *audio, size_t num_samples, int64_t audio_pts)
+{
+	prepare_audio_frame(num_samples);
+	audio_frame->pts = audio_pts;
 
 	if (avresample_convert(resampler, audio_frame->data, 0, num_samples,
 	                       (uint8_t **)&audio, 0, num_samples) < 0) {
@@ -151,17 +186,17 @@ void AudioEncoder::encode_audio_one_frame(const float *audio, size_t num_samples
 		}
 	}
 
-	av_freep(&audio_frame->data[0]);
-	av_frame_unref(audio_frame);
 }
 
 void AudioEncoder::encode_last_audio()
 {
 	if (!audio_queue.empty()) {
 		// Last frame can be whatever size we want.
-		assert(audio_queue.size() % 2 == 0);
-		encode_audio_one_frame(&audio_queue[0], audio_queue.size() / 2, last_pts);
-		audio_queue.clear();
+		const size_t num_floats = audio_queue.size();
+		assert(num_floats % 2 == 0);
+		frame_buffer.resize(num_floats);
+		audio_queue.read(frame_buffer.data(), num_floats);
+		encode_audio_one_frame(frame_buffer.data(), num_floats / 2, last_pts);
 	}
 
 	if (ctx->codec->capabilities & AV_CODEC_CAP_DELAY) {
@@ -1,4 +1,8 @@
 // A class to encode audio (using ffmpeg) and send it to a Mux.
+//
+// Once it has warmed up, it does not allocate; the audio is queued up
+// in a ring buffer until there is enough for a codec frame, and the same
+// AVFrame (with the same sample buffers) is used for every codec frame.
 
 #ifndef _AUDIO_ENCODER_H
 #define _AUDIO_ENCODER_H 1
@@ -16,6 +20,7 @@ extern "C" {
 }
 
 #include "ffmpeg_raii.h"
+#include "ring_buffer.h"
 
 class Mux;
 
@@ -35,12 +40,21 @@ public:
 private:
 	void encode_audio_one_frame(const float *audio, size_t num_samples, int64_t audio_pts);
 
-	std::vector<float> audio_queue;
+	// Makes <audio_frame> ready to be filled with <num_samples> samples.
+	// Only allocates if it does not have room for them, or if the codec
+	// still holds a reference to the old buffers.
+	void prepare_audio_frame(size_t num_samples);
+
+	// Interleaved stereo. Holds less than one codec frame
+	// between calls to encode_audio().
+	RingBuffer<float> audio_queue;
+	std::vector<float> frame_buffer;  // For codec frames that wrap around the end of <audio_queue>.
 	int64_t last_pts = 0;  // The first pts after all audio we've encoded.
 
 	AVCodecContext *ctx;
 	AVAudioResampleContext *resampler;
 	AVFrame *audio_frame = nullptr;
+	size_t audio_frame_capacity = 0;  // In samples (per channel).
 	std::vector<Mux *> muxes;
 };
 
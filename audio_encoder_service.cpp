@@ -0,0 +1,145 @@
+#include "audio_encoder_service.h"
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <time.h>
+#include <string>
+#include <vector>
+
+#include "defs.h"
+#include "metrics.h"
+
+using namespace std;
+
+namespace {
+
+double thread_cpu_time_seconds()
+{
+	timespec ts;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+}  // namespace
+
+AudioEncoderService::~AudioEncoderService()
+{
+	stop();
+	for (const unique_ptr<Rendition> &rendition : renditions) {
+		global_metrics.remove("audio_encoder_cpu_time_seconds", rendition->metric_labels);
+		global_metrics.remove("audio_encoder_queued_chunks", rendition->metric_labels);
+		global_metrics.remove("audio_encoder_dropped_chunks", rendition->metric_labels);
+	}
+}
+
+AudioEncoder *AudioEncoderService::add_rendition(const string &name, const string &codec_name, int bit_rate, const AVOutputFormat *oformat)
+{
+	assert(!started);
+	Rendition *rendition = new Rendition;
+	renditions.emplace_back(rendition);
+	rendition->name = name;
+	rendition->codec_name = codec_name;
+	rendition->encoder.reset(new AudioEncoder(codec_name, bit_rate, oformat));
+	rendition->slots.resize(AUDIO_ENCODER_QUEUE_LENGTH);
+
+	rendition->metric_labels = {{ "rendition", name }, { "codec", codec_name }};
+	global_metrics.add("audio_encoder_cpu_time_seconds", rendition->metric_labels, &rendition->metric_cpu_time_seconds);
+	global_metrics.add("audio_encoder_queued_chunks", rendition->metric_labels, &rendition->metric_queued_chunks, Metrics::TYPE_GAUGE);
+	global_metrics.add("audio_encoder_dropped_chunks", rendition->metric_labels, &rendition->metric_dropped_chunks);
+	return rendition->encoder.get();
+}
+
+void AudioEncoderService::encode_audio(const vector<float> &audio, int64_t audio_pts)
+{
+	assert(!stopped);
+	if (!started) {
+		for (const unique_ptr<Rendition> &rendition : renditions) {
+			rendition->encoder_thread = thread(&AudioEncoderService::encoder_thread_func, this, rendition.get());
+		}
+		started = true;
+	}
+
+	for (const unique_ptr<Rendition> &rendition : renditions) {
+		size_t slot_index;
+		{
+			lock_guard<mutex> lock(rendition->mu);
+			if (rendition->num_queued == AUDIO_ENCODER_QUEUE_LENGTH) {
+				fprintf(stderr, "WARNING: Audio encoder queue for '%s' full, dropping audio with pts %ld\n",
+					rendition->name.c_str(), audio_pts);
+				++rendition->metric_dropped_chunks;
+				continue;
+			}
+			slot_index = (rendition->first_queued + rendition->num_queued) % AUDIO_ENCODER_QUEUE_LENGTH;
+		}
+
+		// The slot is ours until we tell the encoder thread about it,
+		// so we can fill it without holding the lock.
+		QueuedAudio *slot = &rendition->slots[slot_index];
+		slot->audio.assign(audio.begin(), audio.end());  // Reuses the old allocation, if it is large enough.
+		slot->pts = audio_pts;
+
+		{
+			lock_guard<mutex> lock(rendition->mu);
+			++rendition->num_queued;
+			rendition->metric_queued_chunks = rendition->num_queued;
+		}
+		rendition->queued_audio_nonempty.notify_all();
+	}
+}
+
+void AudioEncoderService::stop()
+{
+	if (stopped) {
+		return;
+	}
+	stopped = true;
+	if (!started) {
+		return;
+	}
+	for (const unique_ptr<Rendition> &rendition : renditions) {
+		{
+			lock_guard<mutex> lock(rendition->mu);
+			rendition->should_quit = true;
+		}
+		rendition->queued_audio_nonempty.notify_all();
+	}
+	for (const unique_ptr<Rendition> &rendition : renditions) {
+		rendition->encoder_thread.join();
+	}
+}
+
+void AudioEncoderService::encoder_thread_func(Rendition *rendition)
+{
+	char thread_name[16];
+	snprintf(thread_name, sizeof(thread_name), "AudioEnc_%s", rendition->codec_name.c_str());
+	pthread_setname_np(pthread_self(), thread_name);
+
+	for ( ;; ) {
+		QueuedAudio *slot;
+		{
+			unique_lock<mutex> lock(rendition->mu);
+			rendition->queued_audio_nonempty.wait(lock, [rendition]() {
+				return rendition->should_quit || rendition->num_queued > 0;
+			});
+			if (rendition->num_queued == 0) {
+				// should_quit is set, and everything is encoded.
+				break;
+			}
+			slot = &rendition->slots[rendition->first_queued];
+		}
+
+		const double start_cpu_time = thread_cpu_time_seconds();
+		rendition->encoder->encode_audio(slot->audio, slot->pts);
+		rendition->metric_cpu_time_seconds = rendition->metric_cpu_time_seconds + (thread_cpu_time_seconds() - start_cpu_time);
+
+		lock_guard<mutex> lock(rendition->mu);
+		rendition->first_queued = (rendition->first_queued + 1) % AUDIO_ENCODER_QUEUE_LENGTH;
+		--rendition->num_queued;
+		rendition->metric_queued_chunks = rendition->num_queued;
+	}
+
+	const double start_cpu_time = thread_cpu_time_seconds();
+	rendition->encoder->encode_last_audio();
+	rendition->metric_cpu_time_seconds = rendition->metric_cpu_time_seconds + (thread_cpu_time_seconds() - start_cpu_time);
+}
@@ -0,0 +1,87 @@
+// Encodes the same audio into several renditions (e.g. Opus for one set of
+// consumers, AAC for another, and PCM for a third), each with its own
+// AudioEncoder on its own thread. encode_audio() only copies the audio into
+// each rendition's queue, so the caller (normally the mixer's audio thread)
+// does not need to wait for any codec. Every rendition sends its packets
+// to its own set of muxes; see add_rendition().
+//
+// If a rendition cannot keep up, its queue fills up and new audio is dropped
+// for that rendition only (with a warning and a metric), like X264Encoder
+// does with video frames. CPU time used by each rendition's encoder is
+// exported as a metric.
+
+#ifndef _AUDIO_ENCODER_SERVICE_H
+#define _AUDIO_ENCODER_SERVICE_H 1
+
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+extern "C" {
+#include <libavformat/avformat.h>
+}
+
+#include "audio_encoder.h"
+
+class AudioEncoderService {
+public:
+	AudioEncoderService() {}
+	~AudioEncoderService();
+
+	// Adds a new rendition. <name> is used only for metrics and messages.
+	// Returns the encoder, so that you can call add_mux() and
+	// get_codec_parameters() on it; it is still owned by the service,
+	// and the muxes must outlive it. Must be called before the first call
+	// to encode_audio().
+	AudioEncoder *add_rendition(const std::string &name, const std::string &codec_name, int bit_rate, const AVOutputFormat *oformat);
+
+	// Queues the given audio (interleaved stereo) for all renditions.
+	// Does not allocate after warmup.
+	void encode_audio(const std::vector<float> &audio, int64_t audio_pts);
+
+	// Encodes everything that is queued, flushes all the encoders
+	// (see AudioEncoder::encode_last_audio()), and stops the threads.
+	// Called automatically on destruction if you have not done so.
+	void stop();
+
+private:
+	struct QueuedAudio {
+		std::vector<float> audio;
+		int64_t pts;
+	};
+
+	struct Rendition {
+		std::string name, codec_name;
+		std::unique_ptr<AudioEncoder> encoder;
+		std::thread encoder_thread;
+
+		// A ring of AUDIO_ENCODER_QUEUE_LENGTH slots. The slots themselves
+		// are not protected by <mu>; only the encoder thread touches the
+		// <num_queued> slots starting at <first_queued>, and only
+		// encode_audio() touches the rest.
+		std::vector<QueuedAudio> slots;
+		std::mutex mu;
+		std::condition_variable queued_audio_nonempty;
+		bool should_quit = false;  // Under <mu>.
+		size_t first_queued = 0, num_queued = 0;  // Under <mu>.
+
+		// Metrics.
+		std::atomic<double> metric_cpu_time_seconds{0.0};
+		std::atomic<int64_t> metric_queued_chunks{0};
+		std::atomic<int64_t> metric_dropped_chunks{0};
+		std::vector<std::pair<std::string, std::string>> metric_labels;
+	};
+
+	void encoder_thread_func(Rendition *rendition);
+
+	std::vector<std::unique_ptr<Rendition>> renditions;
+	bool started = false, stopped = false;
+};
+
+#endif  // !defined(_AUDIO_ENCODER_SERVICE_H)
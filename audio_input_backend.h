@@ -0,0 +1,34 @@
+#ifndef _AUDIO_INPUT_BACKEND_H
+#define _AUDIO_INPUT_BACKEND_H 1
+
+// What ALSAPool needs from one of its capture devices. Normally, that's
+// a real sound card (ALSAInput), but it can also be a stand-in that plays
+// back a file (FileAudioInput), so that the ALSA path can be tested and
+// benchmarked without any sound cards.
+//
+// Either way, the backend runs its own capture thread, and sends audio
+// to the callback as it comes in. If the callback returns false, it means
+// “retry later” (typically, the mixer's input queue is full); the backend
+// then waits for about one period and sends the same audio again, unless
+// it has been asked to quit in the meantime.
+
+#include <stdint.h>
+#include <chrono>
+#include <functional>
+
+#include "bmusb/bmusb.h"
+
+class AudioInputBackend {
+public:
+	typedef std::function<bool(const uint8_t *data, unsigned num_samples, bmusb::AudioFormat audio_format, int64_t frame_length, std::chrono::steady_clock::time_point ts)> audio_callback_t;
+
+	virtual ~AudioInputBackend() {}
+
+	// Not valid before the device has been successfully opened.
+	virtual unsigned get_sample_rate() const = 0;
+
+	virtual void start_capture_thread() = 0;
+	virtual void stop_capture_thread() = 0;
+};
+
+#endif  // !defined(_AUDIO_INPUT_BACKEND_H)
@@ -0,0 +1,31 @@
+#include "audio_input_queue.h"
+
+#include <assert.h>
+
+using namespace std;
+
+bool AudioInputQueue::push(const ChunkHeader &header, const uint8_t *data)
+{
+	// The header and data are published together, so the consumer only ever
+	// sees whole chunks (which matters for clear() in particular).
+	return buffer.write_both(reinterpret_cast<const uint8_t *>(&header), sizeof(header), data, header.num_bytes);
+}
+
+bool AudioInputQueue::pop(ChunkHeader *header, vector<uint8_t> *data)
+{
+	const size_t available = buffer.size();
+	if (available < sizeof(*header)) {
+		return false;
+	}
+	buffer.peek(reinterpret_cast<uint8_t *>(header), sizeof(*header));
+	if (available < sizeof(*header) + header->num_bytes) {
+		return false;
+	}
+	buffer.consume(sizeof(*header));
+
+	data->resize(header->num_bytes);
+	size_t bytes_read = buffer.read(data->data(), header->num_bytes);
+	assert(bytes_read == header->num_bytes);
+	(void)bytes_read;
+	return true;
+}
@@ -0,0 +1,57 @@
+#ifndef _AUDIO_INPUT_QUEUE_H
+#define _AUDIO_INPUT_QUEUE_H 1
+
+// A queue of raw audio chunks from a capture thread to the audio mixer,
+// so that capture threads never need to wait for the mixer lock (and thus
+// for the entire DSP pass of the audio thread). Each chunk is a small header
+// followed by the PCM data exactly as it came from the card; conversion and
+// resampling happen on the audio thread when the queue is drained.
+//
+// It is wait-free for one producer and one consumer (it is simply a
+// RingBuffer of bytes underneath). If the consumer stops draining, the queue
+// eventually fills up; push() then fails, and it is up to the producer
+// what to do about it.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <chrono>
+#include <vector>
+
+#include "ring_buffer.h"
+
+class AudioInputQueue {
+public:
+	struct ChunkHeader {
+		std::chrono::steady_clock::time_point frame_time;
+		uint32_t num_samples;
+		uint32_t num_frames;  // Number of times to repeat the chunk; only used for silence.
+		uint32_t num_bytes;  // Number of bytes of PCM data following the header. Zero for silence.
+		uint32_t bits_per_sample;
+		uint32_t num_channels;
+		uint32_t sample_rate;
+		bool silence;
+	};
+
+	// Not thread-safe; must happen before any producer touches the queue.
+	// Existing contents are kept if they fit.
+	void resize(size_t num_bytes) { buffer.resize(num_bytes); }
+	bool is_allocated() const { return buffer.get_capacity() > 0; }
+
+	// Producer side. Returns false (and pushes nothing) if there is not room
+	// for the entire chunk.
+	bool push(const ChunkHeader &header, const uint8_t *data);
+
+	// Consumer side. Pops the oldest complete chunk, if any, and puts its
+	// PCM data in <data> (which is resized as needed).
+	bool pop(ChunkHeader *header, std::vector<uint8_t> *data);
+
+	// Consumer side. Throws away everything that is currently in the queue.
+	// Since push() publishes whole chunks at a time, this never leaves
+	// a partial chunk behind.
+	void clear() { buffer.consume(buffer.size()); }
+
+private:
+	RingBuffer<uint8_t> buffer;
+};
+
+#endif  // !defined(_AUDIO_INPUT_QUEUE_H)
@@ -2,8 +2,8 @@
 
 #include <assert.h>
 #include <bmusb/bmusb.h>
-#include <endian.h>
 #include <math.h>
+#include <pthread.h>
 #ifdef __SSE2__
 #include <immintrin.h>
 #endif
@@ -18,6 +18,7 @@
 #include <limits>
 #include <utility>
 
+#include "audio_conversion.h"
 #include "db.h"
 #include "flags.h"
 #include "metrics.h"
@@ -31,65 +32,41 @@ using namespace std::placeholders;
 
 namespace {
 
-// TODO: If these prove to be a bottleneck, they can be SSSE3-optimized
-// (usually including multiple channels at a time).
+constexpr float bass_freq_hz = 200.0f;
+constexpr float treble_freq_hz = 4700.0f;
 
-void convert_fixed16_to_fp32(float *dst, size_t out_channel, size_t out_num_channels,
-                             const uint8_t *src, size_t in_channel, size_t in_num_channels,
-                             size_t num_samples)
+float hz_to_linear_cutoff(float cutoff_hz)
 {
-	assert(in_channel < in_num_channels);
-	assert(out_channel < out_num_channels);
-	src += in_channel * 2;
-	dst += out_channel;
-
-	for (size_t i = 0; i < num_samples; ++i) {
-		int16_t s = le16toh(*(int16_t *)src);
-		*dst = s * (1.0f / 32768.0f);
-
-		src += 2 * in_num_channels;
-		dst += out_num_channels;
-	}
+	return cutoff_hz * 2.0 * M_PI / OUTPUT_FREQUENCY;
 }
 
-void convert_fixed24_to_fp32(float *dst, size_t out_channel, size_t out_num_channels,
-                             const uint8_t *src, size_t in_channel, size_t in_num_channels,
-                             size_t num_samples)
-{
-	assert(in_channel < in_num_channels);
-	assert(out_channel < out_num_channels);
-	src += in_channel * 3;
-	dst += out_channel;
-
-	for (size_t i = 0; i < num_samples; ++i) {
-		uint32_t s1 = src[0];
-		uint32_t s2 = src[1];
-		uint32_t s3 = src[2];
-		uint32_t s = s1 | (s1 << 8) | (s2 << 16) | (s3 << 24);
-		*dst = int(s) * (1.0f / 2147483648.0f);
-
-		src += 3 * in_num_channels;
-		dst += out_num_channels;
+// Adds the time from construction to destruction to <*location_ns>,
+// unless <location_ns> is nullptr. See AudioMixer::set_stage_timing_enabled().
+class ScopedStageTimer {
+public:
+	explicit ScopedStageTimer(atomic<int64_t> *location_ns)
+		: location_ns(location_ns)
+	{
+		if (location_ns != nullptr) {
+			start = steady_clock::now();
+		}
 	}
-}
 
-void convert_fixed32_to_fp32(float *dst, size_t out_channel, size_t out_num_channels,
-                             const uint8_t *src, size_t in_channel, size_t in_num_channels,
-                             size_t num_samples)
-{
-	assert(in_channel < in_num_channels);
-	assert(out_channel < out_num_channels);
-	src += in_channel * 4;
-	dst += out_channel;
+	~ScopedStageTimer() { stop(); }
 
-	for (size_t i = 0; i < num_samples; ++i) {
-		int32_t s = le32toh(*(int32_t *)src);
-		*dst = s * (1.0f / 2147483648.0f);
-
-		src += 4 * in_num_channels;
-		dst += out_num_channels;
+	// Ends the timing early.
+	void stop()
+	{
+		if (location_ns != nullptr) {
+			*location_ns += duration_cast<nanoseconds>(steady_clock::now() - start).count();
+			location_ns = nullptr;
+		}
 	}
-}
+
+private:
+	atomic<int64_t> *location_ns;
+	steady_clock::time_point start;
+};
 
 float find_peak_plain(const float *samples, size_t num_samples) __attribute__((unused));
 
@@ -150,18 +127,18 @@ float find_peak(const float *samples, size_t num_samples)
 }
 #endif
 
-void deinterleave_samples(const vector<float> &in, vector<float> *out_l, vector<float> *out_r)
+void interleave_samples(const vector<float> &in_l, const vector<float> &in_r, vector<float> *out)
 {
-	size_t num_samples = in.size() / 2;
-	out_l->resize(num_samples);
-	out_r->resize(num_samples);
+	assert(in_l.size() == in_r.size());
+	size_t num_samples = in_l.size();
+	out->resize(num_samples * 2);
 
-	const float *inptr = in.data();
-	float *lptr = &(*out_l)[0];
-	float *rptr = &(*out_r)[0];
+	const float *lptr = in_l.data();
+	const float *rptr = in_r.data();
+	float *outptr = &(*out)[0];
 	for (size_t i = 0; i < num_samples; ++i) {
-		*lptr++ = *inptr++;
-		*rptr++ = *inptr++;
+		*outptr++ = *lptr++;
+		*outptr++ = *rptr++;
 	}
 }
 
@@ -169,6 +146,8 @@ void deinterleave_samples(const vector<float> &in, vector<float> *out_l, vector<
 
 AudioMixer::AudioMixer(unsigned num_cards)
 	: num_cards(num_cards),
+	  bass_eq_coefficients(FILTER_LOW_SHELF, 1, hz_to_linear_cutoff(bass_freq_hz), 0.5f),
+	  treble_eq_coefficients(FILTER_HIGH_SHELF, 1, hz_to_linear_cutoff(treble_freq_hz), 0.5f),
 	  limiter(OUTPUT_FREQUENCY),
 	  correlation(OUTPUT_FREQUENCY)
 {
@@ -188,9 +167,25 @@ AudioMixer::AudioMixer(unsigned num_cards)
 	r128.init(2, OUTPUT_FREQUENCY);
 	r128.integr_start();
 
-	// hlen=16 is pretty low quality, but we use quite a bit of CPU otherwise,
-	// and there's a limit to how important the peak meter is.
-	peak_resampler.setup(OUTPUT_FREQUENCY, OUTPUT_FREQUENCY * 4, /*num_channels=*/2, /*hlen=*/16, /*frel=*/1.0);
+	for (TruePeakDetector &detector : true_peak_detector) {
+		detector = TruePeakDetector(global_flags.audio_true_peak_oversampling);
+	}
+	loudness_momentary_lufs = r128.loudness_M();
+
+	if (global_flags.audio_bus_threads > 0) {
+		bus_worker_pool.reset(new WorkerPool(global_flags.audio_bus_threads, "AudioBus"));
+	}
+	if (global_flags.audio_resampling_threads > 0) {
+		resampling_worker_pool.reset(new WorkerPool(global_flags.audio_resampling_threads, "Resample"));
+	}
+
+	use_metering_thread = global_flags.audio_metering_thread;
+	if (use_metering_thread) {
+		for (RingBuffer<float> &queue : metering_queue) {
+			queue.resize(OUTPUT_FREQUENCY);  // At least a second of audio.
+		}
+		metering_thread = thread(&AudioMixer::metering_thread_func, this);
+	}
 
 	global_audio_mixer = this;
 	alsa_pool.init();
@@ -221,11 +216,22 @@ AudioMixer::AudioMixer(unsigned num_cards)
 	global_metrics.add("audio_peak_dbfs", &metric_audio_peak_dbfs, Metrics::TYPE_GAUGE);
 	global_metrics.add("audio_final_makeup_gain_db", &metric_audio_final_makeup_gain_db, Metrics::TYPE_GAUGE);
 	global_metrics.add("audio_correlation", &metric_audio_correlation, Metrics::TYPE_GAUGE);
+	global_metrics.add("audio_meter_dropped_frames", &metric_audio_meter_dropped_frames);
+}
+
+AudioMixer::~AudioMixer()
+{
+	if (metering_thread.joinable()) {
+		metering_thread_should_quit = true;
+		metering_queue_changed.notify_all();
+		metering_thread.join();
+	}
 }
 
 void AudioMixer::reset_resampler(DeviceSpec device_spec)
 {
 	lock_guard<timed_mutex> lock(audio_mutex);
+	find_audio_device(device_spec)->input_queue.clear();
 	reset_resampler_mutex_held(device_spec);
 }
 
@@ -247,74 +253,111 @@ void AudioMixer::reset_resampler_mutex_held(DeviceSpec device_spec)
 bool AudioMixer::add_audio(DeviceSpec device_spec, const uint8_t *data, unsigned num_samples, AudioFormat audio_format, int64_t frame_length, steady_clock::time_point frame_time)
 {
 	AudioDevice *device = find_audio_device(device_spec);
+	if (!device->input_queue_active.load(memory_order_acquire)) {
+		// No buses use this device; throw it away.
+		return true;
+	}
 
-	unique_lock<timed_mutex> lock(audio_mutex, defer_lock);
-	if (!lock.try_lock_for(chrono::milliseconds(10))) {
-		return false;
+	if (audio_format.bits_per_sample != 0 &&
+	    audio_format.bits_per_sample != 16 &&
+	    audio_format.bits_per_sample != 24 &&
+	    audio_format.bits_per_sample != 32) {
+		fprintf(stderr, "Cannot handle audio with %u bits per sample\n", audio_format.bits_per_sample);
+		assert(false);
 	}
-	if (device->resampling_queue == nullptr) {
+	assert(audio_format.bits_per_sample != 0 || num_samples == 0);
+
+	AudioInputQueue::ChunkHeader header;
+	header.frame_time = frame_time;
+	header.num_samples = num_samples;
+	header.num_frames = 1;
+	header.num_bytes = num_samples * audio_format.num_channels * (audio_format.bits_per_sample / 8);
+	header.bits_per_sample = audio_format.bits_per_sample;
+	header.num_channels = audio_format.num_channels;
+	header.sample_rate = audio_format.sample_rate;
+	header.silence = false;
+	return push_to_input_queue(device, header, data);
+}
+
+bool AudioMixer::add_silence(DeviceSpec device_spec, unsigned samples_per_frame, unsigned num_frames, int64_t frame_length)
+{
+	AudioDevice *device = find_audio_device(device_spec);
+	if (!device->input_queue_active.load(memory_order_acquire)) {
 		// No buses use this device; throw it away.
 		return true;
 	}
 
-	unsigned num_channels = device->interesting_channels.size();
-	assert(num_channels > 0);
+	AudioInputQueue::ChunkHeader header;
+	header.frame_time = steady_clock::now();
+	header.num_samples = samples_per_frame;
+	header.num_frames = num_frames;
+	header.num_bytes = 0;
+	header.bits_per_sample = 0;
+	header.num_channels = 0;
+	header.sample_rate = 0;
+	header.silence = true;
+	return push_to_input_queue(device, header, nullptr);
+}
 
-	// Convert the audio to fp32.
-	unique_ptr<float[]> audio(new float[num_samples * num_channels]);
-	unsigned channel_index = 0;
-	for (auto channel_it = device->interesting_channels.cbegin(); channel_it != device->interesting_channels.end(); ++channel_it, ++channel_index) {
-		switch (audio_format.bits_per_sample) {
-		case 0:
-			assert(num_samples == 0);
-			break;
-		case 16:
-			convert_fixed16_to_fp32(audio.get(), channel_index, num_channels, data, *channel_it, audio_format.num_channels, num_samples);
-			break;
-		case 24:
-			convert_fixed24_to_fp32(audio.get(), channel_index, num_channels, data, *channel_it, audio_format.num_channels, num_samples);
-			break;
-		case 32:
-			convert_fixed32_to_fp32(audio.get(), channel_index, num_channels, data, *channel_it, audio_format.num_channels, num_samples);
-			break;
-		default:
-			fprintf(stderr, "Cannot handle audio with %u bits per sample\n", audio_format.bits_per_sample);
-			assert(false);
+bool AudioMixer::push_to_input_queue(AudioDevice *device, const AudioInputQueue::ChunkHeader &header, const uint8_t *data)
+{
+	if (!device->input_queue.push(header, data)) {
+		// Count each time the queue fills up, not every retry while it is full.
+		if (!device->input_queue_full) {
+			++device->metric_input_queue_full;
+			device->input_queue_full = true;
 		}
+		return false;
 	}
-
-	// If we changed frequency since last frame, we'll need to reset the resampler.
-	if (audio_format.sample_rate != device->capture_frequency) {
-		device->capture_frequency = audio_format.sample_rate;
-		reset_resampler_mutex_held(device_spec);
-	}
-
-	// Now add it.
-	device->resampling_queue->add_input_samples(frame_time, audio.get(), num_samples, ResamplingQueue::ADJUST_RATE);
+	device->input_queue_full = false;
 	return true;
 }
 
-bool AudioMixer::add_silence(DeviceSpec device_spec, unsigned samples_per_frame, unsigned num_frames, int64_t frame_length)
+// Move everything that the capture thread has given us since last time
+// over to the resampling queue.
+void AudioMixer::drain_input_queue_mutex_held(DeviceSpec device_spec)
 {
 	AudioDevice *device = find_audio_device(device_spec);
+	int64_t queue_length_samples = 0;
+
+	AudioInputQueue::ChunkHeader header;
+	while (device->input_queue.pop(&header, &device->input_bytes)) {
+		queue_length_samples += int64_t(header.num_samples) * header.num_frames;
+		if (device->resampling_queue == nullptr) {
+			// No buses use this device (any longer); throw it away.
+			continue;
+		}
 
-	unique_lock<timed_mutex> lock(audio_mutex, defer_lock);
-	if (!lock.try_lock_for(chrono::milliseconds(10))) {
-		return false;
-	}
-	if (device->resampling_queue == nullptr) {
-		// No buses use this device; throw it away.
-		return true;
-	}
+		const unsigned num_channels = device->interesting_channels.size();
+		assert(num_channels > 0);
+		vector<float> &audio = device->input_samples;
 
-	unsigned num_channels = device->interesting_channels.size();
-	assert(num_channels > 0);
+		if (header.silence) {
+			audio.assign(header.num_samples * num_channels, 0.0f);
+			for (unsigned i = 0; i < header.num_frames; ++i) {
+				device->resampling_queue->add_input_samples(header.frame_time, audio.data(), header.num_samples, ResamplingQueue::DO_NOT_ADJUST_RATE);
+			}
+			continue;
+		}
+
+		// Convert the audio to fp32.
+		audio.resize(header.num_samples * num_channels);
+		if (header.bits_per_sample != 0) {
+			convert_fixed_to_fp32(audio.data(), num_channels, device->input_bytes.data(), device->interesting_channel_list.data(), header.num_channels,
+				header.bits_per_sample, header.num_samples);
+		}
 
-	vector<float> silence(samples_per_frame * num_channels, 0.0f);
-	for (unsigned i = 0; i < num_frames; ++i) {
-		device->resampling_queue->add_input_samples(steady_clock::now(), silence.data(), samples_per_frame, ResamplingQueue::DO_NOT_ADJUST_RATE);
+		// If we changed frequency since last frame, we'll need to reset the resampler.
+		if (header.sample_rate != device->capture_frequency) {
+			device->capture_frequency = header.sample_rate;
+			reset_resampler_mutex_held(device_spec);
+		}
+
+		// Now add it.
+		device->resampling_queue->add_input_samples(header.frame_time, audio.data(), header.num_samples, ResamplingQueue::ADJUST_RATE);
 	}
-	return true;
+
+	device->metric_input_queue_length_samples = queue_length_samples;
 }
 
 bool AudioMixer::silence_card(DeviceSpec device_spec, bool silence)
@@ -327,6 +370,7 @@ bool AudioMixer::silence_card(DeviceSpec device_spec, bool silence)
 	}
 
 	if (device->silenced && !silence) {
+		device->input_queue.clear();
 		reset_resampler_mutex_held(device_spec);
 	}
 	device->silenced = silence;
@@ -396,9 +440,35 @@ AudioMixer::AudioDevice *AudioMixer::find_audio_device(DeviceSpec device)
 	return nullptr;
 }
 
+unsigned AudioMixer::get_device_slot(DeviceSpec device_spec)
+{
+	switch (device_spec.type) {
+	case InputSourceType::CAPTURE_CARD:
+		assert(device_spec.index < MAX_VIDEO_CARDS);
+		return device_spec.index;
+	case InputSourceType::ALSA_INPUT:
+		assert(device_spec.index < MAX_ALSA_CARDS);
+		return MAX_VIDEO_CARDS + device_spec.index;
+	case InputSourceType::SILENCE:
+	default:
+		assert(false);
+	}
+	return 0;
+}
+
+DeviceSpec AudioMixer::get_device_spec_from_slot(unsigned device_slot)
+{
+	assert(device_slot < num_device_slots);
+	if (device_slot < MAX_VIDEO_CARDS) {
+		return DeviceSpec{InputSourceType::CAPTURE_CARD, device_slot};
+	} else {
+		return DeviceSpec{InputSourceType::ALSA_INPUT, device_slot - MAX_VIDEO_CARDS};
+	}
+}
+
 // Get a pointer to the given channel from the given device.
 // The channel must be picked out earlier and resampled.
-void AudioMixer::find_sample_src_from_device(const map<DeviceSpec, vector<float>> &samples_card, DeviceSpec device_spec, int source_channel, const float **srcptr, unsigned *stride)
+void AudioMixer::find_sample_src_from_device(DeviceSpec device_spec, int source_channel, const float **srcptr, unsigned *stride)
 {
 	static float zero = 0.0f;
 	if (source_channel == -1 || device_spec.type == InputSourceType::SILENCE) {
@@ -407,77 +477,59 @@ void AudioMixer::find_sample_src_from_device(const map<DeviceSpec, vector<float>
 		return;
 	}
 	AudioDevice *device = find_audio_device(device_spec);
-	assert(device->interesting_channels.count(source_channel) != 0);
-	unsigned channel_index = 0;
-	for (int channel : device->interesting_channels) {
-		if (channel == source_channel) break;
-		++channel_index;
-	}
-	assert(channel_index < device->interesting_channels.size());
-	const auto it = samples_card.find(device_spec);
-	assert(it != samples_card.end());
-	*srcptr = &(it->second)[channel_index];
-	*stride = device->interesting_channels.size();
+	const vector<unsigned> &channels = device->interesting_channel_list;
+	const auto channel_it = lower_bound(channels.begin(), channels.end(), unsigned(source_channel));
+	assert(channel_it != channels.end() && *channel_it == unsigned(source_channel));
+	*srcptr = &scratch.samples_card[get_device_slot(device_spec)][channel_it - channels.begin()];
+	*stride = channels.size();
 }
 
-// TODO: Can be SSSE3-optimized if need be.
-void AudioMixer::fill_audio_bus(const map<DeviceSpec, vector<float>> &samples_card, const InputMapping::Bus &bus, unsigned num_samples, float *output)
+void AudioMixer::fill_audio_bus(const InputMapping::Bus &bus, StereoBuffer *output)
 {
+	const unsigned num_samples = output->size();
 	if (bus.device.type == InputSourceType::SILENCE) {
-		memset(output, 0, num_samples * 2 * sizeof(*output));
+		memset(output->left.data(), 0, num_samples * sizeof(float));
+		memset(output->right.data(), 0, num_samples * sizeof(float));
 	} else {
 		assert(bus.device.type == InputSourceType::CAPTURE_CARD ||
 		       bus.device.type == InputSourceType::ALSA_INPUT);
 		const float *lsrc, *rsrc;
 		unsigned lstride, rstride;
-		float *dptr = output;
-		find_sample_src_from_device(samples_card, bus.device, bus.source_channel[0], &lsrc, &lstride);
-		find_sample_src_from_device(samples_card, bus.device, bus.source_channel[1], &rsrc, &rstride);
+		find_sample_src_from_device(bus.device, bus.source_channel[0], &lsrc, &lstride);
+		find_sample_src_from_device(bus.device, bus.source_channel[1], &rsrc, &rstride);
+		float *lptr = output->left.data();
+		float *rptr = output->right.data();
 		for (unsigned i = 0; i < num_samples; ++i) {
-			*dptr++ = *lsrc;
-			*dptr++ = *rsrc;
+			*lptr++ = *lsrc;
+			*rptr++ = *rsrc;
 			lsrc += lstride;
 			rsrc += rstride;
 		}
 	}
 }
 
-vector<DeviceSpec> AudioMixer::get_active_devices() const
-{
-	vector<DeviceSpec> ret;
-	for (unsigned card_index = 0; card_index < MAX_VIDEO_CARDS; ++card_index) {
-		const DeviceSpec device_spec{InputSourceType::CAPTURE_CARD, card_index};
-		if (!find_audio_device(device_spec)->interesting_channels.empty()) {
-			ret.push_back(device_spec);
-		}
-	}
-	for (unsigned card_index = 0; card_index < MAX_ALSA_CARDS; ++card_index) {
-		const DeviceSpec device_spec{InputSourceType::ALSA_INPUT, card_index};
-		if (!find_audio_device(device_spec)->interesting_channels.empty()) {
-			ret.push_back(device_spec);
-		}
-	}
-	return ret;
-}
-
 namespace {
 
-void apply_gain(float db, float last_db, vector<float> *samples)
+void apply_gain(float db, float last_db, vector<float> *left, vector<float> *right)
 {
+	assert(left->size() == right->size());
+	const unsigned num_samples = left->size();
+	float *lptr = left->data();
+	float *rptr = right->data();
 	if (fabs(db - last_db) < 1e-3) {
 		// Constant over this frame.
 		const float gain = from_db(db);
-		for (size_t i = 0; i < samples->size(); ++i) {
-			(*samples)[i] *= gain;
+		for (size_t i = 0; i < num_samples; ++i) {
+			lptr[i] *= gain;
+			rptr[i] *= gain;
 		}
 	} else {
 		// We need to do a fade.
-		unsigned num_samples = samples->size() / 2;
 		float gain = from_db(last_db);
 		const float gain_inc = pow(from_db(db - last_db), 1.0 / num_samples);
 		for (size_t i = 0; i < num_samples; ++i) {
-			(*samples)[i * 2 + 0] *= gain;
-			(*samples)[i * 2 + 1] *= gain;
+			lptr[i] *= gain;
+			rptr[i] *= gain;
 			gain *= gain_inc;
 		}
 	}
@@ -487,84 +539,120 @@ void apply_gain(float db, float last_db, vector<float> *samples)
 
 vector<float> AudioMixer::get_output(steady_clock::time_point ts, unsigned num_samples, ResamplingQueue::RateAdjustmentPolicy rate_adjustment_policy)
 {
-	map<DeviceSpec, vector<float>> samples_card;
-	vector<float> samples_bus;
+	vector<float> samples_out;
+	get_output(ts, num_samples, rate_adjustment_policy, &samples_out);
+	return samples_out;
+}
+
+const char *AudioMixer::get_processing_stage_name(ProcessingStage stage)
+{
+	switch (stage) {
+	case STAGE_CONVERSION:
+		return "conversion";
+	case STAGE_RESAMPLING:
+		return "resampling";
+	case STAGE_MIXING:
+		return "mixing";
+	case STAGE_EQ:
+		return "eq";
+	case STAGE_COMPRESSION:
+		return "compression";
+	case STAGE_METERING:
+		return "metering";
+	case STAGE_R128:
+		return "r128";
+	default:
+		assert(false);
+		return nullptr;
+	}
+}
+
+void AudioMixer::get_last_stage_times(double times[NUM_PROCESSING_STAGES]) const
+{
+	for (unsigned stage = 0; stage < NUM_PROCESSING_STAGES; ++stage) {
+		times[stage] = stage_time_ns[stage] * 1e-9;
+	}
+}
+
+void AudioMixer::get_output(steady_clock::time_point ts, unsigned num_samples, ResamplingQueue::RateAdjustmentPolicy rate_adjustment_policy, vector<float> *samples_out_ptr)
+{
+	vector<float> &samples_out = *samples_out_ptr;
 
 	lock_guard<timed_mutex> lock(audio_mutex);
 
-	// Pick out all the interesting channels from all the cards.
-	for (const DeviceSpec &device_spec : get_active_devices()) {
-		AudioDevice *device = find_audio_device(device_spec);
-		samples_card[device_spec].resize(num_samples * device->interesting_channels.size());
-		if (device->silenced) {
-			memset(&samples_card[device_spec][0], 0, samples_card[device_spec].size() * sizeof(float));
-		} else {
-			device->resampling_queue->get_output_samples(
-				ts,
-				&samples_card[device_spec][0],
-				num_samples,
-				rate_adjustment_policy);
+	if (stage_timing_enabled) {
+		for (unsigned stage = 0; stage < NUM_PROCESSING_STAGES; ++stage) {
+			stage_time_ns[stage] = 0;
 		}
 	}
 
-	vector<float> samples_out, left, right;
-	samples_out.resize(num_samples * 2);
-	samples_bus.resize(num_samples * 2);
-	for (unsigned bus_index = 0; bus_index < input_mapping.buses.size(); ++bus_index) {
-		fill_audio_bus(samples_card, input_mapping.buses[bus_index], num_samples, &samples_bus[0]);
-		apply_eq(bus_index, &samples_bus);
+	if (num_samples > scratch.max_samples) {
+		reserve_scratch_buffers_lock_held(num_samples);
+	}
 
+	// Pick out all the interesting channels from all the cards.
+	unsigned devices_to_resample[num_device_slots];
+	unsigned num_devices_to_resample = 0;
+	for (unsigned device_slot = 0; device_slot < num_device_slots; ++device_slot) {
+		const DeviceSpec device_spec = get_device_spec_from_slot(device_slot);
+		AudioDevice *device = find_audio_device(device_spec);
+		if (!device->input_queue_active) {
+			continue;
+		}
 		{
-			lock_guard<mutex> lock(compressor_mutex);
-
-			// Apply a level compressor to get the general level right.
-			// Basically, if it's over about -40 dBFS, we squeeze it down to that level
-			// (or more precisely, near it, since we don't use infinite ratio),
-			// then apply a makeup gain to get it to -14 dBFS. -14 dBFS is, of course,
-			// entirely arbitrary, but from practical tests with speech, it seems to
-			// put ut around -23 LUFS, so it's a reasonable starting point for later use.
-			if (level_compressor_enabled[bus_index]) {
-				float threshold = 0.01f;   // -40 dBFS.
-				float ratio = 20.0f;
-				float attack_time = 0.5f;
-				float release_time = 20.0f;
-				float makeup_gain = from_db(ref_level_dbfs - (-40.0f));  // +26 dB.
-				level_compressor[bus_index]->process(samples_bus.data(), samples_bus.size() / 2, threshold, ratio, attack_time, release_time, makeup_gain);
-				gain_staging_db[bus_index] = to_db(level_compressor[bus_index]->get_attenuation() * makeup_gain);
-			} else {
-				// Just apply the gain we already had.
-				float db = gain_staging_db[bus_index];
-				float last_db = last_gain_staging_db[bus_index];
-				apply_gain(db, last_db, &samples_bus);
-			}
-			last_gain_staging_db[bus_index] = gain_staging_db[bus_index];
+			ScopedStageTimer timer(stage_timer_location(STAGE_CONVERSION));
+			drain_input_queue_mutex_held(device_spec);
+		}
+		if (!device->interesting_channels.empty()) {
+			devices_to_resample[num_devices_to_resample++] = device_slot;
+		}
+	}
 
-#if 0
-			printf("level=%f (%+5.2f dBFS) attenuation=%f (%+5.2f dB) end_result=%+5.2f dB\n",
-				level_compressor.get_level(), to_db(level_compressor.get_level()),
-				level_compressor.get_attenuation(), to_db(level_compressor.get_attenuation()),
-				to_db(level_compressor.get_level() * level_compressor.get_attenuation() * makeup_gain));
-#endif
+	// Each device has its own resampling queue and output buffer, so they
+	// can be resampled in parallel, and the result is the same no matter
+	// which threads got which devices.
+	if (resampling_worker_pool != nullptr) {
+		resampling_worker_pool->run(num_devices_to_resample, [this, &devices_to_resample, ts, num_samples, rate_adjustment_policy](unsigned job_index) {
+			resample_device(devices_to_resample[job_index], ts, num_samples, rate_adjustment_policy);
+		});
+	} else {
+		for (unsigned i = 0; i < num_devices_to_resample; ++i) {
+			resample_device(devices_to_resample[i], ts, num_samples, rate_adjustment_policy);
+		}
+	}
 
-			// The real compressor.
-			if (compressor_enabled[bus_index]) {
-				float threshold = from_db(compressor_threshold_dbfs[bus_index]);
-				float ratio = 20.0f;
-				float attack_time = 0.005f;
-				float release_time = 0.040f;
-				float makeup_gain = 2.0f;  // +6 dB.
-				compressor[bus_index]->process(samples_bus.data(), samples_bus.size() / 2, threshold, ratio, attack_time, release_time, makeup_gain);
-		//		compressor_att = compressor.get_attenuation();
+	// Note that bus 0 does not necessarily overwrite the output
+	// (e.g. if it is muted), so we need to clear it.
+	StereoBuffer &master = scratch.master;
+	master.left.assign(num_samples, 0.0f);
+	master.right.assign(num_samples, 0.0f);
+
+	// The buses are independent of each other until they are mixed together,
+	// so if we have worker threads, we can process them in parallel.
+	// The mixdown happens afterwards, always in bus order, so the output is
+	// the same no matter which threads processed which buses.
+	{
+		lock_guard<mutex> lock(compressor_mutex);
+		if (bus_worker_pool != nullptr) {
+			bus_worker_pool->run(input_mapping.buses.size(), [this, num_samples](unsigned bus_index) {
+				process_bus(bus_index, num_samples);
+			});
+		} else {
+			for (unsigned bus_index = 0; bus_index < input_mapping.buses.size(); ++bus_index) {
+				process_bus(bus_index, num_samples);
 			}
 		}
-
-		add_bus_to_master(bus_index, samples_bus, &samples_out);
-		deinterleave_samples(samples_bus, &left, &right);
-		measure_bus_levels(bus_index, left, right);
+	}
+	{
+		ScopedStageTimer timer(stage_timer_location(STAGE_MIXING));
+		for (unsigned bus_index = 0; bus_index < input_mapping.buses.size(); ++bus_index) {
+			add_bus_to_master(bus_index, scratch.buses[bus_index], &master);
+		}
 	}
 
 	{
 		lock_guard<mutex> lock(compressor_mutex);
+		ScopedStageTimer timer(stage_timer_location(STAGE_COMPRESSION));
 
 		// Finally a limiter at -4 dB (so, -10 dBFS) to take out the worst peaks only.
 		// Note that since ratio is not infinite, we could go slightly higher than this.
@@ -574,7 +662,7 @@ vector<float> AudioMixer::get_output(steady_clock::time_point ts, unsigned num_s
 			float attack_time = 0.0f;  // Instant.
 			float release_time = 0.020f;
 			float makeup_gain = 1.0f;  // 0 dB.
-			limiter.process(samples_out.data(), samples_out.size() / 2, threshold, ratio, attack_time, release_time, makeup_gain);
+			limiter.process(master.left.data(), master.right.data(), num_samples, threshold, ratio, attack_time, release_time, makeup_gain);
 	//		limiter_att = limiter.get_attenuation();
 		}
 
@@ -594,7 +682,7 @@ vector<float> AudioMixer::get_output(steady_clock::time_point ts, unsigned num_s
 	// Note that there's a feedback loop here, so we choose a very slow filter
 	// (half-time of 30 seconds).
 	double target_loudness_factor, alpha;
-	double loudness_lu = r128.loudness_M() - ref_level_lufs;
+	double loudness_lu = loudness_momentary_lufs - ref_level_lufs;
 	target_loudness_factor = final_makeup_gain * from_db(-loudness_lu);
 
 	// If we're outside +/- 5 LU (after correction), we don't count it as
@@ -612,61 +700,152 @@ vector<float> AudioMixer::get_output(steady_clock::time_point ts, unsigned num_s
 
 	{
 		lock_guard<mutex> lock(compressor_mutex);
+		ScopedStageTimer timer(stage_timer_location(STAGE_MIXING));
 		double m = final_makeup_gain;
-		for (size_t i = 0; i < samples_out.size(); i += 2) {
-			samples_out[i + 0] *= m;
-			samples_out[i + 1] *= m;
+		for (size_t i = 0; i < num_samples; ++i) {
+			master.left[i] *= m;
+			master.right[i] *= m;
 			m += (target_loudness_factor - m) * alpha;
 		}
 		final_makeup_gain = m;
 	}
 
-	update_meters(samples_out);
+	// This is the only place we interleave; everybody downstream of us
+	// (the encoders and ALSA output) wants it that way.
+	{
+		ScopedStageTimer timer(stage_timer_location(STAGE_MIXING));
+		interleave_samples(master.left, master.right, &samples_out);
+	}
 
-	return samples_out;
+	publish_bus_levels_mutex_held();
+	if (use_metering_thread) {
+		queue_for_metering(master);
+	} else {
+		update_meters(master);
+	}
 }
 
-namespace {
+// Fills scratch.samples_card for one device. Like process_bus(), this touches
+// nothing but state belonging to that device, so it is safe to run for
+// different devices at the same time. Must be called with audio_mutex held
+// (possibly by another thread that is waiting for us).
+void AudioMixer::resample_device(unsigned device_slot, steady_clock::time_point ts, unsigned num_samples, ResamplingQueue::RateAdjustmentPolicy rate_adjustment_policy)
+{
+	ScopedStageTimer timer(stage_timer_location(STAGE_RESAMPLING));
+	steady_clock::time_point start = steady_clock::now();
+
+	AudioDevice *device = find_audio_device(get_device_spec_from_slot(device_slot));
+	vector<float> &samples_card = scratch.samples_card[device_slot];
+	samples_card.resize(num_samples * device->interesting_channels.size());
+	if (device->silenced) {
+		memset(&samples_card[0], 0, samples_card.size() * sizeof(float));
+	} else {
+		device->resampling_queue->get_output_samples(
+			ts,
+			&samples_card[0],
+			num_samples,
+			rate_adjustment_policy);
+	}
+
+	device->metric_resampling_seconds = device->metric_resampling_seconds + duration<double>(steady_clock::now() - start).count();
+}
 
-void apply_filter_fade(StereoFilter *filter, float *data, unsigned num_samples, float cutoff_hz, float db, float last_db)
+// Everything that happens to a bus before it is added to the master bus.
+// Touches nothing but state belonging to <bus_index>, so it is safe to run
+// for different buses at the same time. Must be called with audio_mutex and
+// compressor_mutex held (possibly by another thread that is waiting for us).
+void AudioMixer::process_bus(unsigned bus_index, unsigned num_samples)
 {
-	// A granularity of 32 samples is an okay tradeoff between speed and
-	// smoothness; recalculating the filters is pretty expensive, so it's
-	// good that we don't do this all the time.
-	static constexpr unsigned filter_granularity_samples = 32;
+	StereoBuffer &samples_bus = scratch.buses[bus_index];
+	samples_bus.resize(num_samples);
+	{
+		ScopedStageTimer timer(stage_timer_location(STAGE_MIXING));
+		fill_audio_bus(input_mapping.buses[bus_index], &samples_bus);
+	}
+	{
+		ScopedStageTimer timer(stage_timer_location(STAGE_EQ));
+		apply_eq(bus_index, &samples_bus);
+	}
 
-	const float cutoff_linear = cutoff_hz * 2.0 * M_PI / OUTPUT_FREQUENCY;
+	ScopedStageTimer compression_timer(stage_timer_location(STAGE_COMPRESSION));
+
+	// Apply a level compressor to get the general level right.
+	// Basically, if it's over about -40 dBFS, we squeeze it down to that level
+	// (or more precisely, near it, since we don't use infinite ratio),
+	// then apply a makeup gain to get it to -14 dBFS. -14 dBFS is, of course,
+	// entirely arbitrary, but from practical tests with speech, it seems to
+	// put ut around -23 LUFS, so it's a reasonable starting point for later use.
+	if (level_compressor_enabled[bus_index]) {
+		float threshold = 0.01f;   // -40 dBFS.
+		float ratio = 20.0f;
+		float attack_time = 0.5f;
+		float release_time = 20.0f;
+		float makeup_gain = from_db(ref_level_dbfs - (-40.0f));  // +26 dB.
+		level_compressor[bus_index]->process(samples_bus.left.data(), samples_bus.right.data(), num_samples, threshold, ratio, attack_time, release_time, makeup_gain);
+		gain_staging_db[bus_index] = to_db(level_compressor[bus_index]->get_attenuation() * makeup_gain);
+	} else {
+		// Just apply the gain we already had.
+		float db = gain_staging_db[bus_index];
+		float last_db = last_gain_staging_db[bus_index];
+		apply_gain(db, last_db, &samples_bus.left, &samples_bus.right);
+	}
+	last_gain_staging_db[bus_index] = gain_staging_db[bus_index];
+
+#if 0
+	printf("level=%f (%+5.2f dBFS) attenuation=%f (%+5.2f dB) end_result=%+5.2f dB\n",
+		level_compressor.get_level(), to_db(level_compressor.get_level()),
+		level_compressor.get_attenuation(), to_db(level_compressor.get_attenuation()),
+		to_db(level_compressor.get_level() * level_compressor.get_attenuation() * makeup_gain));
+#endif
+
+	// The real compressor.
+	if (compressor_enabled[bus_index]) {
+		float threshold = from_db(compressor_threshold_dbfs[bus_index]);
+		float ratio = 20.0f;
+		float attack_time = 0.005f;
+		float release_time = 0.040f;
+		float makeup_gain = 2.0f;  // +6 dB.
+		compressor[bus_index]->process(samples_bus.left.data(), samples_bus.right.data(), num_samples, threshold, ratio, attack_time, release_time, makeup_gain);
+	//	compressor_att = compressor.get_attenuation();
+	}
+	compression_timer.stop();
+
+	ScopedStageTimer metering_timer(stage_timer_location(STAGE_METERING));
+	measure_bus_levels(bus_index, samples_bus);
+}
+
+namespace {
+
+void add_filter_fade(StereoFilterCascade *cascade, StereoFilter *filter, const EQCoefficientTable *table, unsigned num_samples, float cutoff_hz, float db, float last_db)
+{
 	if (fabs(db - last_db) < 1e-3) {
 		// Constant over this frame.
 		if (fabs(db) > 0.01f) {
-			filter->render(data, num_samples, cutoff_linear, 0.5f, db / 40.0f);
+			cascade->add(filter, hz_to_linear_cutoff(cutoff_hz), 0.5f, db / 40.0f);
 		}
 	} else {
-		// We need to do a fade. (Rounding up avoids division by zero.)
-		unsigned num_blocks = (num_samples + filter_granularity_samples - 1) / filter_granularity_samples;
+		// We need to do a fade, changing the coefficients every
+		// StereoFilterCascade::fade_block_size samples. (Rounding up avoids
+		// division by zero.)
+		const unsigned num_blocks = (num_samples + StereoFilterCascade::fade_block_size - 1) / StereoFilterCascade::fade_block_size;
 		const float inc_db_norm = (db - last_db) / 40.0f / num_blocks;
-		float db_norm = db / 40.0f;
-		for (size_t i = 0; i < num_samples; i += filter_granularity_samples) {
-			size_t samples_this_block = std::min<size_t>(num_samples - i, filter_granularity_samples);
-			filter->render(data + i * 2, samples_this_block, cutoff_linear, 0.5f, db_norm);
-			db_norm += inc_db_norm;
-		}
+		cascade->add_fade(filter, table, db / 40.0f, inc_db_norm);
 	}
 }
 
 }  // namespace
 
-void AudioMixer::apply_eq(unsigned bus_index, vector<float> *samples_bus)
+void AudioMixer::apply_eq(unsigned bus_index, StereoBuffer *samples_bus)
 {
-	constexpr float bass_freq_hz = 200.0f;
-	constexpr float treble_freq_hz = 4700.0f;
+	// All the filters below are run in one pass over the samples.
+	StereoFilterCascade cascade;
 
 	// Cut away everything under 120 Hz (or whatever the cutoff is);
 	// we don't need it for voice, and it will reduce headroom
 	// and confuse the compressor. (In particular, any hums at 50 or 60 Hz
 	// should be dampened.)
 	if (locut_enabled[bus_index]) {
-		locut[bus_index].render(samples_bus->data(), samples_bus->size() / 2, locut_cutoff_hz * 2.0 * M_PI / OUTPUT_FREQUENCY, 0.5f);
+		cascade.add(&locut[bus_index], hz_to_linear_cutoff(locut_cutoff_hz), 0.5f);
 	}
 
 	// Apply the rest of the EQ. Since we only have a simple three-band EQ,
@@ -674,6 +853,8 @@ void AudioMixer::apply_eq(unsigned bus_index, vector<float> *samples_bus)
 	// set the mid-level filter, and then offset the low and high bands
 	// from that if we need to. (We could perhaps have folded the gain into
 	// the next part, but it's so cheap that the trouble isn't worth it.)
+	// The gain is applied before all the filters, so that it does not
+	// need to split the cascade in two.
 	//
 	// If any part of the EQ has changed appreciably since last frame,
 	// we fade smoothly during the course of this frame.
@@ -685,24 +866,25 @@ void AudioMixer::apply_eq(unsigned bus_index, vector<float> *samples_bus)
 	const float last_mid_db = last_eq_level_db[bus_index][EQ_BAND_MID];
 	const float last_treble_db = last_eq_level_db[bus_index][EQ_BAND_TREBLE];
 
-	assert(samples_bus->size() % 2 == 0);
-	const unsigned num_samples = samples_bus->size() / 2;
+	const unsigned num_samples = samples_bus->size();
 
-	apply_gain(mid_db, last_mid_db, samples_bus);
+	apply_gain(mid_db, last_mid_db, &samples_bus->left, &samples_bus->right);
 
-	apply_filter_fade(&eq[bus_index][EQ_BAND_BASS], samples_bus->data(), num_samples, bass_freq_hz, bass_db - mid_db, last_bass_db - last_mid_db);
-	apply_filter_fade(&eq[bus_index][EQ_BAND_TREBLE], samples_bus->data(), num_samples, treble_freq_hz, treble_db - mid_db, last_treble_db - last_mid_db);
+	add_filter_fade(&cascade, &eq[bus_index][EQ_BAND_BASS], &bass_eq_coefficients, num_samples, bass_freq_hz, bass_db - mid_db, last_bass_db - last_mid_db);
+	add_filter_fade(&cascade, &eq[bus_index][EQ_BAND_TREBLE], &treble_eq_coefficients, num_samples, treble_freq_hz, treble_db - mid_db, last_treble_db - last_mid_db);
+	cascade.render(samples_bus->left.data(), samples_bus->right.data(), num_samples);
 
 	last_eq_level_db[bus_index][EQ_BAND_BASS] = bass_db;
 	last_eq_level_db[bus_index][EQ_BAND_MID] = mid_db;
 	last_eq_level_db[bus_index][EQ_BAND_TREBLE] = treble_db;
 }
 
-void AudioMixer::add_bus_to_master(unsigned bus_index, const vector<float> &samples_bus, vector<float> *samples_out)
+void AudioMixer::add_bus_to_master(unsigned bus_index, const StereoBuffer &samples_bus, StereoBuffer *samples_out)
 {
 	assert(samples_bus.size() == samples_out->size());
-	assert(samples_bus.size() % 2 == 0);
-	unsigned num_samples = samples_bus.size() / 2;
+	unsigned num_samples = samples_bus.size();
+	const float *src_l = samples_bus.left.data(), *src_r = samples_bus.right.data();
+	float *dst_l = samples_out->left.data(), *dst_r = samples_out->right.data();
 	const float new_volume_db = mute[bus_index] ? -90.0f : fader_volume_db[bus_index].load();
 	if (fabs(new_volume_db - last_fader_volume_db[bus_index]) > 1e-3) {
 		// The volume has changed; do a fade over the course of this frame.
@@ -716,14 +898,14 @@ void AudioMixer::add_bus_to_master(unsigned bus_index, const vector<float> &samp
 		volume = old_volume;
 		if (bus_index == 0) {
 			for (unsigned i = 0; i < num_samples; ++i) {
-				(*samples_out)[i * 2 + 0] = samples_bus[i * 2 + 0] * volume;
-				(*samples_out)[i * 2 + 1] = samples_bus[i * 2 + 1] * volume;
+				dst_l[i] = src_l[i] * volume;
+				dst_r[i] = src_r[i] * volume;
 				volume *= volume_inc;
 			}
 		} else {
 			for (unsigned i = 0; i < num_samples; ++i) {
-				(*samples_out)[i * 2 + 0] += samples_bus[i * 2 + 0] * volume;
-				(*samples_out)[i * 2 + 1] += samples_bus[i * 2 + 1] * volume;
+				dst_l[i] += src_l[i] * volume;
+				dst_r[i] += src_r[i] * volume;
 				volume *= volume_inc;
 			}
 		}
@@ -731,13 +913,13 @@ void AudioMixer::add_bus_to_master(unsigned bus_index, const vector<float> &samp
 		float volume = from_db(new_volume_db);
 		if (bus_index == 0) {
 			for (unsigned i = 0; i < num_samples; ++i) {
-				(*samples_out)[i * 2 + 0] = samples_bus[i * 2 + 0] * volume;
-				(*samples_out)[i * 2 + 1] = samples_bus[i * 2 + 1] * volume;
+				dst_l[i] = src_l[i] * volume;
+				dst_r[i] = src_r[i] * volume;
 			}
 		} else {
 			for (unsigned i = 0; i < num_samples; ++i) {
-				(*samples_out)[i * 2 + 0] += samples_bus[i * 2 + 0] * volume;
-				(*samples_out)[i * 2 + 1] += samples_bus[i * 2 + 1] * volume;
+				dst_l[i] += src_l[i] * volume;
+				dst_r[i] += src_r[i] * volume;
 			}
 		}
 	}
@@ -745,8 +927,9 @@ void AudioMixer::add_bus_to_master(unsigned bus_index, const vector<float> &samp
 	last_fader_volume_db[bus_index] = new_volume_db;
 }
 
-void AudioMixer::measure_bus_levels(unsigned bus_index, const vector<float> &left, const vector<float> &right)
+void AudioMixer::measure_bus_levels(unsigned bus_index, const StereoBuffer &samples_bus)
 {
+	const vector<float> &left = samples_bus.left, &right = samples_bus.right;
 	assert(left.size() == right.size());
 	const float volume = mute[bus_index] ? 0.0f : from_db(fader_volume_db[bus_index]);
 	const float peak_levels[2] = {
@@ -780,76 +963,106 @@ void AudioMixer::measure_bus_levels(unsigned bus_index, const vector<float> &lef
 	}
 }
 
-void AudioMixer::update_meters(const vector<float> &samples)
+void AudioMixer::queue_for_metering(const StereoBuffer &samples)
 {
-	// Upsample 4x to find interpolated peak.
-	peak_resampler.inp_data = const_cast<float *>(samples.data());
-	peak_resampler.inp_count = samples.size() / 2;
+	if (metering_queue[0].free_space() < samples.size() ||
+	    metering_queue[1].free_space() < samples.size()) {
+		// The metering thread is behind; don't wait for it.
+		++metric_audio_meter_dropped_frames;
+		return;
+	}
+	metering_queue[0].write(samples.left.data(), samples.size());
+	metering_queue[1].write(samples.right.data(), samples.size());
 
-	vector<float> interpolated_samples;
-	interpolated_samples.resize(samples.size());
-	{
-		lock_guard<mutex> lock(audio_measure_mutex);
+	// Note that we don't take metering_mutex, so the wakeup can come just
+	// before the metering thread goes to sleep and be lost. It wakes up
+	// by itself soon enough anyway.
+	metering_queue_changed.notify_all();
+}
 
-		while (peak_resampler.inp_count > 0) {  // About four iterations.
-			peak_resampler.out_data = &interpolated_samples[0];
-			peak_resampler.out_count = interpolated_samples.size() / 2;
-			peak_resampler.process();
-			size_t out_stereo_samples = interpolated_samples.size() / 2 - peak_resampler.out_count;
-			peak = max<float>(peak, find_peak(interpolated_samples.data(), out_stereo_samples * 2));
-			peak_resampler.out_data = nullptr;
+void AudioMixer::metering_thread_func()
+{
+	pthread_setname_np(pthread_self(), "Mixer_Metering");
+
+	// We never read more than the queues can hold, so this is all
+	// the memory we'll ever need.
+	StereoBuffer &samples = meter_buffers.samples;
+	samples.reserve(metering_queue[0].get_capacity());
+
+	while (!metering_thread_should_quit) {
+		{
+			unique_lock<mutex> lock(metering_mutex);
+			metering_queue_changed.wait_for(lock, milliseconds(10), [this]{
+				return metering_thread_should_quit || !metering_queue[1].empty();
+			});
 		}
+
+		// Take everything that's there in one go. If we've fallen behind,
+		// this means we send only one level update for several frames.
+		// The left channel is always written first, so there's at least
+		// as much of it as of the right.
+		samples.resize(metering_queue[1].size());
+		if (samples.size() == 0) {
+			continue;
+		}
+		metering_queue[0].read(samples.left.data(), samples.size());
+		metering_queue[1].read(samples.right.data(), samples.size());
+		update_meters(samples);
+	}
+}
+
+void AudioMixer::update_meters(const StereoBuffer &samples)
+{
+	const unsigned num_samples = samples.size();
+
+	// Find the true (interpolated) peak.
+	{
+		lock_guard<mutex> lock(audio_measure_mutex);
+		ScopedStageTimer timer(meter_timer_location(STAGE_METERING));
+		peak = max<float>(peak, true_peak_detector[0].process(samples.left.data(), num_samples));
+		peak = max<float>(peak, true_peak_detector[1].process(samples.right.data(), num_samples));
 	}
 
 	// Find R128 levels and L/R correlation.
-	vector<float> left, right;
-	deinterleave_samples(samples, &left, &right);
-	float *ptrs[] = { left.data(), right.data() };
+	float *ptrs[] = { const_cast<float *>(samples.left.data()), const_cast<float *>(samples.right.data()) };
 	{
 		lock_guard<mutex> lock(audio_measure_mutex);
-		r128.process(left.size(), ptrs);
-		correlation.process_samples(samples);
+		{
+			ScopedStageTimer timer(meter_timer_location(STAGE_R128));
+			r128.process(num_samples, ptrs);
+			loudness_momentary_lufs = r128.loudness_M();
+		}
+		ScopedStageTimer timer(meter_timer_location(STAGE_METERING));
+		correlation.process_samples(samples.left.data(), samples.right.data(), num_samples);
 	}
 
-	send_audio_level_callback();
+	ScopedStageTimer timer(meter_timer_location(STAGE_METERING));
+	publish_master_levels();
 }
 
 void AudioMixer::reset_meters()
 {
 	lock_guard<mutex> lock(audio_measure_mutex);
-	peak_resampler.reset();
+	for (TruePeakDetector &detector : true_peak_detector) {
+		detector.reset();
+	}
 	peak = 0.0f;
 	r128.reset();
 	r128.integr_start();
+	loudness_momentary_lufs = r128.loudness_M();
 	correlation.reset();
 }
 
-void AudioMixer::send_audio_level_callback()
+// Publishes the bus levels for get_audio_levels(). Done on the audio thread,
+// since the bus levels come from state under audio_mutex and compressor_mutex.
+void AudioMixer::publish_bus_levels_mutex_held()
 {
-	if (audio_level_callback == nullptr) {
-		return;
-	}
-
-	lock_guard<mutex> lock(audio_measure_mutex);
-	double loudness_s = r128.loudness_S();
-	double loudness_i = r128.integrated();
-	double loudness_range_low = r128.range_min();
-	double loudness_range_high = r128.range_max();
-
-	metric_audio_loudness_short_lufs = loudness_s;
-	metric_audio_loudness_integrated_lufs = loudness_i;
-	metric_audio_loudness_range_low_lufs = loudness_range_low;
-	metric_audio_loudness_range_high_lufs = loudness_range_high;
-	metric_audio_peak_dbfs = to_db(peak);
-	metric_audio_final_makeup_gain_db = to_db(final_makeup_gain);
-	metric_audio_correlation = correlation.get_correlation();
-
-	vector<BusLevel> bus_levels;
-	bus_levels.resize(input_mapping.buses.size());
-	{
-		lock_guard<mutex> lock(compressor_mutex);
-		for (unsigned bus_index = 0; bus_index < bus_levels.size(); ++bus_index) {
-			BusLevel &levels = bus_levels[bus_index];
+	ScopedStageTimer timer(stage_timer_location(STAGE_METERING));
+	lock_guard<mutex> lock(compressor_mutex);
+	bus_levels_snapshot.publish([this](BusLevels *snapshot) {
+		snapshot->num_buses = input_mapping.buses.size();
+		for (unsigned bus_index = 0; bus_index < snapshot->num_buses; ++bus_index) {
+			BusLevel &levels = snapshot->bus_levels[bus_index];
 			BusMetrics &metrics = bus_metrics[bus_index];
 
 			levels.current_level_dbfs[0] = metrics.current_level_dbfs[0] = to_db(peak_history[bus_index][0].current_level);
@@ -867,12 +1080,49 @@ void AudioMixer::send_audio_level_callback()
 				metrics.compressor_attenuation_db = 0.0 / 0.0;
 			}
 		}
-	}
+		snapshot->final_makeup_gain_db = metric_audio_final_makeup_gain_db = to_db(final_makeup_gain);
+	});
+}
 
-	audio_level_callback(loudness_s, to_db(peak), bus_levels,
-		loudness_i, loudness_range_low, loudness_range_high,
-		to_db(final_makeup_gain),
-		correlation.get_correlation());
+// Publishes the master levels for get_audio_levels(). Called by whoever
+// updates the master meters, right after doing so.
+void AudioMixer::publish_master_levels()
+{
+	lock_guard<mutex> lock(audio_measure_mutex);
+	master_levels_snapshot.publish([this](MasterLevels *snapshot) {
+		snapshot->level_lufs = metric_audio_loudness_short_lufs = r128.loudness_S();
+		snapshot->global_level_lufs = metric_audio_loudness_integrated_lufs = r128.integrated();
+		snapshot->range_low_lufs = metric_audio_loudness_range_low_lufs = r128.range_min();
+		snapshot->range_high_lufs = metric_audio_loudness_range_high_lufs = r128.range_max();
+		snapshot->peak_db = metric_audio_peak_dbfs = to_db(peak);
+		snapshot->correlation = metric_audio_correlation = correlation.get_correlation();
+	});
+}
+
+bool AudioMixer::get_audio_levels(AudioLevels *levels) const
+{
+	// The two snapshots are published from different threads, so they
+	// are not necessarily from exactly the same frame, but that doesn't
+	// matter for meters.
+	MasterLevels master;
+	if (!master_levels_snapshot.read(&master)) {
+		return false;
+	}
+	levels->level_lufs = master.level_lufs;
+	levels->peak_db = master.peak_db;
+	levels->global_level_lufs = master.global_level_lufs;
+	levels->range_low_lufs = master.range_low_lufs;
+	levels->range_high_lufs = master.range_high_lufs;
+	levels->correlation = master.correlation;
+
+	BusLevels buses;
+	if (!bus_levels_snapshot.read(&buses)) {
+		return false;
+	}
+	levels->num_buses = buses.num_buses;
+	copy(buses.bus_levels, buses.bus_levels + buses.num_buses, levels->bus_levels);
+	levels->final_makeup_gain_db = buses.final_makeup_gain_db;
+	return true;
 }
 
 map<DeviceSpec, DeviceInfo> AudioMixer::get_devices()
@@ -1049,6 +1299,8 @@ void AudioMixer::set_input_mapping_lock_held(const InputMapping &new_input_mappi
 		AudioDevice *device = find_audio_device(device_spec);
 		if (device->interesting_channels != interesting_channels[device_spec]) {
 			device->interesting_channels = interesting_channels[device_spec];
+			device->interesting_channel_list.assign(device->interesting_channels.begin(), device->interesting_channels.end());
+			device->input_queue.clear();
 			reset_resampler_mutex_held(device_spec);
 		}
 	}
@@ -1062,12 +1314,74 @@ void AudioMixer::set_input_mapping_lock_held(const InputMapping &new_input_mappi
 		}
 		if (device->interesting_channels != interesting_channels[device_spec]) {
 			device->interesting_channels = interesting_channels[device_spec];
+			device->interesting_channel_list.assign(device->interesting_channels.begin(), device->interesting_channels.end());
+			device->input_queue.clear();
 			alsa_pool.reset_device(device_spec.index);
 			reset_resampler_mutex_held(device_spec);
 		}
 	}
 
+	// Start or stop accepting audio from each device as needed.
+	for (unsigned device_slot = 0; device_slot < num_device_slots; ++device_slot) {
+		const DeviceSpec device_spec = get_device_spec_from_slot(device_slot);
+		const AudioDevice *device = find_audio_device(device_spec);
+		set_input_queue_active_mutex_held(device_spec, !device->interesting_channels.empty());
+	}
+
 	input_mapping = new_input_mapping;
+	reserve_scratch_buffers_lock_held(scratch.max_samples);
+}
+
+void AudioMixer::set_input_queue_active_mutex_held(DeviceSpec device_spec, bool active)
+{
+	// Enough for half a second or so of 16-channel, 32-bit audio.
+	static constexpr size_t input_queue_bytes = 2 << 20;
+
+	AudioDevice *device = find_audio_device(device_spec);
+	if (device->input_queue_active == active) {
+		return;
+	}
+	if (active) {
+		// The queue is never freed, so a producer that still thinks
+		// the device is active after this point cannot touch freed memory.
+		if (!device->input_queue.is_allocated()) {
+			device->input_queue.resize(input_queue_bytes);
+		}
+		device->input_queue.clear();
+
+		char source_index_str[16];
+		snprintf(source_index_str, sizeof(source_index_str), "%u", device_spec.index);
+		device->metric_labels.clear();
+		device->metric_labels.emplace_back("source_type", device_spec.type == InputSourceType::CAPTURE_CARD ? "capture_card" : "alsa_input");
+		device->metric_labels.emplace_back("source_index", source_index_str);
+		global_metrics.add("audio_input_queue_length_samples", device->metric_labels, &device->metric_input_queue_length_samples, Metrics::TYPE_GAUGE);
+		global_metrics.add("audio_input_queue_full", device->metric_labels, &device->metric_input_queue_full);
+		global_metrics.add("audio_resampling_seconds", device->metric_labels, &device->metric_resampling_seconds);
+		device->input_queue_active.store(true, memory_order_release);
+	} else {
+		device->input_queue_active.store(false, memory_order_release);
+		global_metrics.remove("audio_input_queue_length_samples", device->metric_labels);
+		global_metrics.remove("audio_input_queue_full", device->metric_labels);
+		global_metrics.remove("audio_resampling_seconds", device->metric_labels);
+	}
+}
+
+void AudioMixer::reserve_scratch_buffers_lock_held(unsigned num_samples)
+{
+	scratch.max_samples = num_samples;
+	for (unsigned device_slot = 0; device_slot < num_device_slots; ++device_slot) {
+		const AudioDevice *device = find_audio_device(get_device_spec_from_slot(device_slot));
+		if (device->interesting_channels.empty()) {
+			vector<float>().swap(scratch.samples_card[device_slot]);
+		} else {
+			scratch.samples_card[device_slot].reserve(num_samples * device->interesting_channels.size());
+		}
+	}
+	scratch.buses.resize(input_mapping.buses.size());
+	for (StereoBuffer &bus : scratch.buses) {
+		bus.reserve(num_samples);
+	}
+	scratch.master.reserve(num_samples);
 }
 
 InputMapping AudioMixer::get_input_mapping() const
@@ -10,18 +10,20 @@
 
 #include <assert.h>
 #include <stdint.h>
-#include <zita-resampler/resampler.h>
 #include <atomic>
 #include <chrono>
+#include <condition_variable>
 #include <functional>
 #include <map>
 #include <memory>
 #include <mutex>
 #include <set>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include "alsa_pool.h"
+#include "audio_input_queue.h"
 #include "correlation_measurer.h"
 #include "db.h"
 #include "defs.h"
@@ -29,7 +31,11 @@
 #include "filter.h"
 #include "input_mapping.h"
 #include "resampling_queue.h"
+#include "ring_buffer.h"
+#include "snapshot_buffer.h"
 #include "stereocompressor.h"
+#include "true_peak.h"
+#include "worker_pool.h"
 
 class DeviceSpecProto;
 
@@ -47,14 +53,18 @@ enum EQBand {
 class AudioMixer {
 public:
 	AudioMixer(unsigned num_cards);
+	~AudioMixer();
 	void reset_resampler(DeviceSpec device_spec);
 	void reset_meters();
 
-	// Add audio (or silence) to the given device's queue. Can return false if
-	// the lock wasn't successfully taken; if so, you should simply try again.
-	// (This is to avoid a deadlock where a card hangs on the mutex in add_audio()
-	// while we are trying to shut it down from another thread that also holds
-	// the mutex.) frame_length is in TIMEBASE units.
+	// Add audio (or silence) to the given device's queue. This does not take
+	// the mixer lock; the data goes into a wait-free queue that is drained by
+	// the audio thread at the start of get_output(). Only one thread can add
+	// audio to any given device at a time (naturally, its capture thread).
+	// Can return false if the queue is full (ie., the audio thread is hanging
+	// or far behind); if so, you can wait a bit (e.g. one period) and try again,
+	// or drop the audio. Do not retry in a busy loop. frame_length is
+	// in TIMEBASE units.
 	bool add_audio(DeviceSpec device_spec, const uint8_t *data, unsigned num_samples, bmusb::AudioFormat audio_format, int64_t frame_length, std::chrono::steady_clock::time_point frame_time);
 	bool add_silence(DeviceSpec device_spec, unsigned samples_per_frame, unsigned num_frames, int64_t frame_length);
 
@@ -62,11 +72,43 @@ public:
 	// (by means of add_audio() or add_silence()), you can call put it in silence mode,
 	// where it will be taken to only output silence. Note that when taking it _out_
 	// of silence mode, the resampler will be reset, so that old audio will not
-	// affect it. Same true/false behavior as add_audio().
+	// affect it. Can return false if the lock wasn't successfully taken; if so,
+	// you should simply try again. (This is to avoid a deadlock where a card hangs
+	// on the mutex while we are trying to shut it down from another thread that
+	// also holds the mutex.)
 	bool silence_card(DeviceSpec device_spec, bool silence);
 
 	std::vector<float> get_output(std::chrono::steady_clock::time_point ts, unsigned num_samples, ResamplingQueue::RateAdjustmentPolicy rate_adjustment_policy);
 
+	// Same, but puts the output into <samples_out>, reusing its storage.
+	// If it is already large enough (e.g. from the previous frame) and the
+	// input mapping has not changed, this does not touch the heap at all.
+	void get_output(std::chrono::steady_clock::time_point ts, unsigned num_samples, ResamplingQueue::RateAdjustmentPolicy rate_adjustment_policy, std::vector<float> *samples_out);
+
+	// For profiling (e.g. benchmark_audio_mixer). If enabled, get_output()
+	// keeps track of how much time it spends in each of these stages.
+	enum ProcessingStage {
+		STAGE_CONVERSION = 0,  // Draining the input queues, including conversion to float.
+		STAGE_RESAMPLING,
+		STAGE_MIXING,  // Picking out channels for the buses, faders, final makeup gain.
+		STAGE_EQ,  // Including the locut filter.
+		STAGE_COMPRESSION,  // Both compressors and the limiter.
+		STAGE_METERING,  // Bus levels, and the master peak and correlation.
+		STAGE_R128,  // Master loudness.
+		NUM_PROCESSING_STAGES
+	};
+	static const char *get_processing_stage_name(ProcessingStage stage);
+	void set_stage_timing_enabled(bool enabled) { stage_timing_enabled = enabled; }
+
+	// The time spent in each stage during the last call to get_output(),
+	// in seconds. Resampling and the per-bus stages are summed over all
+	// devices and buses, so if they run on multiple threads, this is CPU time,
+	// not wall-clock time.
+	// Master metering on the metering thread (see update_meters()) is not
+	// part of get_output(), and is thus not counted.
+	// Must not be called while get_output() is running.
+	void get_last_stage_times(double times[NUM_PROCESSING_STAGES]) const;
+
 	float get_fader_volume(unsigned bus_index) const { return fader_volume_db[bus_index]; }
 	void set_fader_volume(unsigned bus_index, float level_db) { fader_volume_db[bus_index] = level_db; }
 
@@ -254,15 +296,21 @@ public:
 		float compressor_attenuation_db;  // A positive number; 0.0 for no attenuation.
 	};
 
-	typedef std::function<void(float level_lufs, float peak_db,
-	                           std::vector<BusLevel> bus_levels,
-	                           float global_level_lufs, float range_low_lufs, float range_high_lufs,
-	                           float final_makeup_gain_db,
-	                           float correlation)> audio_level_callback_t;
-	void set_audio_level_callback(audio_level_callback_t callback)
-	{
-		audio_level_callback = callback;
-	}
+	struct AudioLevels {
+		float level_lufs;  // Short-term loudness.
+		float peak_db;  // True peak since the last reset_meters().
+		float global_level_lufs, range_low_lufs, range_high_lufs;
+		float final_makeup_gain_db;
+		float correlation;
+		unsigned num_buses;
+		BusLevel bus_levels[MAX_BUSES];  // Only the first <num_buses> are valid.
+	};
+
+	// Gets the current levels for the meters. This never waits for the audio
+	// thread (nor does the audio thread ever wait for us), so it's fine to call
+	// from anywhere, as often as you want to update your meters. Returns false
+	// if there are no levels yet (ie., no audio has come through).
+	bool get_audio_levels(AudioLevels *levels) const;
 
 	typedef std::function<void()> state_changed_callback_t;
 	void set_state_changed_callback(state_changed_callback_t callback)
@@ -306,7 +354,28 @@ private:
 		unsigned capture_frequency = OUTPUT_FREQUENCY;
 		// Which channels we consider interesting (ie., are part of some input_mapping).
 		std::set<unsigned> interesting_channels;
+		// The same channels, as a sorted array (for conversion and fill_audio_bus()).
+		std::vector<unsigned> interesting_channel_list;
 		bool silenced = false;
+
+		// Audio from add_audio() and add_silence() that has not been given to
+		// the resampling queue yet. Written to by the capture thread without
+		// any locking, and drained under audio_mutex. <input_queue_active> is
+		// set if anybody is interested in audio from this device; if not,
+		// the producer just throws its audio away.
+		AudioInputQueue input_queue;
+		std::atomic<bool> input_queue_active{false};
+		bool input_queue_full = false;  // Only touched by the producer.
+
+		// Scratch buffers for draining <input_queue>.
+		std::vector<uint8_t> input_bytes;
+		std::vector<float> input_samples;
+
+		// Metrics.
+		std::vector<std::pair<std::string, std::string>> metric_labels;
+		std::atomic<int64_t> metric_input_queue_length_samples{0};
+		std::atomic<int64_t> metric_input_queue_full{0};
+		std::atomic<double> metric_resampling_seconds{0.0};  // Only written to under audio_mutex.
 	};
 
 	const AudioDevice *find_audio_device(DeviceSpec device_spec) const
@@ -316,16 +385,49 @@ private:
 
 	AudioDevice *find_audio_device(DeviceSpec device_spec);
 
-	void find_sample_src_from_device(const std::map<DeviceSpec, std::vector<float>> &samples_card, DeviceSpec device_spec, int source_channel, const float **srcptr, unsigned *stride);
-	void fill_audio_bus(const std::map<DeviceSpec, std::vector<float>> &samples_card, const InputMapping::Bus &bus, unsigned num_samples, float *output);
+	// Devices, flattened into a single index space (video cards first, then
+	// ALSA inputs), for the per-device arrays below.
+	static constexpr unsigned num_device_slots = MAX_VIDEO_CARDS + MAX_ALSA_CARDS;
+	static unsigned get_device_slot(DeviceSpec device_spec);
+	static DeviceSpec get_device_spec_from_slot(unsigned device_slot);
+
+	void find_sample_src_from_device(DeviceSpec device_spec, int source_channel, const float **srcptr, unsigned *stride);
+	// Stereo audio with the two channels in separate buffers. Everything
+	// in get_output() works on these, from picking the channels out of
+	// the cards until the very end, where the master bus is interleaved.
+	struct StereoBuffer {
+		std::vector<float> left, right;
+
+		size_t size() const { return left.size(); }  // Per channel.
+		void resize(size_t num_samples)
+		{
+			left.resize(num_samples);
+			right.resize(num_samples);
+		}
+		void reserve(size_t num_samples)
+		{
+			left.reserve(num_samples);
+			right.reserve(num_samples);
+		}
+	};
+
+	void fill_audio_bus(const InputMapping::Bus &bus, StereoBuffer *output);
 	void reset_resampler_mutex_held(DeviceSpec device_spec);
-	void apply_eq(unsigned bus_index, std::vector<float> *samples_bus);
-	void update_meters(const std::vector<float> &samples);
-	void add_bus_to_master(unsigned bus_index, const std::vector<float> &samples_bus, std::vector<float> *samples_out);
-	void measure_bus_levels(unsigned bus_index, const std::vector<float> &left, const std::vector<float> &right);
-	void send_audio_level_callback();
-	std::vector<DeviceSpec> get_active_devices() const;
+	void drain_input_queue_mutex_held(DeviceSpec device_spec);
+	void resample_device(unsigned device_slot, std::chrono::steady_clock::time_point ts, unsigned num_samples, ResamplingQueue::RateAdjustmentPolicy rate_adjustment_policy);
+	void set_input_queue_active_mutex_held(DeviceSpec device_spec, bool active);
+	bool push_to_input_queue(AudioDevice *device, const AudioInputQueue::ChunkHeader &header, const uint8_t *data);
+	void process_bus(unsigned bus_index, unsigned num_samples);
+	void apply_eq(unsigned bus_index, StereoBuffer *samples_bus);
+	void queue_for_metering(const StereoBuffer &samples);
+	void metering_thread_func();
+	void update_meters(const StereoBuffer &samples);
+	void publish_bus_levels_mutex_held();
+	void add_bus_to_master(unsigned bus_index, const StereoBuffer &samples_bus, StereoBuffer *samples_out);
+	void measure_bus_levels(unsigned bus_index, const StereoBuffer &samples_bus);
+	void publish_master_levels();
 	void set_input_mapping_lock_held(const InputMapping &input_mapping);
+	void reserve_scratch_buffers_lock_held(unsigned num_samples);
 
 	unsigned num_cards;
 
@@ -340,6 +442,9 @@ private:
 	std::atomic<bool> locut_enabled[MAX_BUSES];
 	StereoFilter eq[MAX_BUSES][NUM_EQ_BANDS];  // The one for EQBand::MID isn't actually used (see comments in apply_eq()).
 
+	// Shared between all buses, for quick fades.
+	const EQCoefficientTable bass_eq_coefficients, treble_eq_coefficients;
+
 	// First compressor; takes us up to about -12 dBFS.
 	mutable std::mutex compressor_mutex;
 	std::unique_ptr<StereoCompressor> level_compressor[MAX_BUSES];  // Under compressor_mutex. Used to set/override gain_staging_db if <level_compressor_enabled>.
@@ -370,6 +475,41 @@ private:
 	double final_makeup_gain = 1.0;  // Under compressor_mutex. Read/write by the user. Note: Not in dB, we want the numeric precision so that we can change it slowly.
 	bool final_makeup_gain_auto = true;  // Under compressor_mutex.
 
+	// Working memory for get_output(), so that it doesn't need to allocate
+	// anything per frame. Everything is reserved for frames of <max_samples>
+	// whenever the input mapping changes, and grown if a longer frame than
+	// before comes along. Under audio_mutex.
+	struct ScratchBuffers {
+		unsigned max_samples = 0;
+		std::vector<float> samples_card[num_device_slots];  // Interesting channels only, resampled.
+		std::vector<StereoBuffer> buses;  // One for each bus in <input_mapping>.
+		StereoBuffer master;
+	} scratch;
+
+	// If set, the per-bus processing in get_output() is spread out over
+	// these threads (plus the one calling get_output()).
+	std::unique_ptr<WorkerPool> bus_worker_pool;
+
+	// Same, for resampling the inputs (each device on its own).
+	std::unique_ptr<WorkerPool> resampling_worker_pool;
+
+	// See set_stage_timing_enabled(). Nanoseconds for the current (or last)
+	// get_output(); added to from all the threads that take part in it.
+	// stage_timer_location() gives nullptr if timing is disabled.
+	std::atomic<bool> stage_timing_enabled{false};
+	std::atomic<int64_t> stage_time_ns[NUM_PROCESSING_STAGES] {{ 0 }};
+	std::atomic<int64_t> *stage_timer_location(ProcessingStage stage)
+	{
+		return stage_timing_enabled.load(std::memory_order_relaxed) ? &stage_time_ns[stage] : nullptr;
+	}
+
+	// Same, for the master meters, which are only counted if they are
+	// updated on the audio thread.
+	std::atomic<int64_t> *meter_timer_location(ProcessingStage stage)
+	{
+		return use_metering_thread ? nullptr : stage_timer_location(stage);
+	}
+
 	MappingMode current_mapping_mode;  // Under audio_mutex.
 	InputMapping input_mapping;  // Under audio_mutex.
 	std::atomic<float> fader_volume_db[MAX_BUSES] {{ 0.0f }};
@@ -378,14 +518,53 @@ private:
 	std::atomic<float> eq_level_db[MAX_BUSES][NUM_EQ_BANDS] {{{ 0.0f }}};
 	float last_eq_level_db[MAX_BUSES][NUM_EQ_BANDS] {{ 0.0f }};
 
-	audio_level_callback_t audio_level_callback = nullptr;
 	state_changed_callback_t state_changed_callback = nullptr;
 	mutable std::mutex audio_measure_mutex;
 	Ebu_r128_proc r128;  // Under audio_measure_mutex.
 	CorrelationMeasurer correlation;  // Under audio_measure_mutex.
-	Resampler peak_resampler;  // Under audio_measure_mutex.
+	TruePeakDetector true_peak_detector[2];  // One for each channel. Under audio_measure_mutex.
 	std::atomic<float> peak{0.0f};
 
+	// r128.loudness_M() as of the last update, for the final makeup gain
+	// (so that get_output() never needs to wait for the meters).
+	std::atomic<double> loudness_momentary_lufs;
+
+	// The master bus, on its way from get_output() to the metering thread.
+	// If the metering thread falls behind so that a frame doesn't fit,
+	// the frame is dropped (from the meters only, of course); the audio thread
+	// never waits for the metering thread. If <use_metering_thread> is false,
+	// there is no metering thread, and get_output() calls update_meters()
+	// directly instead.
+	bool use_metering_thread = false;
+	RingBuffer<float> metering_queue[2];  // Left and right.
+	std::thread metering_thread;
+	std::mutex metering_mutex;  // Only for sleeping on <metering_queue_changed>.
+	std::condition_variable metering_queue_changed;
+	std::atomic<bool> metering_thread_should_quit{false};
+
+	// What get_audio_levels() returns, in two parts: The bus levels are
+	// published by the audio thread after every frame, and the master levels
+	// by whoever updates the master meters (see update_meters()).
+	struct BusLevels {
+		unsigned num_buses;
+		BusLevel bus_levels[MAX_BUSES];
+		float final_makeup_gain_db;
+	};
+	SnapshotBuffer<BusLevels> bus_levels_snapshot;
+	struct MasterLevels {
+		float level_lufs, peak_db;
+		float global_level_lufs, range_low_lufs, range_high_lufs;
+		float correlation;
+	};
+	SnapshotBuffer<MasterLevels> master_levels_snapshot;
+
+	// Working memory for update_meters(); only used by the thread that
+	// updates the meters (the metering thread, or the audio thread if
+	// there is none).
+	struct MeterBuffers {
+		StereoBuffer samples;  // From <metering_queue>.
+	} meter_buffers;
+
 	// Metrics.
 	std::atomic<double> metric_audio_loudness_short_lufs{0.0 / 0.0};
 	std::atomic<double> metric_audio_loudness_integrated_lufs{0.0 / 0.0};
@@ -394,6 +573,7 @@ private:
 	std::atomic<double> metric_audio_peak_dbfs{0.0 / 0.0};
 	std::atomic<double> metric_audio_final_makeup_gain_db{0.0};
 	std::atomic<double> metric_audio_correlation{0.0};
+	std::atomic<int64_t> metric_audio_meter_dropped_frames{0};
 
 	// These are all gauges corresponding to the elements of BusLevel.
 	// In a sense, they'd probably do better as histograms, but that's an
@@ -1,42 +1,104 @@
-// Rather simplistic benchmark of AudioMixer. Sets up a simple mapping
-// with the default settings, feeds some white noise to the inputs and
-// runs a while. Useful for e.g. profiling.
+// Benchmark of AudioMixer. Sets up a configurable number of cards and buses,
+// feeds white noise to the inputs and runs a while, timing each stage of
+// get_output() per frame. Useful for e.g. profiling, and for catching
+// performance regressions before deploying a new build (see --json and
+// --baseline). Also counts heap allocations, since there should be none
+// once the mixer has warmed up. Finally, checks the block-based
+// StereoCompressor against the scalar version and times both.
+//
+// Run with --help for the options. If REFERENCE_FILE is given, the output
+// of the first few frames is compared against it (or written to it, if it
+// does not exist); this only makes sense with the same options as the ones
+// the reference was made with. With the default options, the output should
+// match the reference exactly no matter the number of bus or resampling threads.
 
 #include <assert.h>
 #include <bmusb/bmusb.h>
+#include <getopt.h>
+#include <google/protobuf/util/json_util.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <algorithm>
+#include <atomic>
 #include <chrono>
 #include <cmath>
-#include <ratio>
+#include <fstream>
+#include <new>
+#include <sstream>
+#include <string>
 #include <vector>
 
 #include "audio_mixer.h"
 #include "db.h"
 #include "defs.h"
+#include "flags.h"
 #include "input_mapping.h"
+#include "json.pb.h"
 #include "resampling_queue.h"
+#include "stereocompressor.h"
 #include "timebase.h"
 
-#define NUM_BENCHMARK_CARDS 4
-#define NUM_WARMUP_FRAMES 100
-#define NUM_BENCHMARK_FRAMES 1000
 #define NUM_TEST_FRAMES 10
-#define NUM_CHANNELS 8
-#define NUM_SAMPLES 1024
+#define NUM_COMPRESSOR_FRAMES 2000
+#define NUM_COMPRESSOR_SAMPLES 1024
 
 using namespace std;
 using namespace std::chrono;
 
-// 16-bit samples, white noise at full volume.
-uint8_t samples16[(NUM_SAMPLES * NUM_CHANNELS + 1024) * sizeof(uint16_t)];
-
-// 24-bit samples, white noise at low volume (-48 dB).
-uint8_t samples24[(NUM_SAMPLES * NUM_CHANNELS + 1024) * 3];
+struct BenchmarkConfig {
+	unsigned num_cards = 4;
+	unsigned num_buses = 2;
+	unsigned num_channels = 8;
+	vector<unsigned> bits_per_sample{ 16, 16, 16, 24 };  // Cycled through for the cards.
+	unsigned frame_size = 1024;
+	unsigned num_warmup_frames = 100;
+	unsigned num_frames = 1000;
+	unsigned bus_threads = 0;
+	unsigned resampling_threads = 0;
+	bool metering_thread = false;  // Unlike in Nageru, so that the metering and r128 stages get timed.
+	unsigned true_peak_oversampling = 4;
+
+	// The defaults are the same as AudioMixer's.
+	bool locut = true;
+	bool eq = false;  // If true, sets a bass boost and treble cut, so that the shelf filters are active.
+	bool level_compressor = true;
+	bool compressor = true;
+	bool limiter = true;
+
+	string reference_filename;
+	string json_filename;
+	string baseline_filename;
+	double tolerance_percent = 10.0;
+};
+
+// White noise for each sample format; 16-bit at full volume, 24-bit at
+// low volume (-48 dB) and 32-bit at -24 dB. Each has room for one frame
+// (plus jitter) of all channels.
+vector<uint8_t> samples16, samples24, samples32;
 
 static uint32_t seed = 1234;
 
+// Every heap allocation in the program goes through here
+// (operator new[] and the sized/nothrow variants end up in these, too).
+atomic<size_t> num_allocations{0};
+
+void *operator new(size_t size)
+{
+	++num_allocations;
+	void *ptr = malloc(size == 0 ? 1 : size);
+	if (ptr == nullptr) {
+		throw bad_alloc();
+	}
+	return ptr;
+}
+
+void operator delete(void *ptr) noexcept
+{
+	free(ptr);
+}
+
 // We use our own instead of rand() to get deterministic behavior.
 // Quality doesn't really matter much.
 uint32_t lcgrand()
@@ -50,67 +112,110 @@ void reset_lcgrand()
 	seed = 1234;
 }
 
-void callback(float level_lufs, float peak_db,
-              std::vector<AudioMixer::BusLevel> bus_levels,
-	      float global_level_lufs, float range_low_lufs, float range_high_lufs,
-	      float final_makeup_gain_db,
-	      float correlation)
+void init_samples(const BenchmarkConfig &config)
+{
+	const size_t num_samples = config.frame_size * config.num_channels + 1024;
+	samples16.resize(num_samples * 2);
+	samples24.resize(num_samples * 3);
+	samples32.resize(num_samples * 4);
+
+	reset_lcgrand();
+	for (size_t i = 0; i < num_samples; ++i) {
+		samples16[i * 2] = lcgrand() & 0xff;
+		samples16[i * 2 + 1] = lcgrand() & 0xff;
+
+		samples24[i * 3] = lcgrand() & 0xff;
+		samples24[i * 3 + 1] = lcgrand() & 0xff;
+		samples24[i * 3 + 2] = 0;
+	}
+	for (size_t i = 0; i < num_samples; ++i) {
+		const uint32_t s = uint32_t(int32_t(lcgrand()) >> 4);
+		samples32[i * 4] = s & 0xff;
+		samples32[i * 4 + 1] = (s >> 8) & 0xff;
+		samples32[i * 4 + 2] = (s >> 16) & 0xff;
+		samples32[i * 4 + 3] = s >> 24;
+	}
+}
+
+const uint8_t *get_samples(unsigned bits_per_sample)
 {
-	// Empty.
+	switch (bits_per_sample) {
+	case 16:
+		return samples16.data();
+	case 24:
+		return samples24.data();
+	case 32:
+		return samples32.data();
+	default:
+		assert(false);
+		return nullptr;
+	}
 }
 
-vector<float> process_frame(unsigned frame_num, AudioMixer *mixer)
+void process_frame(const BenchmarkConfig &config, unsigned frame_num, AudioMixer *mixer, vector<float> *output)
 {
-	duration<int64_t, ratio<NUM_SAMPLES, OUTPUT_FREQUENCY>> frame_duration(frame_num);
 	steady_clock::time_point ts = steady_clock::time_point::min() +
-		duration_cast<steady_clock::duration>(frame_duration);
+		nanoseconds(int64_t(frame_num) * config.frame_size * 1000000000ll / OUTPUT_FREQUENCY);
 
 	// Feed the inputs.
-	for (unsigned card_index = 0; card_index < NUM_BENCHMARK_CARDS; ++card_index) {
+	for (unsigned card_index = 0; card_index < config.num_cards; ++card_index) {
 		bmusb::AudioFormat audio_format;
-		audio_format.bits_per_sample = card_index == 3 ? 24 : 16;
-		audio_format.num_channels = NUM_CHANNELS;
-		
-		unsigned num_samples = NUM_SAMPLES + (lcgrand() % 9) - 5;
+		audio_format.bits_per_sample = config.bits_per_sample[card_index % config.bits_per_sample.size()];
+		audio_format.num_channels = config.num_channels;
+
+		unsigned num_samples = config.frame_size + (lcgrand() % 9) - 5;
 		bool ok = mixer->add_audio(DeviceSpec{InputSourceType::CAPTURE_CARD, card_index},
-			card_index == 3 ? samples24 : samples16, num_samples, audio_format,
-			NUM_SAMPLES * TIMEBASE / OUTPUT_FREQUENCY, ts);
+			get_samples(audio_format.bits_per_sample), num_samples, audio_format,
+			int64_t(config.frame_size) * TIMEBASE / OUTPUT_FREQUENCY, ts);
 		assert(ok);
 	}
 
-	return mixer->get_output(ts, NUM_SAMPLES, ResamplingQueue::ADJUST_RATE);
+	mixer->get_output(ts, config.frame_size, ResamplingQueue::ADJUST_RATE, output);
 }
 
-void init_mapping(AudioMixer *mixer)
+void init_mixer(const BenchmarkConfig &config, AudioMixer *mixer)
 {
 	InputMapping mapping;
-
-	InputMapping::Bus bus1;
-	bus1.device = DeviceSpec{InputSourceType::CAPTURE_CARD, 0};
-	bus1.source_channel[0] = 0;
-	bus1.source_channel[1] = 1;
-	mapping.buses.push_back(bus1);
-
-	InputMapping::Bus bus2;
-	bus2.device = DeviceSpec{InputSourceType::CAPTURE_CARD, 3};
-	bus2.source_channel[0] = 6;
-	bus2.source_channel[1] = 4;
-	mapping.buses.push_back(bus2);
-
+	for (unsigned bus_index = 0; bus_index < config.num_buses; ++bus_index) {
+		InputMapping::Bus bus;
+		if (bus_index == 1 && config.num_cards > 3 && config.num_channels > 6) {
+			// The second bus of the original benchmark; keeps the
+			// default setup the same as before.
+			bus.device = DeviceSpec{InputSourceType::CAPTURE_CARD, 3};
+			bus.source_channel[0] = 6;
+			bus.source_channel[1] = 4;
+		} else {
+			bus.device = DeviceSpec{InputSourceType::CAPTURE_CARD, bus_index % config.num_cards};
+			bus.source_channel[0] = (bus_index * 2) % config.num_channels;
+			bus.source_channel[1] = (bus_index * 2 + 1) % config.num_channels;
+		}
+		mapping.buses.push_back(bus);
+	}
 	mixer->set_input_mapping(mapping);
+
+	for (unsigned bus_index = 0; bus_index < config.num_buses; ++bus_index) {
+		mixer->set_locut_enabled(bus_index, config.locut);
+		mixer->set_eq(bus_index, EQ_BAND_BASS, config.eq ? 6.0f : 0.0f);
+		mixer->set_eq(bus_index, EQ_BAND_TREBLE, config.eq ? -4.0f : 0.0f);
+		mixer->set_gain_staging_auto(bus_index, config.level_compressor);
+		mixer->set_compressor_enabled(bus_index, config.compressor);
+	}
+	mixer->set_limiter_enabled(config.limiter);
 }
 
-void do_test(const char *filename)
+void do_test(const BenchmarkConfig &config, const char *filename)
 {
-	AudioMixer mixer(NUM_BENCHMARK_CARDS);
-	mixer.set_audio_level_callback(callback);
-	init_mapping(&mixer);
+	// The final makeup gain depends on the loudness measurements, so the
+	// output is only deterministic if they are made on the audio thread.
+	global_flags.audio_metering_thread = false;
+	AudioMixer mixer(config.num_cards);
+	init_mixer(config, &mixer);
 
 	reset_lcgrand();
 
-	vector<float> output;
+	vector<float> output, frame_output;
 	for (unsigned i = 0; i < NUM_TEST_FRAMES; ++i) {
-		vector<float> frame_output = process_frame(i, &mixer);
+		process_frame(config, i, &mixer, &frame_output);
 		output.insert(output.end(), frame_output.begin(), frame_output.end());
 	}
 
@@ -139,48 +244,502 @@ void do_test(const char *filename)
 	printf("RMS error:     %+.1f dB\n", to_db(sqrt(sum_sq_err) / output.size()));
 }
 
-void do_benchmark()
+// Fills in everything but the name. Reorders <times_sec>.
+void summarize_stage(vector<double> *times_sec, AudioMixerBenchmarkStage *stage)
 {
-	AudioMixer mixer(NUM_BENCHMARK_CARDS);
-	mixer.set_audio_level_callback(callback);
-	init_mapping(&mixer);
+	assert(!times_sec->empty());
+	sort(times_sec->begin(), times_sec->end());
+	auto percentile_us = [times_sec](double q) {
+		size_t idx = min<size_t>(times_sec->size() - 1, size_t(q * times_sec->size()));
+		return (*times_sec)[idx] * 1e6;
+	};
+	double sum = 0.0;
+	for (double t : *times_sec) {
+		sum += t;
+	}
+	stage->set_mean_us(sum / times_sec->size() * 1e6);
+	stage->set_p50_us(percentile_us(0.50));
+	stage->set_p95_us(percentile_us(0.95));
+	stage->set_p99_us(percentile_us(0.99));
+	stage->set_max_us(times_sec->back() * 1e6);
+}
+
+void fill_config_proto(const BenchmarkConfig &config, AudioMixerBenchmarkConfig *proto)
+{
+	proto->set_num_cards(config.num_cards);
+	proto->set_num_buses(config.num_buses);
+	proto->set_num_channels(config.num_channels);
+	for (unsigned bits : config.bits_per_sample) {
+		proto->add_bits_per_sample(bits);
+	}
+	proto->set_frame_size(config.frame_size);
+	proto->set_num_frames(config.num_frames);
+	proto->set_bus_threads(config.bus_threads);
+	proto->set_resampling_threads(config.resampling_threads);
+	proto->set_metering_thread(config.metering_thread);
+	proto->set_true_peak_oversampling(config.true_peak_oversampling);
+	proto->set_locut(config.locut);
+	proto->set_eq(config.eq);
+	proto->set_level_compressor(config.level_compressor);
+	proto->set_compressor(config.compressor);
+	proto->set_limiter(config.limiter);
+}
+
+void do_benchmark(const BenchmarkConfig &config, AudioMixerBenchmark *result)
+{
+	global_flags.audio_metering_thread = config.metering_thread;
+	AudioMixer mixer(config.num_cards);
+	init_mixer(config, &mixer);
+	mixer.set_stage_timing_enabled(true);
+
+	// Per frame; index 0 is the entire get_output() call,
+	// then one for each AudioMixer::ProcessingStage.
+	constexpr unsigned num_stages = AudioMixer::NUM_PROCESSING_STAGES + 1;
+	vector<double> times_sec[num_stages];
+	for (unsigned stage = 0; stage < num_stages; ++stage) {
+		times_sec[stage].resize(config.num_frames);
+	}
 
 	size_t out_samples = 0;
+	size_t allocations_at_start = 0;
 
 	reset_lcgrand();
 
+	vector<float> output;
 	steady_clock::time_point start, end;
-	for (unsigned i = 0; i < NUM_WARMUP_FRAMES + NUM_BENCHMARK_FRAMES; ++i) {
-		if (i == NUM_WARMUP_FRAMES) {
+	for (unsigned i = 0; i < config.num_warmup_frames + config.num_frames; ++i) {
+		if (i == config.num_warmup_frames) {
 			start = steady_clock::now();
+			allocations_at_start = num_allocations;
 		}
-		vector<float> output = process_frame(i, &mixer);
-		if (i >= NUM_WARMUP_FRAMES) {
+		steady_clock::time_point frame_start = steady_clock::now();
+		process_frame(config, i, &mixer, &output);
+		steady_clock::time_point frame_end = steady_clock::now();
+		if (i >= config.num_warmup_frames) {
+			const unsigned frame_idx = i - config.num_warmup_frames;
 			out_samples += output.size();
+			times_sec[0][frame_idx] = duration<double>(frame_end - frame_start).count();
+
+			double stage_times[AudioMixer::NUM_PROCESSING_STAGES];
+			mixer.get_last_stage_times(stage_times);
+			for (unsigned stage = 0; stage < AudioMixer::NUM_PROCESSING_STAGES; ++stage) {
+				times_sec[stage + 1][frame_idx] = stage_times[stage];
+			}
 		}
 	}
 	end = steady_clock::now();
+	size_t allocations = num_allocations - allocations_at_start;
 
 	double elapsed = duration<double>(end - start).count();
 	double simulated = double(out_samples) / (OUTPUT_FREQUENCY * 2);
 	printf("%ld samples produced in %.1f ms (%.1f%% CPU, %.1fx realtime).\n",
 		out_samples, elapsed * 1e3, 100.0 * elapsed / simulated, simulated / elapsed);
+	printf("%zu heap allocations after warmup (%.2f per frame).\n",
+		allocations, double(allocations) / config.num_frames);
+
+	fill_config_proto(config, result->mutable_config());
+	result->set_realtime_factor(simulated / elapsed);
+	result->set_heap_allocations(allocations);
+
+	printf("\n%-12s %10s %10s %10s %10s %10s\n", "Stage", "mean us", "p50 us", "p95 us", "p99 us", "max us");
+	for (unsigned stage = 0; stage < num_stages; ++stage) {
+		AudioMixerBenchmarkStage *stage_proto = result->add_stage();
+		stage_proto->set_name(stage == 0 ? "total" : AudioMixer::get_processing_stage_name(AudioMixer::ProcessingStage(stage - 1)));
+		summarize_stage(&times_sec[stage], stage_proto);
+		printf("%-12s %10.2f %10.2f %10.2f %10.2f %10.2f\n", stage_proto->name().c_str(),
+			stage_proto->mean_us(), stage_proto->p50_us(), stage_proto->p95_us(),
+			stage_proto->p99_us(), stage_proto->max_us());
+	}
+	if (config.bus_threads > 0) {
+		printf("(Per-bus stages are summed over all bus threads.)\n");
+	}
+	if (config.resampling_threads > 0) {
+		printf("(Resampling is summed over all resampling threads.)\n");
+	}
+	if (config.metering_thread) {
+		printf("(Master metering is on its own thread, and not counted.)\n");
+	}
 }
 
-int main(int argc, char **argv)
+bool write_json(const AudioMixerBenchmark &result, const string &filename)
 {
-	for (unsigned i = 0; i < NUM_SAMPLES * NUM_CHANNELS + 1024; ++i) {
-		samples16[i * 2] = lcgrand() & 0xff;
-		samples16[i * 2 + 1] = lcgrand() & 0xff;
+	google::protobuf::util::JsonPrintOptions options;
+	options.add_whitespace = true;
+	options.preserve_proto_field_names = true;
+	string contents;
+	if (!google::protobuf::util::MessageToJsonString(result, &contents, options).ok()) {
+		fprintf(stderr, "Could not serialize benchmark results to JSON.\n");
+		return false;
+	}
 
-		samples24[i * 3] = lcgrand() & 0xff;
-		samples24[i * 3 + 1] = lcgrand() & 0xff;
-		samples24[i * 3 + 2] = 0;
+	FILE *fp = fopen(filename.c_str(), "w");
+	if (fp == nullptr) {
+		perror(filename.c_str());
+		return false;
 	}
+	fwrite(contents.data(), contents.size(), 1, fp);
+	fclose(fp);
+	return true;
+}
+
+// Returns false if any stage got slower than the baseline by more than the
+// tolerance (judged by the median, which is the least noisy), or if the
+// baseline could not be read.
+bool compare_to_baseline(const BenchmarkConfig &config, const AudioMixerBenchmark &result)
+{
+	ifstream in(config.baseline_filename);
+	if (!in) {
+		perror(config.baseline_filename.c_str());
+		return false;
+	}
+	stringstream ss;
+	ss << in.rdbuf();
 
-	if (argc == 2) {
-		do_test(argv[1]);
+	AudioMixerBenchmark baseline;
+	if (!google::protobuf::util::JsonStringToMessage(ss.str(), &baseline).ok()) {
+		fprintf(stderr, "%s: Could not parse benchmark results.\n", config.baseline_filename.c_str());
+		return false;
 	}
-	do_benchmark();
+	if (baseline.config().SerializeAsString() != result.config().SerializeAsString()) {
+		fprintf(stderr, "WARNING: %s was made with different options; the comparison may be meaningless.\n",
+			config.baseline_filename.c_str());
+	}
+
+	bool ok = true;
+	printf("\nCompared to %s (tolerance %.1f%%):\n", config.baseline_filename.c_str(), config.tolerance_percent);
+	printf("%-12s %14s %14s %10s\n", "Stage", "baseline p50", "p50", "change");
+	for (const AudioMixerBenchmarkStage &stage : result.stage()) {
+		const AudioMixerBenchmarkStage *base_stage = nullptr;
+		for (const AudioMixerBenchmarkStage &s : baseline.stage()) {
+			if (s.name() == stage.name()) {
+				base_stage = &s;
+			}
+		}
+		if (base_stage == nullptr) {
+			printf("%-12s %14s %14.2f\n", stage.name().c_str(), "-", stage.p50_us());
+			continue;
+		}
+
+		double change_percent = 100.0 * (stage.p50_us() / base_stage->p50_us() - 1.0);
+		bool regression = change_percent > config.tolerance_percent;
+		printf("%-12s %14.2f %14.2f %+9.1f%%%s\n", stage.name().c_str(),
+			base_stage->p50_us(), stage.p50_us(), change_percent,
+			regression ? "  REGRESSION" : "");
+		if (regression) {
+			ok = false;
+		}
+	}
+	if (result.heap_allocations() > baseline.heap_allocations()) {
+		printf("Heap allocations after warmup went from %ld to %ld.  REGRESSION\n",
+			long(baseline.heap_allocations()), long(result.heap_allocations()));
+		ok = false;
+	}
+	return ok;
+}
+
+struct CompressorSettings {
+	const char *name;
+	float threshold, ratio, attack_time, release_time, makeup_gain;
+};
+
+// Noise whose level moves up and down quite a bit, so that we get both
+// attack and release, and spend time both above and below the threshold.
+// The left channel comes first in <buf>, then the right.
+void fill_compressor_input(unsigned frame_num, float *buf)
+{
+	const float level = from_db(-30.0f + 30.0f * sin(frame_num * 0.05f));
+	for (unsigned i = 0; i < NUM_COMPRESSOR_SAMPLES * 2; ++i) {
+		buf[i] = level * (int32_t(lcgrand()) * (1.0f / 2147483648.0f));
+	}
+}
+
+void do_compressor_test(const CompressorSettings &settings)
+{
+	StereoCompressor compressor(OUTPUT_FREQUENCY), compressor_plain(OUTPUT_FREQUENCY);
+	vector<float> buf(NUM_COMPRESSOR_SAMPLES * 2), buf_plain(NUM_COMPRESSOR_SAMPLES * 2);
+
+	reset_lcgrand();
+
+	float max_err = 0.0f;
+	double elapsed = 0.0, elapsed_plain = 0.0;
+	for (unsigned i = 0; i < NUM_COMPRESSOR_FRAMES; ++i) {
+		fill_compressor_input(i, &buf[0]);
+		buf_plain = buf;
+
+		steady_clock::time_point start = steady_clock::now();
+		compressor.process(&buf[0], &buf[NUM_COMPRESSOR_SAMPLES], NUM_COMPRESSOR_SAMPLES, settings.threshold, settings.ratio,
+			settings.attack_time, settings.release_time, settings.makeup_gain);
+		steady_clock::time_point mid = steady_clock::now();
+		compressor_plain.process_plain(&buf_plain[0], &buf_plain[NUM_COMPRESSOR_SAMPLES], NUM_COMPRESSOR_SAMPLES, settings.threshold, settings.ratio,
+			settings.attack_time, settings.release_time, settings.makeup_gain);
+		steady_clock::time_point end = steady_clock::now();
+
+		elapsed += duration<double>(mid - start).count();
+		elapsed_plain += duration<double>(end - mid).count();
+		for (unsigned j = 0; j < NUM_COMPRESSOR_SAMPLES * 2; ++j) {
+			max_err = max(max_err, fabs(buf[j] - buf_plain[j]));
+		}
+	}
+
+	printf("Compressor (%s): largest error %.6f, %.1f ns/sample (scalar: %.1f ns/sample)\n",
+		settings.name, max_err,
+		1e9 * elapsed / (NUM_COMPRESSOR_FRAMES * NUM_COMPRESSOR_SAMPLES),
+		1e9 * elapsed_plain / (NUM_COMPRESSOR_FRAMES * NUM_COMPRESSOR_SAMPLES));
+}
+
+enum {
+	OPTION_CARDS = 1000,
+	OPTION_BUSES,
+	OPTION_CHANNELS,
+	OPTION_FORMATS,
+	OPTION_FRAME_SIZE,
+	OPTION_FRAMES,
+	OPTION_WARMUP_FRAMES,
+	OPTION_BUS_THREADS,
+	OPTION_RESAMPLING_THREADS,
+	OPTION_METERING_THREAD,
+	OPTION_TRUE_PEAK_OVERSAMPLING,
+	OPTION_LOCUT,
+	OPTION_EQ,
+	OPTION_LEVEL_COMPRESSOR,
+	OPTION_COMPRESSOR,
+	OPTION_LIMITER,
+	OPTION_JSON,
+	OPTION_BASELINE,
+	OPTION_TOLERANCE,
+	OPTION_HELP,
+};
+
+void usage(const char *argv0)
+{
+	fprintf(stderr, "Usage: %s [OPTION]... [REFERENCE_FILE [NUM_BUS_THREADS]]\n", argv0);
+	fprintf(stderr, "\n");
+	fprintf(stderr, "      --cards=NUM                 number of capture cards (default 4)\n");
+	fprintf(stderr, "      --buses=NUM                 number of buses (default 2)\n");
+	fprintf(stderr, "      --channels=NUM              channels per card (default 8)\n");
+	fprintf(stderr, "      --formats=BITS[,BITS...]    bits per sample (16, 24 or 32), cycled through\n");
+	fprintf(stderr, "                                    for the cards (default 16,16,16,24)\n");
+	fprintf(stderr, "      --frame-size=SAMPLES        samples per frame (default 1024)\n");
+	fprintf(stderr, "      --frames=NUM                number of frames to time (default 1000)\n");
+	fprintf(stderr, "      --warmup-frames=NUM         number of frames to run first (default 100)\n");
+	fprintf(stderr, "      --bus-threads=NUM           like --audio-bus-threads in Nageru (default 0)\n");
+	fprintf(stderr, "      --resampling-threads=NUM    like --audio-resampling-threads in Nageru (default 0)\n");
+	fprintf(stderr, "      --metering-thread=on|off    off is like --no-audio-metering-thread in Nageru\n");
+	fprintf(stderr, "                                    (default off, so that master metering is timed;\n");
+	fprintf(stderr, "                                    the reference test is always off)\n");
+	fprintf(stderr, "      --true-peak-oversampling=2|4  like --audio-true-peak-oversampling in Nageru (default 4)\n");
+	fprintf(stderr, "      --locut=on|off              (default on)\n");
+	fprintf(stderr, "      --eq=on|off                 bass and treble shelves (default off)\n");
+	fprintf(stderr, "      --level-compressor=on|off   (default on)\n");
+	fprintf(stderr, "      --compressor=on|off         (default on)\n");
+	fprintf(stderr, "      --limiter=on|off            (default on)\n");
+	fprintf(stderr, "      --json=FILE                 write the results to FILE as JSON\n");
+	fprintf(stderr, "      --baseline=FILE             compare against results from an earlier --json run;\n");
+	fprintf(stderr, "                                    exits with status 1 on regressions\n");
+	fprintf(stderr, "      --tolerance=PERCENT         how much slower a stage may get before it counts\n");
+	fprintf(stderr, "                                    as a regression (default 10)\n");
+}
+
+bool parse_on_off(const char *option, const char *arg)
+{
+	if (strcmp(arg, "on") == 0) {
+		return true;
+	} else if (strcmp(arg, "off") == 0) {
+		return false;
+	}
+	fprintf(stderr, "--%s must be on or off.\n", option);
+	exit(1);
+}
+
+unsigned parse_positive(const char *option, const char *arg)
+{
+	int val = atoi(arg);
+	if (val <= 0) {
+		fprintf(stderr, "--%s must be at least 1.\n", option);
+		exit(1);
+	}
+	return val;
+}
+
+vector<unsigned> parse_formats(const char *arg)
+{
+	vector<unsigned> ret;
+	stringstream ss(arg);
+	string bits;
+	while (getline(ss, bits, ',')) {
+		unsigned val = atoi(bits.c_str());
+		if (val != 16 && val != 24 && val != 32) {
+			fprintf(stderr, "--formats: %s is not 16, 24 or 32.\n", bits.c_str());
+			exit(1);
+		}
+		ret.push_back(val);
+	}
+	if (ret.empty()) {
+		fprintf(stderr, "--formats needs at least one format.\n");
+		exit(1);
+	}
+	return ret;
 }
 
+void parse_options(int argc, char **argv, BenchmarkConfig *config)
+{
+	static const option long_options[] = {
+		{ "cards", required_argument, 0, OPTION_CARDS },
+		{ "buses", required_argument, 0, OPTION_BUSES },
+		{ "channels", required_argument, 0, OPTION_CHANNELS },
+		{ "formats", required_argument, 0, OPTION_FORMATS },
+		{ "frame-size", required_argument, 0, OPTION_FRAME_SIZE },
+		{ "frames", required_argument, 0, OPTION_FRAMES },
+		{ "warmup-frames", required_argument, 0, OPTION_WARMUP_FRAMES },
+		{ "bus-threads", required_argument, 0, OPTION_BUS_THREADS },
+		{ "resampling-threads", required_argument, 0, OPTION_RESAMPLING_THREADS },
+		{ "metering-thread", required_argument, 0, OPTION_METERING_THREAD },
+		{ "true-peak-oversampling", required_argument, 0, OPTION_TRUE_PEAK_OVERSAMPLING },
+		{ "locut", required_argument, 0, OPTION_LOCUT },
+		{ "eq", required_argument, 0, OPTION_EQ },
+		{ "level-compressor", required_argument, 0, OPTION_LEVEL_COMPRESSOR },
+		{ "compressor", required_argument, 0, OPTION_COMPRESSOR },
+		{ "limiter", required_argument, 0, OPTION_LIMITER },
+		{ "json", required_argument, 0, OPTION_JSON },
+		{ "baseline", required_argument, 0, OPTION_BASELINE },
+		{ "tolerance", required_argument, 0, OPTION_TOLERANCE },
+		{ "help", no_argument, 0, OPTION_HELP },
+		{ 0, 0, 0, 0 }
+	};
+	for ( ;; ) {
+		int option_index = 0;
+		int c = getopt_long(argc, argv, "", long_options, &option_index);
+		if (c == -1) {
+			break;
+		}
+		switch (c) {
+		case OPTION_CARDS:
+			config->num_cards = parse_positive("cards", optarg);
+			break;
+		case OPTION_BUSES:
+			config->num_buses = parse_positive("buses", optarg);
+			break;
+		case OPTION_CHANNELS:
+			config->num_channels = parse_positive("channels", optarg);
+			break;
+		case OPTION_FORMATS:
+			config->bits_per_sample = parse_formats(optarg);
+			break;
+		case OPTION_FRAME_SIZE:
+			config->frame_size = parse_positive("frame-size", optarg);
+			break;
+		case OPTION_FRAMES:
+			config->num_frames = parse_positive("frames", optarg);
+			break;
+		case OPTION_WARMUP_FRAMES:
+			config->num_warmup_frames = atoi(optarg);
+			break;
+		case OPTION_BUS_THREADS:
+			config->bus_threads = atoi(optarg);
+			break;
+		case OPTION_RESAMPLING_THREADS:
+			config->resampling_threads = atoi(optarg);
+			break;
+		case OPTION_METERING_THREAD:
+			config->metering_thread = parse_on_off("metering-thread", optarg);
+			break;
+		case OPTION_TRUE_PEAK_OVERSAMPLING:
+			config->true_peak_oversampling = atoi(optarg);
+			if (config->true_peak_oversampling != 2 && config->true_peak_oversampling != 4) {
+				fprintf(stderr, "--true-peak-oversampling must be 2 or 4.\n");
+				exit(1);
+			}
+			break;
+		case OPTION_LOCUT:
+			config->locut = parse_on_off("locut", optarg);
+			break;
+		case OPTION_EQ:
+			config->eq = parse_on_off("eq", optarg);
+			break;
+		case OPTION_LEVEL_COMPRESSOR:
+			config->level_compressor = parse_on_off("level-compressor", optarg);
+			break;
+		case OPTION_COMPRESSOR:
+			config->compressor = parse_on_off("compressor", optarg);
+			break;
+		case OPTION_LIMITER:
+			config->limiter = parse_on_off("limiter", optarg);
+			break;
+		case OPTION_JSON:
+			config->json_filename = optarg;
+			break;
+		case OPTION_BASELINE:
+			config->baseline_filename = optarg;
+			break;
+		case OPTION_TOLERANCE:
+			config->tolerance_percent = atof(optarg);
+			break;
+		case OPTION_HELP:
+			usage(argv[0]);
+			exit(0);
+		default:
+			usage(argv[0]);
+			exit(1);
+		}
+	}
+
+	// The old positional arguments.
+	if (optind < argc) {
+		config->reference_filename = argv[optind++];
+	}
+	if (optind < argc) {
+		config->bus_threads = atoi(argv[optind++]);
+	}
+	if (optind < argc) {
+		usage(argv[0]);
+		exit(1);
+	}
+
+	if (config->num_cards > MAX_VIDEO_CARDS) {
+		fprintf(stderr, "--cards can be at most %d.\n", MAX_VIDEO_CARDS);
+		exit(1);
+	}
+	if (config->num_buses > MAX_BUSES) {
+		fprintf(stderr, "--buses can be at most %d.\n", MAX_BUSES);
+		exit(1);
+	}
+	if (config->num_channels > 64) {
+		fprintf(stderr, "--channels can be at most 64.\n");
+		exit(1);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	BenchmarkConfig config;
+	parse_options(argc, argv, &config);
+
+	init_samples(config);
+
+	global_flags.audio_bus_threads = config.bus_threads;
+	global_flags.audio_resampling_threads = config.resampling_threads;
+	global_flags.audio_true_peak_oversampling = config.true_peak_oversampling;
+	if (!config.reference_filename.empty()) {
+		do_test(config, config.reference_filename.c_str());
+	}
+
+	AudioMixerBenchmark result;
+	do_benchmark(config, &result);
+
+	bool ok = true;
+	if (!config.json_filename.empty() && !write_json(result, config.json_filename)) {
+		ok = false;
+	}
+	if (!config.baseline_filename.empty() && !compare_to_baseline(config, result)) {
+		ok = false;
+	}
+
+	// The settings AudioMixer uses for each of its compressors (see process_bus()
+	// and get_output()), with the default thresholds; keep them in sync.
+	printf("\n");
+	do_compressor_test({ "level compressor", 0.01f, 20.0f, 0.5f, 20.0f, float(from_db(26.0f)) });  // -40 dBFS.
+	do_compressor_test({ "compressor", float(from_db(-26.0f)), 20.0f, 0.005f, 0.040f, 2.0f });
+	do_compressor_test({ "limiter", float(from_db(-10.0f)), 30.0f, 0.0f, 0.020f, 1.0f });
+
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,180 @@
+// Microbenchmark of the per-bus EQ (locut plus bass and treble shelves),
+// the way AudioMixer::apply_eq() runs it. Compares the old way of doing it
+// (one StereoFilter::render() per filter, with fades recalculating the
+// coefficients every 32 samples) to StereoFilterCascade, both with constant
+// EQ and with the EQ fading all the time, and checks that they agree.
+// (The cascade works on separate left and right buffers, like AudioMixer.)
+// Prints the cost per bus at 48 kHz.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <vector>
+
+#include "defs.h"
+#include "filter.h"
+
+#define NUM_WARMUP_FRAMES 100
+#define NUM_BENCHMARK_FRAMES 10000
+#define NUM_SAMPLES 800  // One frame at 60 fps.
+
+using namespace std;
+using namespace std::chrono;
+
+namespace {
+
+constexpr float bass_freq_hz = 200.0f;
+constexpr float treble_freq_hz = 4700.0f;
+constexpr float locut_freq_hz = 120.0f;
+constexpr unsigned fade_block_size = StereoFilterCascade::fade_block_size;
+
+float hz_to_linear_cutoff(float cutoff_hz)
+{
+	return cutoff_hz * 2.0 * M_PI / OUTPUT_FREQUENCY;
+}
+
+struct Bus {
+	Bus()
+	{
+		locut.init(FILTER_HPF, 2);
+		bass.init(FILTER_LOW_SHELF, 1);
+		treble.init(FILTER_HIGH_SHELF, 1);
+	}
+
+	StereoFilter locut, bass, treble;
+};
+
+// The EQ gains (bass and treble, in dB) for the given frame.
+// If <fading> is false, they are constant.
+void get_eq_db(unsigned frame_num, bool fading, float *bass_db, float *treble_db)
+{
+	if (fading) {
+		*bass_db = 10.0f * sin(frame_num * 0.1f);
+		*treble_db = -8.0f * cos(frame_num * 0.07f);
+	} else {
+		*bass_db = 6.0f;
+		*treble_db = -4.0f;
+	}
+}
+
+// The old apply_filter_fade() from AudioMixer.
+void apply_filter_fade(StereoFilter *filter, float *data, unsigned num_samples, float cutoff_hz, float db, float last_db)
+{
+	const float cutoff_linear = hz_to_linear_cutoff(cutoff_hz);
+	if (fabs(db - last_db) < 1e-3) {
+		if (fabs(db) > 0.01f) {
+			filter->render(data, num_samples, cutoff_linear, 0.5f, db / 40.0f);
+		}
+	} else {
+		unsigned num_blocks = (num_samples + fade_block_size - 1) / fade_block_size;
+		const float inc_db_norm = (db - last_db) / 40.0f / num_blocks;
+		float db_norm = db / 40.0f;
+		for (size_t i = 0; i < num_samples; i += fade_block_size) {
+			size_t samples_this_block = std::min<size_t>(num_samples - i, fade_block_size);
+			filter->render(data + i * 2, samples_this_block, cutoff_linear, 0.5f, db_norm);
+			db_norm += inc_db_norm;
+		}
+	}
+}
+
+void eq_frame_separate(Bus *bus, float *data, float bass_db, float last_bass_db, float treble_db, float last_treble_db)
+{
+	bus->locut.render(data, NUM_SAMPLES, hz_to_linear_cutoff(locut_freq_hz), 0.5f);
+	apply_filter_fade(&bus->bass, data, NUM_SAMPLES, bass_freq_hz, bass_db, last_bass_db);
+	apply_filter_fade(&bus->treble, data, NUM_SAMPLES, treble_freq_hz, treble_db, last_treble_db);
+}
+
+void add_filter_fade(StereoFilterCascade *cascade, StereoFilter *filter, const EQCoefficientTable *table, float cutoff_hz, float db, float last_db)
+{
+	if (fabs(db - last_db) < 1e-3) {
+		if (fabs(db) > 0.01f) {
+			cascade->add(filter, hz_to_linear_cutoff(cutoff_hz), 0.5f, db / 40.0f);
+		}
+	} else {
+		const unsigned num_blocks = (NUM_SAMPLES + fade_block_size - 1) / fade_block_size;
+		cascade->add_fade(filter, table, db / 40.0f, (db - last_db) / 40.0f / num_blocks);
+	}
+}
+
+void eq_frame_cascade(Bus *bus, const EQCoefficientTable &bass_table, const EQCoefficientTable &treble_table,
+                      float *data, float bass_db, float last_bass_db, float treble_db, float last_treble_db)
+{
+	StereoFilterCascade cascade;
+	cascade.add(&bus->locut, hz_to_linear_cutoff(locut_freq_hz), 0.5f);
+	add_filter_fade(&cascade, &bus->bass, &bass_table, bass_freq_hz, bass_db, last_bass_db);
+	add_filter_fade(&cascade, &bus->treble, &treble_table, treble_freq_hz, treble_db, last_treble_db);
+	cascade.render(data, data + NUM_SAMPLES, NUM_SAMPLES);
+}
+
+// Feeds the same noise through both versions, and returns the time per frame
+// for each (and the largest difference between them).
+void run(bool fading, double *separate_sec, double *cascade_sec, float *max_err)
+{
+	const EQCoefficientTable bass_table(FILTER_LOW_SHELF, 1, hz_to_linear_cutoff(bass_freq_hz), 0.5f);
+	const EQCoefficientTable treble_table(FILTER_HIGH_SHELF, 1, hz_to_linear_cutoff(treble_freq_hz), 0.5f);
+
+	Bus bus_separate, bus_cascade;
+	vector<float> input(NUM_SAMPLES * 2), data_separate(NUM_SAMPLES * 2);
+	vector<float> data_cascade(NUM_SAMPLES * 2);  // All of the left channel, then all of the right.
+
+	uint32_t seed = 1234;
+	float last_bass_db, last_treble_db;
+	get_eq_db(0, fading, &last_bass_db, &last_treble_db);
+	*separate_sec = *cascade_sec = 0.0;
+	*max_err = 0.0f;
+	for (unsigned i = 0; i < NUM_WARMUP_FRAMES + NUM_BENCHMARK_FRAMES; ++i) {
+		for (float &sample : input) {
+			seed = seed * 1103515245u + 12345u;
+			sample = int32_t(seed) * (0.5f / 2147483648.0f);
+		}
+		data_separate = input;
+		for (unsigned j = 0; j < NUM_SAMPLES; ++j) {
+			data_cascade[j] = input[j * 2 + 0];
+			data_cascade[j + NUM_SAMPLES] = input[j * 2 + 1];
+		}
+
+		float bass_db, treble_db;
+		get_eq_db(i, fading, &bass_db, &treble_db);
+
+		steady_clock::time_point start = steady_clock::now();
+		eq_frame_separate(&bus_separate, data_separate.data(), bass_db, last_bass_db, treble_db, last_treble_db);
+		steady_clock::time_point mid = steady_clock::now();
+		eq_frame_cascade(&bus_cascade, bass_table, treble_table, data_cascade.data(), bass_db, last_bass_db, treble_db, last_treble_db);
+		steady_clock::time_point end = steady_clock::now();
+
+		if (i >= NUM_WARMUP_FRAMES) {
+			*separate_sec += duration<double>(mid - start).count();
+			*cascade_sec += duration<double>(end - mid).count();
+		}
+		for (unsigned j = 0; j < NUM_SAMPLES; ++j) {
+			*max_err = max(*max_err, fabs(data_separate[j * 2 + 0] - data_cascade[j]));
+			*max_err = max(*max_err, fabs(data_separate[j * 2 + 1] - data_cascade[j + NUM_SAMPLES]));
+		}
+
+		last_bass_db = bass_db;
+		last_treble_db = treble_db;
+	}
+	*separate_sec /= NUM_BENCHMARK_FRAMES;
+	*cascade_sec /= NUM_BENCHMARK_FRAMES;
+}
+
+}  // namespace
+
+int main(int argc, char **argv)
+{
+	for (bool fading : { false, true }) {
+		double separate_sec, cascade_sec;
+		float max_err;
+		run(fading, &separate_sec, &cascade_sec, &max_err);
+
+		// How much of one core a single bus' EQ takes at 48 kHz.
+		const double frame_sec = double(NUM_SAMPLES) / OUTPUT_FREQUENCY;
+		printf("%-9s  separate filters %6.2f us/frame (%.3f%% CPU),  cascade %6.2f us/frame (%.3f%% CPU, %.1fx),  largest error %.2g\n",
+			fading ? "Fading:" : "Constant:",
+			separate_sec * 1e6, 100.0 * separate_sec / frame_sec,
+			cascade_sec * 1e6, 100.0 * cascade_sec / frame_sec,
+			separate_sec / cascade_sec, max_err);
+	}
+}
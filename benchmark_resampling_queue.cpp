@@ -0,0 +1,112 @@
+// Microbenchmark of the sample buffer in ResamplingQueue. Runs the same
+// per-frame access pattern (append one frame of input, then pull it out
+// again in chunks, the way get_output_samples() feeds the resampler)
+// through both the old std::deque<float> buffer and the new RingBuffer,
+// and then times ResamplingQueue itself as a whole. Prints the per-frame
+// cost for each.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <vector>
+
+#include "defs.h"
+#include "resampling_queue.h"
+#include "ring_buffer.h"
+
+#define NUM_WARMUP_FRAMES 100
+#define NUM_BENCHMARK_FRAMES 10000
+#define NUM_SAMPLES 800  // One frame at 60 fps.
+
+using namespace std;
+using namespace std::chrono;
+
+namespace {
+
+// The chunk size that get_output_samples() uses for feeding the resampler.
+constexpr size_t inbuf_floats = 1024;
+
+// Keep the compiler from optimizing away the copies.
+float sink = 0.0f;
+
+// The buffer handling of the old ResamplingQueue.
+void deque_frame(deque<float> *buffer, const float *samples, size_t num_floats)
+{
+	buffer->insert(buffer->end(), samples, samples + num_floats);
+
+	float inbuf[inbuf_floats];
+	while (!buffer->empty()) {
+		size_t n = min(inbuf_floats, buffer->size());
+		copy(buffer->begin(), buffer->begin() + n, inbuf);
+		sink += inbuf[0];
+		buffer->erase(buffer->begin(), buffer->begin() + n);
+	}
+}
+
+void ring_frame(RingBuffer<float> *buffer, const float *samples, size_t num_floats)
+{
+	buffer->write(samples, num_floats);
+
+	float inbuf[inbuf_floats];
+	while (!buffer->empty()) {
+		size_t n = buffer->read(inbuf, inbuf_floats);
+		sink += inbuf[n - 1];
+	}
+}
+
+template<class Func>
+double time_per_frame(Func &&func)
+{
+	steady_clock::time_point start;
+	for (unsigned i = 0; i < NUM_WARMUP_FRAMES + NUM_BENCHMARK_FRAMES; ++i) {
+		if (i == NUM_WARMUP_FRAMES) {
+			start = steady_clock::now();
+		}
+		func(i);
+	}
+	steady_clock::time_point end = steady_clock::now();
+	return duration<double>(end - start).count() / NUM_BENCHMARK_FRAMES;
+}
+
+void benchmark_channels(unsigned num_channels)
+{
+	const size_t num_floats = NUM_SAMPLES * num_channels;
+	vector<float> samples(num_floats);
+	for (size_t i = 0; i < num_floats; ++i) {
+		samples[i] = (i % 97) * (1.0f / 97.0f) - 0.5f;
+	}
+
+	deque<float> dq;
+	double deque_sec = time_per_frame([&](unsigned) {
+		deque_frame(&dq, samples.data(), num_floats);
+	});
+
+	RingBuffer<float> ring(num_floats * 4);
+	double ring_sec = time_per_frame([&](unsigned) {
+		ring_frame(&ring, samples.data(), num_floats);
+	});
+
+	ResamplingQueue queue(/*card_num=*/0, OUTPUT_FREQUENCY, OUTPUT_FREQUENCY, num_channels, /*expected_delay_seconds=*/0.1);
+	vector<float> output(num_floats);
+	const steady_clock::time_point base = steady_clock::now();
+	double queue_sec = time_per_frame([&](unsigned frame_num) {
+		steady_clock::time_point ts = base + microseconds(frame_num * 1000000ll * NUM_SAMPLES / OUTPUT_FREQUENCY);
+		queue.add_input_samples(ts, samples.data(), NUM_SAMPLES, ResamplingQueue::ADJUST_RATE);
+		queue.get_output_samples(ts, output.data(), NUM_SAMPLES, ResamplingQueue::ADJUST_RATE);
+	});
+
+	printf("%2u channels:  deque buffer %7.2f us/frame,  ring buffer %7.2f us/frame (%5.1fx),  full ResamplingQueue %7.2f us/frame\n",
+		num_channels, deque_sec * 1e6, ring_sec * 1e6, deque_sec / ring_sec, queue_sec * 1e6);
+}
+
+}  // namespace
+
+int main(int argc, char **argv)
+{
+	for (unsigned num_channels : { 2, 8, 16 }) {
+		benchmark_channels(num_channels);
+	}
+	fprintf(stderr, "(ignore: %f)\n", sink);
+}
@@ -18,7 +18,6 @@
 
 #include "correlation_measurer.h"
 
-#include <assert.h>
 #include <cmath>
 #include <cstddef>
 
@@ -37,21 +36,19 @@ void CorrelationMeasurer::reset()
 	zl = zr = zll = zlr = zrr = 0.0f;
 }
 
-void CorrelationMeasurer::process_samples(const std::vector<float> &samples)
+void CorrelationMeasurer::process_samples(const float *left, const float *right, size_t num_samples)
 {
-	assert(samples.size() % 2 == 0);
-
 	// The compiler isn't always happy about modifying members,
-	// since it doesn't always know they can't alias on <samples>.
+	// since it doesn't always know they can't alias on <left> and <right>.
 	// Help it out a bit.
 	float l = zl, r = zr, ll = zll, lr = zlr, rr = zrr;
 	const float w1c = w1, w2c = w2;
 
-	for (size_t i = 0; i < samples.size(); i += 2) {
+	for (size_t i = 0; i < num_samples; ++i) {
 		// The 1e-15f epsilon is to avoid denormals.
 		// TODO: Just set the SSE flush-to-zero flags instead.
-		l += w1c * (samples[i + 0] - l) + 1e-15f;
-		r += w1c * (samples[i + 1] - r) + 1e-15f;
+		l += w1c * (left[i] - l) + 1e-15f;
+		r += w1c * (right[i] - r) + 1e-15f;
 		lr += w2c * (l * r - lr);
 		ll += w2c * (l * l - ll);
 		rr += w2c * (r * r - rr);
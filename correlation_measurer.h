@@ -31,13 +31,13 @@
 //  You should have received a copy of the GNU General Public License
 //  along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
-#include <vector>
+#include <stddef.h>
 
 class CorrelationMeasurer {
 public:
 	CorrelationMeasurer(unsigned sample_rate, float lowpass_cutoff_hz = 1000.0f,
 	                    float falloff_seconds = 0.150f);
-	void process_samples(const std::vector<float> &samples);  // Taken to be stereo, interleaved.
+	void process_samples(const float *left, const float *right, size_t num_samples);
 	void reset();
 	float get_correlation() const;
 
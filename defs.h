@@ -14,7 +14,7 @@
 #define MAX_FPS 60
 #define FAKE_FPS 25  // Must be an integer.
 #define MAX_VIDEO_CARDS 16
-#define MAX_ALSA_CARDS 16
+#define MAX_ALSA_CARDS 64
 #define MAX_BUSES 256  // Audio buses.
 
 // For deinterlacing. See also comments on InputState.
@@ -49,6 +49,10 @@
 // (frame threading, lookahead, etc.).
 #define X264_QUEUE_LENGTH 50
 
+// In number of calls to AudioEncoderService::encode_audio() (normally one
+// per output frame), per rendition.
+#define AUDIO_ENCODER_QUEUE_LENGTH 50
+
 #define X264_DEFAULT_PRESET "ultrafast"
 #define X264_DEFAULT_TUNE "film"
 
@@ -15,7 +15,9 @@
  * of jitter can make it hard for the algorithm to find the right level of
  * conservatism.
  *
- * This is not meant to be production-quality code.
+ * This is not meant to be production-quality code. To measure the
+ * queue-dropping code that is actually in Nageru on the same kind of log,
+ * use replay_frame_log (or “make queue-policy-regression”) instead.
  */
 
 #include <assert.h>
@@ -468,11 +470,85 @@ public:
 	}
 };
 
-void test_jitter_history(const vector<Event> &events, size_t history_length, double multiplier, double percentile, double margin)
+// Same order statistics as HistoryJitter, but from a histogram with
+// logarithmically spaced buckets instead of the actual values; this is what
+// JitterHistory in mixer.h does. Each value is estimated by the upper edge
+// of its bucket, so the result is never lower than HistoryJitter's, and at most
+// (bucket_growth - 1) higher (except below min_jitter_seconds).
+class HistogramJitter {
+	static constexpr double min_jitter_seconds = 1e-6;
+	static constexpr double bucket_growth = 1.01;
+	static constexpr size_t num_buckets = 1700;
+
+	const size_t history_length;
+	const double multiplier, percentile;
+	double expected_timestamp = 0.0;
+	double max_jitter_seconds = 0.0;
+
+	deque<size_t> history;  // Bucket indexes.
+	vector<size_t> bucket_counts = vector<size_t>(num_buckets, 0);
+
+	static size_t find_bucket(double jitter_seconds)
+	{
+		if (!(jitter_seconds >= min_jitter_seconds)) {
+			return 0;
+		}
+		size_t bucket = floor(log(jitter_seconds / min_jitter_seconds) / log(bucket_growth));
+		return min<size_t>(bucket, num_buckets - 1);
+	}
+
+	double elem_at(size_t elem_idx)
+	{
+		size_t bucket = 0;
+		for (size_t seen = bucket_counts[0]; seen <= elem_idx; seen += bucket_counts[bucket]) {
+			++bucket;
+		}
+		return min_jitter_seconds * pow(bucket_growth, bucket + 1);
+	}
+
+public:
+	HistogramJitter(size_t history_length, double multiplier, double percentile)
+		: history_length(history_length), multiplier(multiplier), percentile(percentile) {}
+
+	void update(double timestamp, double frame_duration, size_t dropped_frames)
+	{
+		if (expected_timestamp >= 0.0) {
+			expected_timestamp += dropped_frames * frame_duration;
+			double jitter_seconds = fabs(expected_timestamp - timestamp);
+
+			size_t bucket = find_bucket(jitter_seconds);
+			history.push_back(bucket);
+			++bucket_counts[bucket];
+			while (history.size() > history_length) {
+				--bucket_counts[history.front()];
+				history.pop_front();
+			}
+
+			size_t elem_idx = lrint(percentile * (history.size() - 1));
+
+			// Cap at 100 ms.
+			max_jitter_seconds = min(elem_at(elem_idx), 0.1);
+		}
+		expected_timestamp = timestamp + frame_duration;
+	}
+
+	double get_expected() const
+	{
+		return expected_timestamp;
+	}
+
+	double get_jitter() const
+	{
+		return max_jitter_seconds * multiplier;
+	}
+};
+
+template<class JitterEstimator>
+void test_jitter_history(const vector<Event> &events, const char *estimator_name, size_t history_length, double multiplier, double percentile, double margin)
 {
 	Queue q;
-	HistoryJitter input_jitter(history_length, multiplier, percentile);
-	HistoryJitter output_jitter(history_length, multiplier, percentile);
+	JitterEstimator input_jitter(history_length, multiplier, percentile);
+	JitterEstimator output_jitter(history_length, multiplier, percentile);
 	
 	for (const Event &event : events) {
 		if (event.direction == Event::IN) {
@@ -496,7 +572,7 @@ void test_jitter_history(const vector<Event> &events, size_t history_length, dou
 		if (q.should_abort()) return;
 	}
 	char name[256];
-	snprintf(name, sizeof(name), "history[len=%lu,mul=%.1f,pct=%.4f,margin=%.1f]", history_length, multiplier, percentile, 1e3 * margin);
+	snprintf(name, sizeof(name), "%s[len=%lu,mul=%.1f,pct=%.4f,margin=%.1f]", estimator_name, history_length, multiplier, percentile, 1e3 * margin);
 	q.eval(name);
 }
 
@@ -580,9 +656,14 @@ int main(int argc, char **argv)
 
 				//for (double margin_ms : { -1.0, 0.0, 1.0, 2.0, 5.0, 10.0, 20.0 }) {
 				for (double margin_ms : { 0.0 }) {
-					test_jitter_history(events, history_samples, multiplier, percentile, 1e-3 * margin_ms);
+					test_jitter_history<HistoryJitter>(events, "history", history_samples, multiplier, percentile, 1e-3 * margin_ms);
 				}
 			}
 		}
 	}
+
+	// The parameters used in Nageru (see JitterHistory in mixer.h), with both
+	// the exact order statistics and the histogram approximation actually used.
+	test_jitter_history<HistoryJitter>(events, "history", 5000, 2.0, 0.999, 0.0);
+	test_jitter_history<HistogramJitter>(events, "histogram", 5000, 2.0, 0.999, 0.0);
 }
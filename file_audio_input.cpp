@@ -0,0 +1,304 @@
+#include "file_audio_input.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <random>
+
+#include "alsa_pool.h"
+#include "bmusb/bmusb.h"
+#include "timebase.h"
+
+using namespace std;
+using namespace std::chrono;
+
+namespace {
+
+uint16_t read_le16(const uint8_t *ptr)
+{
+	return ptr[0] | (ptr[1] << 8);
+}
+
+uint32_t read_le32(const uint8_t *ptr)
+{
+	return ptr[0] | (ptr[1] << 8) | (ptr[2] << 16) | (uint32_t(ptr[3]) << 24);
+}
+
+enum class HeaderResult {
+	WAV,
+	NOT_WAV,
+	ERROR
+};
+
+// If <fp> is at the start of a WAV file, parses its header and leaves
+// <fp> at the start of the sample data. If not, rewinds <fp>.
+HeaderResult read_wav_header(FILE *fp, const char *filename, FileAudioInput::Params *params, uint32_t *data_size)
+{
+	uint8_t header[12];
+	if (fread(header, sizeof(header), 1, fp) != 1 ||
+	    memcmp(header, "RIFF", 4) != 0 ||
+	    memcmp(header + 8, "WAVE", 4) != 0) {
+		rewind(fp);
+		return HeaderResult::NOT_WAV;
+	}
+
+	bool seen_fmt = false;
+	for ( ;; ) {
+		uint8_t chunk_header[8];
+		if (fread(chunk_header, sizeof(chunk_header), 1, fp) != 1) {
+			fprintf(stderr, "%s: No data chunk found in WAV file\n", filename);
+			return HeaderResult::ERROR;
+		}
+		const uint32_t chunk_size = read_le32(chunk_header + 4);
+		if (memcmp(chunk_header, "data", 4) == 0) {
+			if (!seen_fmt) {
+				fprintf(stderr, "%s: Data chunk before format chunk in WAV file\n", filename);
+				return HeaderResult::ERROR;
+			}
+			*data_size = chunk_size;
+			return HeaderResult::WAV;
+		}
+
+		uint32_t bytes_to_skip = chunk_size + (chunk_size & 1);
+		if (memcmp(chunk_header, "fmt ", 4) == 0) {
+			uint8_t fmt[40];
+			const uint32_t fmt_size = min<uint32_t>(chunk_size, sizeof(fmt));
+			if (fmt_size < 16 || fread(fmt, fmt_size, 1, fp) != 1) {
+				fprintf(stderr, "%s: Short format chunk in WAV file\n", filename);
+				return HeaderResult::ERROR;
+			}
+			bytes_to_skip -= fmt_size;
+
+			unsigned format = read_le16(fmt);
+			if (format == 0xfffe && fmt_size >= 26) {
+				// WAVE_FORMAT_EXTENSIBLE; the real format is in the start of the subformat GUID.
+				format = read_le16(fmt + 24);
+			}
+			if (format != 1) {
+				fprintf(stderr, "%s: Unsupported WAV format %u (only integer PCM is supported)\n", filename, format);
+				return HeaderResult::ERROR;
+			}
+			params->num_channels = read_le16(fmt + 2);
+			params->sample_rate = read_le32(fmt + 4);
+			params->bits_per_sample = read_le16(fmt + 14);
+			seen_fmt = true;
+		}
+		if (fseek(fp, bytes_to_skip, SEEK_CUR) != 0) {
+			perror(filename);
+			return HeaderResult::ERROR;
+		}
+	}
+}
+
+bool check_params(const FileAudioInput::Params &params)
+{
+	const char *filename = params.filename.c_str();
+	if (params.bits_per_sample != 16 && params.bits_per_sample != 24 && params.bits_per_sample != 32) {
+		fprintf(stderr, "%s: Unsupported bits per sample %u (must be 16, 24 or 32)\n", filename, params.bits_per_sample);
+		return false;
+	}
+	if (params.num_channels == 0 || params.sample_rate == 0 || params.period_size == 0) {
+		fprintf(stderr, "%s: Channels, sample rate and period size must be at least 1\n", filename);
+		return false;
+	}
+	if (params.drift_ppm <= -1e6 || params.jitter_ms < 0.0) {
+		fprintf(stderr, "%s: drift_ppm must be above -1000000, and jitter_ms cannot be negative\n", filename);
+		return false;
+	}
+	return true;
+}
+
+}  // namespace
+
+bool FileAudioInput::parse_spec(const string &spec, Params *params)
+{
+	size_t pos = spec.find(',');
+	params->filename = spec.substr(0, pos);
+	if (params->filename.empty()) {
+		fprintf(stderr, "%s: Missing filename\n", spec.c_str());
+		return false;
+	}
+	while (pos != string::npos) {
+		const size_t start = pos + 1;
+		pos = spec.find(',', start);
+		const string option = spec.substr(start, pos == string::npos ? string::npos : pos - start);
+		const size_t eq = option.find('=');
+		if (eq == string::npos) {
+			fprintf(stderr, "%s: Option '%s' is not of the form key=value\n", spec.c_str(), option.c_str());
+			return false;
+		}
+		const string key = option.substr(0, eq);
+		const char *value = option.c_str() + eq + 1;
+		if (key == "rate") {
+			params->sample_rate = atoi(value);
+		} else if (key == "channels") {
+			params->num_channels = atoi(value);
+		} else if (key == "bits") {
+			params->bits_per_sample = atoi(value);
+		} else if (key == "period") {
+			params->period_size = atoi(value);
+		} else if (key == "drift_ppm") {
+			params->drift_ppm = atof(value);
+		} else if (key == "jitter_ms") {
+			params->jitter_ms = atof(value);
+		} else if (key == "seed") {
+			params->seed = atoi(value);
+		} else {
+			fprintf(stderr, "%s: Unknown option '%s'\n", spec.c_str(), key.c_str());
+			return false;
+		}
+	}
+	return check_params(*params);
+}
+
+bool FileAudioInput::probe(Params *params)
+{
+	FILE *fp = fopen(params->filename.c_str(), "rb");
+	if (fp == nullptr) {
+		perror(params->filename.c_str());
+		return false;
+	}
+	uint32_t data_size;
+	HeaderResult result = read_wav_header(fp, params->filename.c_str(), params, &data_size);
+	fclose(fp);
+	return result != HeaderResult::ERROR && check_params(*params);
+}
+
+FileAudioInput::FileAudioInput(const Params &params, audio_callback_t audio_callback, ALSAPool *parent_pool, unsigned internal_dev_index)
+	: params(params),
+	  audio_callback(audio_callback),
+	  parent_pool(parent_pool),
+	  internal_dev_index(internal_dev_index)
+{
+	audio_format.num_channels = params.num_channels;
+	audio_format.bits_per_sample = params.bits_per_sample;
+	audio_format.sample_rate = params.sample_rate;
+	buffer.reset(new uint8_t[params.period_size * params.num_channels * params.bits_per_sample / 8]);
+}
+
+FileAudioInput::~FileAudioInput()
+{
+}
+
+void FileAudioInput::start_capture_thread()
+{
+	should_quit.unquit();
+	capture_thread = thread(&FileAudioInput::capture_thread_func, this);
+}
+
+void FileAudioInput::stop_capture_thread()
+{
+	should_quit.quit();
+	capture_thread.join();
+}
+
+bool FileAudioInput::read_samples(const Params &params, vector<uint8_t> *samples)
+{
+	const char *filename = params.filename.c_str();
+	FILE *fp = fopen(filename, "rb");
+	if (fp == nullptr) {
+		perror(filename);
+		return false;
+	}
+
+	// The file could have changed since we probed it, so check the header again.
+	Params file_params = params;
+	uint32_t data_size = UINT32_MAX;
+	if (read_wav_header(fp, filename, &file_params, &data_size) == HeaderResult::ERROR) {
+		fclose(fp);
+		return false;
+	}
+	if (file_params.sample_rate != params.sample_rate ||
+	    file_params.num_channels != params.num_channels ||
+	    file_params.bits_per_sample != params.bits_per_sample) {
+		fprintf(stderr, "%s: Format changed since the file was added\n", filename);
+		fclose(fp);
+		return false;
+	}
+
+	// Read until the end of the data chunk (or the file, if the size
+	// is bogus, as it is e.g. when streaming WAV from a pipe).
+	samples->clear();
+	uint8_t buf[65536];
+	while (samples->size() < data_size) {
+		size_t ret = fread(buf, 1, min<size_t>(sizeof(buf), data_size - samples->size()), fp);
+		if (ret == 0) {
+			break;
+		}
+		samples->insert(samples->end(), buf, buf + ret);
+	}
+	if (ferror(fp)) {
+		perror(filename);
+		fclose(fp);
+		return false;
+	}
+	fclose(fp);
+
+	const size_t bytes_per_frame = params.num_channels * params.bits_per_sample / 8;
+	samples->resize(samples->size() - samples->size() % bytes_per_frame);
+	if (samples->empty()) {
+		fprintf(stderr, "%s: No audio in file\n", filename);
+		return false;
+	}
+	return true;
+}
+
+void FileAudioInput::capture_thread_func()
+{
+	parent_pool->set_card_state(internal_dev_index, ALSAPool::Device::State::STARTING);
+	if (!read_samples(params, &samples)) {
+		// Like an unplugged card; there's no point in retrying.
+		parent_pool->free_card(internal_dev_index);
+		return;
+	}
+	parent_pool->set_card_state(internal_dev_index, ALSAPool::Device::State::RUNNING);
+
+	const size_t bytes_per_frame = params.num_channels * params.bits_per_sample / 8;
+	const size_t file_frames = samples.size() / bytes_per_frame;
+
+	// The rate we actually deliver frames at. Note that audio_format
+	// (and the pts) still say the nominal rate, just like a real card would.
+	const double actual_rate = params.sample_rate * (1.0 + params.drift_ppm * 1e-6);
+	mt19937 rng(params.seed);
+	uniform_real_distribution<double> jitter_dist(0.0, params.jitter_ms * 1e-3);
+
+	const steady_clock::time_point start = steady_clock::now();
+	uint64_t num_frames_output = 0;
+	size_t file_pos = 0;  // In frames.
+	while (!should_quit.should_quit()) {
+		// Wait until the period would be done on the card, plus any jitter.
+		const double period_end = (num_frames_output + params.period_size) / actual_rate;
+		const double jitter = (params.jitter_ms > 0.0) ? jitter_dist(rng) : 0.0;
+		if (!should_quit.sleep_until(start + duration_cast<steady_clock::duration>(duration<double>(period_end + jitter)))) {
+			continue;
+		}
+
+		// Copy out the period, looping the file as needed.
+		for (size_t frames_copied = 0; frames_copied < params.period_size; ) {
+			const size_t frames = min<size_t>(params.period_size - frames_copied, file_frames - file_pos);
+			memcpy(buffer.get() + frames_copied * bytes_per_frame, &samples[file_pos * bytes_per_frame], frames * bytes_per_frame);
+			frames_copied += frames;
+			file_pos = (file_pos + frames) % file_frames;
+		}
+
+		const int64_t prev_pts = frames_to_pts(num_frames_output);
+		const int64_t pts = frames_to_pts(num_frames_output + params.period_size);
+		const steady_clock::time_point now = steady_clock::now();
+		for ( ;; ) {
+			if (should_quit.should_quit()) return;
+			if (audio_callback(buffer.get(), params.period_size, audio_format, pts - prev_pts, now)) {
+				break;
+			}
+			// The mixer is not keeping up; give it about a period
+			// before trying again, instead of spinning.
+			should_quit.sleep_for(duration<double>(double(pts - prev_pts) / TIMEBASE));
+		}
+		num_frames_output += params.period_size;
+	}
+}
+
+int64_t FileAudioInput::frames_to_pts(uint64_t n) const
+{
+	return (n * TIMEBASE) / params.sample_rate;
+}
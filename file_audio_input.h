@@ -0,0 +1,88 @@
+#ifndef _FILE_AUDIO_INPUT_H
+#define _FILE_AUDIO_INPUT_H 1
+
+// A stand-in for a sound card, for testing and benchmarking the ALSA input
+// path (ALSAPool, AudioMixer and ResamplingQueue) without any real hardware.
+// It plays back a WAV file (or raw interleaved PCM) in a loop, sending one
+// period at a time to the callback, exactly the way ALSAInput would.
+//
+// Like a real card, its clock need not match ours: It can be set to run
+// <drift_ppm> fast (or slow, if negative), while still claiming to be running
+// at the nominal sample rate. Each period can also be delivered up to
+// <jitter_ms> late (at random, but with a fixed seed, so that runs are
+// repeatable), like interrupt latency; the lateness does not accumulate.
+//
+// These are registered with ALSAPool (see ALSAPool::add_file_device()),
+// and show up there like any other hotplugged sound card.
+
+#include <stdint.h>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "audio_input_backend.h"
+#include "bmusb/bmusb.h"
+#include "quittable_sleeper.h"
+
+class ALSAPool;
+
+class FileAudioInput : public AudioInputBackend {
+public:
+	struct Params {
+		std::string filename;
+
+		// For raw files only; WAV files have these in the header.
+		unsigned sample_rate = 48000;
+		unsigned num_channels = 2;
+		unsigned bits_per_sample = 16;  // 16, 24 or 32; little-endian.
+
+		unsigned period_size = 256;  // In frames.
+		double drift_ppm = 0.0;
+		double jitter_ms = 0.0;
+		unsigned seed = 1;  // For the jitter.
+	};
+
+	// Parses a specification of the form FILE[,key=value...], where the keys
+	// are rate, channels, bits, period, drift_ppm, jitter_ms and seed.
+	// On error, prints a message and returns false.
+	static bool parse_spec(const std::string &spec, Params *params);
+
+	// Reads the header of the given file, if it is a WAV file, and fills in
+	// sample_rate, num_channels and bits_per_sample from it. Returns false
+	// (after printing a message) if the file could not be read or is in
+	// a format we do not understand.
+	static bool probe(Params *params);
+
+	// Reads all the samples (in the file's own format, minus any header)
+	// into <samples>, rounded down to a whole number of frames. Returns false
+	// (after printing a message) on error, or if there is no audio at all.
+	static bool read_samples(const Params &params, std::vector<uint8_t> *samples);
+
+	FileAudioInput(const Params &params, audio_callback_t audio_callback, ALSAPool *parent_pool, unsigned internal_dev_index);
+	~FileAudioInput() override;
+
+	unsigned get_sample_rate() const override { return params.sample_rate; }
+
+	void start_capture_thread() override;
+	void stop_capture_thread() override;
+
+private:
+	void capture_thread_func();
+	int64_t frames_to_pts(uint64_t n) const;
+
+	const Params params;
+	bmusb::AudioFormat audio_format;
+	audio_callback_t audio_callback;
+
+	std::vector<uint8_t> samples;  // The entire file, minus any header. Only touched by the capture thread.
+	std::unique_ptr<uint8_t[]> buffer;  // One period.
+
+	std::thread capture_thread;
+	QuittableSleeper should_quit;
+	ALSAPool *parent_pool;
+	unsigned internal_dev_index;
+};
+
+#endif  // !defined(_FILE_AUDIO_INPUT_H)
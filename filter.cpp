@@ -351,6 +351,267 @@ void StereoFilter::render(float *inout_left_ptr, unsigned n_samples, float cutof
 #endif
 }
 
+EQCoefficientTable::EQCoefficientTable(FilterType type, int order, float cutoff, float resonance)
+{
+	assert(type == FILTER_PEAKING_EQ || type == FILTER_LOW_SHELF || type == FILTER_HIGH_SHELF);
+
+	Filter filter;
+	filter.init(type, order);
+	filter.set_linear_cutoff(cutoff);
+	filter.set_resonance(resonance);
+	for (unsigned i = 0; i < 2 * steps_per_unit + 1; ++i) {
+		filter.set_dbgain_normalized(float(int(i) - int(steps_per_unit)) / steps_per_unit);
+		filter.update();
+		table[i] = filter.get_coefficients();
+	}
+}
+
+BiquadCoefficients EQCoefficientTable::lookup(float dbgain_normalized) const
+{
+	const float pos = (max(min(dbgain_normalized, 1.0f), -1.0f) + 1.0f) * steps_per_unit;
+	const unsigned idx = min<unsigned>(unsigned(pos), 2 * steps_per_unit - 1);
+	const float t = pos - idx;
+
+	const BiquadCoefficients &c0 = table[idx], &c1 = table[idx + 1];
+	return BiquadCoefficients{
+		c0.b0 + (c1.b0 - c0.b0) * t,
+		c0.b1 + (c1.b1 - c0.b1) * t,
+		c0.b2 + (c1.b2 - c0.b2) * t,
+		c0.a1 + (c1.a1 - c0.a1) * t,
+		c0.a2 + (c1.a2 - c0.a2) * t
+	};
+}
+
+void StereoFilterCascade::add(StereoFilter *filter, float cutoff, float resonance, float dbgain_normalized)
+{
+	assert(num_stages < max_filters);
+#ifdef __SSE__
+	Filter *parm_filter = &filter->parm_filter;
+#else
+	Filter *parm_filter = &filter->filters[0];
+#endif
+	if (parm_filter->filtertype == FILTER_NONE || parm_filter->filter_order == 0)
+		return;
+
+	parm_filter->set_linear_cutoff(cutoff);
+	parm_filter->set_resonance(resonance);
+	parm_filter->set_dbgain_normalized(dbgain_normalized);
+	parm_filter->update();
+
+	Stage *stage = &stages[num_stages++];
+	stage->filter = filter;
+	stage->table = nullptr;
+	stage->coeff = parm_filter->get_coefficients();
+	stage->dbgain_normalized = dbgain_normalized;
+	stage->dbgain_inc_per_block = 0.0f;
+}
+
+void StereoFilterCascade::add_fade(StereoFilter *filter, const EQCoefficientTable *table, float dbgain_normalized, float dbgain_inc_per_block)
+{
+	assert(num_stages < max_filters);
+#ifdef __SSE__
+	const Filter *parm_filter = &filter->parm_filter;
+#else
+	const Filter *parm_filter = &filter->filters[0];
+#endif
+	if (parm_filter->filtertype == FILTER_NONE || parm_filter->filter_order == 0)
+		return;
+
+	Stage *stage = &stages[num_stages++];
+	stage->filter = filter;
+	stage->table = table;
+	stage->coeff = table->lookup(dbgain_normalized);
+	stage->dbgain_normalized = dbgain_normalized;
+	stage->dbgain_inc_per_block = dbgain_inc_per_block;
+}
+
+#ifdef __SSE__
+
+namespace {
+
+// One biquad (ie., one order of one filter), for both channels at once.
+struct SIMDSection {
+	__m128 b0, b1, b2, a1, a2;
+	__m128 d0, d1;
+};
+
+void set_section_coefficients(SIMDSection *section, const BiquadCoefficients &coeff)
+{
+	section->b0 = _mm_set1_ps(coeff.b0);
+	section->b1 = _mm_set1_ps(coeff.b1);
+	section->b2 = _mm_set1_ps(coeff.b2);
+	section->a1 = _mm_set1_ps(coeff.a1);
+	section->a2 = _mm_set1_ps(coeff.a2);
+}
+
+// Runs one stereo sample (left and right in the two lowest lanes, zero
+// in the others) through all the sections, with the same arithmetic
+// as StereoFilter::render().
+template<unsigned NumSections>
+inline __m128 run_sections(SIMDSection *s, unsigned num_sections, __m128 in)
+{
+	for (unsigned j = 0; j < num_sections; ++j) {
+		__m128 out = _mm_add_ps(_mm_mul_ps(s[j].b0, in), s[j].d0);
+		s[j].d0 = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(s[j].b1, in), _mm_mul_ps(s[j].a1, out)), s[j].d1);
+		s[j].d1 = _mm_sub_ps(_mm_mul_ps(s[j].b2, in), _mm_mul_ps(s[j].a2, out));
+		in = out;
+	}
+	return in;
+}
+
+// Runs each stereo sample through all the sections before going on to the next.
+// Templated on the number of sections, so that the compiler can keep everything
+// in registers for the common cases; NumSections == 0 means to use
+// <num_sections> instead.
+//
+// The samples are loaded and stored four at a time from each channel, and paired
+// up in registers; the feedback chain runs one sample at a time anyway, so this
+// costs next to nothing.
+template<unsigned NumSections>
+void render_sections(SIMDSection *sections, unsigned num_sections, float *inout_left, float *inout_right, unsigned n_samples)
+{
+	if (NumSections != 0) {
+		num_sections = NumSections;
+	}
+
+	SIMDSection s[NumSections == 0 ? FILTER_MAX_ORDER * StereoFilterCascade::max_filters : NumSections];
+	for (unsigned j = 0; j < num_sections; ++j) {
+		s[j] = sections[j];
+	}
+
+	const __m128 zero = _mm_setzero_ps();
+	unsigned i = 0;
+	for ( ; i + 4 <= n_samples; i += 4) {
+		const __m128 l = _mm_loadu_ps(inout_left + i);
+		const __m128 r = _mm_loadu_ps(inout_right + i);
+		const __m128 lr01 = _mm_unpacklo_ps(l, r);  // L0 R0 L1 R1
+		const __m128 lr23 = _mm_unpackhi_ps(l, r);  // L2 R2 L3 R3
+
+		const __m128 out0 = run_sections<NumSections>(s, num_sections, _mm_movelh_ps(lr01, zero));
+		const __m128 out1 = run_sections<NumSections>(s, num_sections, _mm_movehl_ps(zero, lr01));
+		const __m128 out2 = run_sections<NumSections>(s, num_sections, _mm_movelh_ps(lr23, zero));
+		const __m128 out3 = run_sections<NumSections>(s, num_sections, _mm_movehl_ps(zero, lr23));
+
+		const __m128 out01 = _mm_movelh_ps(out0, out1);
+		const __m128 out23 = _mm_movelh_ps(out2, out3);
+		_mm_storeu_ps(inout_left + i, _mm_shuffle_ps(out01, out23, _MM_SHUFFLE(2, 0, 2, 0)));
+		_mm_storeu_ps(inout_right + i, _mm_shuffle_ps(out01, out23, _MM_SHUFFLE(3, 1, 3, 1)));
+	}
+	for ( ; i < n_samples; ++i) {
+		const __m128 in = _mm_unpacklo_ps(_mm_load_ss(inout_left + i), _mm_load_ss(inout_right + i));
+		const __m128 out = run_sections<NumSections>(s, num_sections, in);
+		_mm_store_ss(inout_left + i, out);
+		_mm_store_ss(inout_right + i, _mm_shuffle_ps(out, out, _MM_SHUFFLE(1, 1, 1, 1)));
+	}
+
+	for (unsigned j = 0; j < num_sections; ++j) {
+		sections[j].d0 = s[j].d0;
+		sections[j].d1 = s[j].d1;
+	}
+}
+
+}  // namespace
+
+void StereoFilterCascade::render(float *inout_left, float *inout_right, unsigned n_samples)
+{
+	if (num_stages == 0)
+		return;
+
+	unsigned old_denormals_mode = _MM_GET_FLUSH_ZERO_MODE();
+	_MM_SET_FLUSH_ZERO_MODE(_MM_FLUSH_ZERO_ON);
+
+	SIMDSection sections[FILTER_MAX_ORDER * max_filters];
+	unsigned num_sections = 0;
+	bool any_fade = false;
+	for (unsigned i = 0; i < num_stages; ++i) {
+		StereoFilter *filter = stages[i].filter;
+		for (unsigned j = 0; j < filter->parm_filter.filter_order; ++j) {
+			set_section_coefficients(&sections[num_sections], stages[i].coeff);
+			sections[num_sections].d0 = filter->feedback[j].d0;
+			sections[num_sections].d1 = filter->feedback[j].d1;
+			++num_sections;
+		}
+		any_fade |= (stages[i].table != nullptr);
+	}
+
+	const unsigned block_size = any_fade ? fade_block_size : n_samples;
+	for (unsigned start = 0; start < n_samples; start += block_size) {
+		if (start != 0) {
+			// New coefficients for the faded filters.
+			unsigned section_idx = 0;
+			for (unsigned i = 0; i < num_stages; ++i) {
+				const unsigned order = stages[i].filter->parm_filter.filter_order;
+				if (stages[i].table != nullptr) {
+					stages[i].dbgain_normalized += stages[i].dbgain_inc_per_block;
+					const BiquadCoefficients coeff = stages[i].table->lookup(stages[i].dbgain_normalized);
+					for (unsigned j = 0; j < order; ++j) {
+						set_section_coefficients(&sections[section_idx + j], coeff);
+					}
+				}
+				section_idx += order;
+			}
+		}
+
+		float *left = inout_left + start;
+		float *right = inout_right + start;
+		const unsigned samples_this_block = min(n_samples - start, block_size);
+		switch (num_sections) {
+		case 1:
+			render_sections<1>(sections, num_sections, left, right, samples_this_block);
+			break;
+		case 2:
+			render_sections<2>(sections, num_sections, left, right, samples_this_block);
+			break;
+		case 3:
+			render_sections<3>(sections, num_sections, left, right, samples_this_block);
+			break;
+		case 4:
+			render_sections<4>(sections, num_sections, left, right, samples_this_block);
+			break;
+		default:
+			render_sections<0>(sections, num_sections, left, right, samples_this_block);
+			break;
+		}
+	}
+
+	unsigned section_idx = 0;
+	for (unsigned i = 0; i < num_stages; ++i) {
+		StereoFilter *filter = stages[i].filter;
+		for (unsigned j = 0; j < filter->parm_filter.filter_order; ++j) {
+			filter->feedback[j].d0 = sections[section_idx].d0;
+			filter->feedback[j].d1 = sections[section_idx].d1;
+			++section_idx;
+		}
+	}
+
+	_MM_SET_FLUSH_ZERO_MODE(old_denormals_mode);
+}
+
+#else  // !defined(__SSE__)
+
+void StereoFilterCascade::render(float *inout_left, float *inout_right, unsigned n_samples)
+{
+	// No SIMD, so just run the filters one after the other.
+	for (unsigned i = 0; i < num_stages; ++i) {
+		Stage *stage = &stages[i];
+		const unsigned block_size = (stage->table != nullptr) ? fade_block_size : n_samples;
+		for (unsigned start = 0; start < n_samples; start += block_size) {
+			if (start != 0) {
+				stage->dbgain_normalized += stage->dbgain_inc_per_block;
+				stage->coeff = stage->table->lookup(stage->dbgain_normalized);
+			}
+			const unsigned samples_this_block = min(n_samples - start, block_size);
+			float *channels[] = { inout_left + start, inout_right + start };
+			for (unsigned channel = 0; channel < 2; ++channel) {
+				stage->filter->filters[channel].set_coefficients(stage->coeff);
+				stage->filter->filters[channel].render_chunk(channels[channel], samples_this_block);
+			}
+		}
+	}
+}
+
+#endif  // !defined(__SSE__)
+
 /*
 
   Find the transfer function for an IIR biquad. This is relatively basic signal
@@ -34,10 +34,16 @@ enum FilterType
 
 #define FILTER_MAX_ORDER 4
 
+// Biquad coefficients, normalized so that a0 = 1.
+struct BiquadCoefficients {
+	float b0, b1, b2, a1, a2;
+};
+
 class Filter  
 {
 	friend class StereoFilter;
 	friend class SplittingStereoFilter;
+	friend class StereoFilterCascade;
 public:
 	Filter();
 	
@@ -73,6 +79,22 @@ public:
 		A = pow(10.0f, db_gain_div_40);
 	}
 
+	// As calculated by the last update().
+	BiquadCoefficients get_coefficients() const
+	{
+		return BiquadCoefficients{ b0, b1, b2, a1, a2 };
+	}
+
+	// Overridden by the next update().
+	void set_coefficients(const BiquadCoefficients &coeff)
+	{
+		b0 = coeff.b0;
+		b1 = coeff.b1;
+		b2 = coeff.b2;
+		a1 = coeff.a1;
+		a2 = coeff.a2;
+	}
+
 #ifdef __SSE__
 	// We don't need the stride argument for SSE, as StereoFilter
 	// has its own SSE implementations.
@@ -106,6 +128,7 @@ private:
 
 class StereoFilter
 {
+	friend class StereoFilterCascade;
 public:
 	void init(FilterType type, int new_order);
 	
@@ -136,4 +159,64 @@ private:
 #endif
 };
 
+// Precomputed coefficients for an EQ filter (peaking or shelving) of a given
+// order, cutoff and resonance, for all gains from -40 to +40 dB (ie.,
+// db_gain / 40 from -1 to 1; anything outside is clamped). Gains in-between
+// the table entries are interpolated linearly, which is very close to exact
+// at this resolution, and much cheaper than going through update() with its
+// sin(), cos() and pow(). This makes it feasible to change the gain often,
+// e.g. during fades.
+class EQCoefficientTable
+{
+public:
+	EQCoefficientTable(FilterType type, int order, float cutoff, float resonance);
+
+	BiquadCoefficients lookup(float dbgain_normalized) const;
+
+private:
+	static constexpr unsigned steps_per_unit = 80;  // 0.5 dB.
+	BiquadCoefficients table[2 * steps_per_unit + 1];
+};
+
+// Runs a chain of StereoFilters over the same stereo buffer in a single pass,
+// instead of one pass per filter (and per order), which lets the CPU overlap
+// the different filters' feedback chains. Each filter keeps its own state,
+// so filters can come and go from the cascade from one call to the next.
+// For filters with constant coefficients, the result is exactly the same
+// as calling render() on each filter in turn.
+//
+// The cascade itself only lives for one render() call; set it up anew
+// for each buffer.
+class StereoFilterCascade
+{
+public:
+	static constexpr unsigned max_filters = 4;
+
+	// How often faded filters get new coefficients.
+	static constexpr unsigned fade_block_size = 32;
+
+	// Adds a filter with constant coefficients (calculated right away).
+	void add(StereoFilter *filter, float cutoff, float resonance, float dbgain_normalized = 0.0f);
+
+	// Adds an EQ filter whose gain changes during the buffer; the first
+	// <fade_block_size> samples get the gain <dbgain_normalized>, the next
+	// get <dbgain_normalized> + <dbgain_inc_per_block>, and so on.
+	// <table> must match the filter's type and order (and the desired cutoff
+	// and resonance).
+	void add_fade(StereoFilter *filter, const EQCoefficientTable *table, float dbgain_normalized, float dbgain_inc_per_block);
+
+	// Unlike StereoFilter::render(), takes the two channels in separate buffers.
+	void render(float *inout_left, float *inout_right, unsigned n_samples);
+
+private:
+	struct Stage {
+		StereoFilter *filter;
+		const EQCoefficientTable *table;  // nullptr if constant.
+		BiquadCoefficients coeff;
+		float dbgain_normalized, dbgain_inc_per_block;
+	};
+	Stage stages[max_filters];
+	unsigned num_stages = 0;
+};
+
 #endif // !defined(_FILTER_H)
@@ -48,10 +48,18 @@ enum LongOption {
 	OPTION_DISABLE_MAKEUP_GAIN_AUTO,
 	OPTION_ENABLE_MAKEUP_GAIN_AUTO,
 	OPTION_DISABLE_ALSA_OUTPUT,
+	OPTION_ALSA_MMAP_CAPTURE,
+	OPTION_FILE_AUDIO_INPUT,
+	OPTION_AUDIO_RENDITION,
 	OPTION_NO_FLUSH_PBOS,
+	OPTION_GL_UPLOAD_THREAD,
 	OPTION_PRINT_VIDEO_LATENCY,
 	OPTION_MAX_INPUT_QUEUE_FRAMES,
 	OPTION_AUDIO_QUEUE_LENGTH_MS,
+	OPTION_AUDIO_BUS_THREADS,
+	OPTION_AUDIO_RESAMPLING_THREADS,
+	OPTION_NO_AUDIO_METERING_THREAD,
+	OPTION_AUDIO_TRUE_PEAK_OVERSAMPLING,
 	OPTION_OUTPUT_YCBCR_COEFFICIENTS,
 	OPTION_OUTPUT_BUFFER_FRAMES,
 	OPTION_OUTPUT_SLOP_FRAMES,
@@ -129,13 +137,37 @@ void usage(Program program)
 		fprintf(stderr, "      --disable-limiter           turn off limiter (also --enable)\n");
 		fprintf(stderr, "      --disable-makeup-gain-auto  turn off auto-adjustment of final makeup gain (also --enable)\n");
 		fprintf(stderr, "      --disable-alsa-output       disable audio monitoring via ALSA\n");
+		fprintf(stderr, "      --alsa-mmap-capture         read ALSA inputs directly from the sound card's buffer\n");
+		fprintf(stderr, "                                    (saves a copy; falls back to normal reads if\n");
+		fprintf(stderr, "                                    the device does not support it)\n");
+		fprintf(stderr, "      --file-audio-input=FILE[,KEY=VALUE...]  add a WAV or raw file as a virtual\n");
+		fprintf(stderr, "                                    sound card, looping forever (can be given multiple\n");
+		fprintf(stderr, "                                    times); keys are rate, channels, bits (for raw files),\n");
+		fprintf(stderr, "                                    period (in frames), drift_ppm, jitter_ms and seed\n");
+		fprintf(stderr, "      --audio-rendition=FILE,codec=NAME[,bitrate=KBITS]  also encode the mixed audio\n");
+		fprintf(stderr, "                                    with the given codec, on its own thread, into an\n");
+		fprintf(stderr, "                                    audio-only file (mux guessed from the file name;\n");
+		fprintf(stderr, "                                    can be given multiple times)\n");
 		fprintf(stderr, "      --no-flush-pbos             do not explicitly signal texture data uploads\n");
 		fprintf(stderr, "                                    (will give display corruption, but makes it\n");
 		fprintf(stderr, "                                    possible to run with apitrace in real time)\n");
+		fprintf(stderr, "      --gl-upload-thread          upload input frames to the GPU on a separate thread\n");
+		fprintf(stderr, "                                    as they arrive, instead of on the mixer thread\n");
+		fprintf(stderr, "                                    (experimental; can trigger driver bugs)\n");
 		fprintf(stderr, "      --print-video-latency       print out measurements of video latency on stdout\n");
 		fprintf(stderr, "      --max-input-queue-frames=FRAMES  never keep more than FRAMES frames for each card\n");
 		fprintf(stderr, "                                    (default 6, minimum 1)\n");
 		fprintf(stderr, "      --audio-queue-length-ms=MS  length of audio resampling queue (default 100.0)\n");
+		fprintf(stderr, "      --audio-bus-threads=NUM     process audio buses in parallel on NUM extra threads\n");
+		fprintf(stderr, "                                    (default 0, ie., all on the audio thread)\n");
+		fprintf(stderr, "      --audio-resampling-threads=NUM\n");
+		fprintf(stderr, "                                  resample audio inputs in parallel on NUM extra threads\n");
+		fprintf(stderr, "                                    (default 0, ie., all on the audio thread)\n");
+		fprintf(stderr, "      --no-audio-metering-thread  update the loudness and peak meters on the audio\n");
+		fprintf(stderr, "                                    thread instead of on a separate thread\n");
+		fprintf(stderr, "      --audio-true-peak-oversampling={2,4}\n");
+		fprintf(stderr, "                                  oversampling for the master peak meter; 2 is cheaper,\n");
+		fprintf(stderr, "                                    but can read up to ~1 dB low (default 4)\n");
 		fprintf(stderr, "      --output-ycbcr-coefficients={rec601,rec709,auto}\n");
 		fprintf(stderr, "                                  Y'CbCr coefficient standard of output (default auto)\n");
 		fprintf(stderr, "                                    auto is rec601, unless --output-card is used\n");
@@ -207,10 +239,18 @@ void parse_flags(Program program, int argc, char * const argv[])
 		{ "disable-makeup-gain-auto", no_argument, 0, OPTION_DISABLE_MAKEUP_GAIN_AUTO },
 		{ "enable-makeup-gain-auto", no_argument, 0, OPTION_ENABLE_MAKEUP_GAIN_AUTO },
 		{ "disable-alsa-output", no_argument, 0, OPTION_DISABLE_ALSA_OUTPUT },
+		{ "alsa-mmap-capture", no_argument, 0, OPTION_ALSA_MMAP_CAPTURE },
+		{ "file-audio-input", required_argument, 0, OPTION_FILE_AUDIO_INPUT },
+		{ "audio-rendition", required_argument, 0, OPTION_AUDIO_RENDITION },
 		{ "no-flush-pbos", no_argument, 0, OPTION_NO_FLUSH_PBOS },
+		{ "gl-upload-thread", no_argument, 0, OPTION_GL_UPLOAD_THREAD },
 		{ "print-video-latency", no_argument, 0, OPTION_PRINT_VIDEO_LATENCY },
 		{ "max-input-queue-frames", required_argument, 0, OPTION_MAX_INPUT_QUEUE_FRAMES },
 		{ "audio-queue-length-ms", required_argument, 0, OPTION_AUDIO_QUEUE_LENGTH_MS },
+		{ "audio-bus-threads", required_argument, 0, OPTION_AUDIO_BUS_THREADS },
+		{ "audio-resampling-threads", required_argument, 0, OPTION_AUDIO_RESAMPLING_THREADS },
+		{ "no-audio-metering-thread", no_argument, 0, OPTION_NO_AUDIO_METERING_THREAD },
+		{ "audio-true-peak-oversampling", required_argument, 0, OPTION_AUDIO_TRUE_PEAK_OVERSAMPLING },
 		{ "output-ycbcr-coefficients", required_argument, 0, OPTION_OUTPUT_YCBCR_COEFFICIENTS },
 		{ "output-buffer-frames", required_argument, 0, OPTION_OUTPUT_BUFFER_FRAMES },
 		{ "output-slop-frames", required_argument, 0, OPTION_OUTPUT_SLOP_FRAMES },
@@ -386,9 +426,21 @@ void parse_flags(Program program, int argc, char * const argv[])
 		case OPTION_DISABLE_ALSA_OUTPUT:
 			global_flags.enable_alsa_output = false;
 			break;
+		case OPTION_ALSA_MMAP_CAPTURE:
+			global_flags.alsa_mmap_capture = true;
+			break;
+		case OPTION_FILE_AUDIO_INPUT:
+			global_flags.file_audio_inputs.push_back(optarg);
+			break;
+		case OPTION_AUDIO_RENDITION:
+			global_flags.audio_renditions.push_back(optarg);
+			break;
 		case OPTION_NO_FLUSH_PBOS:
 			global_flags.flush_pbos = false;
 			break;
+		case OPTION_GL_UPLOAD_THREAD:
+			global_flags.gl_upload_thread = true;
+			break;
 		case OPTION_PRINT_VIDEO_LATENCY:
 			global_flags.print_video_latency = true;
 			break;
@@ -398,6 +450,18 @@ void parse_flags(Program program, int argc, char * const argv[])
 		case OPTION_AUDIO_QUEUE_LENGTH_MS:
 			global_flags.audio_queue_length_ms = atof(optarg);
 			break;
+		case OPTION_AUDIO_BUS_THREADS:
+			global_flags.audio_bus_threads = atoi(optarg);
+			break;
+		case OPTION_AUDIO_RESAMPLING_THREADS:
+			global_flags.audio_resampling_threads = atoi(optarg);
+			break;
+		case OPTION_NO_AUDIO_METERING_THREAD:
+			global_flags.audio_metering_thread = false;
+			break;
+		case OPTION_AUDIO_TRUE_PEAK_OVERSAMPLING:
+			global_flags.audio_true_peak_oversampling = atoi(optarg);
+			break;
 		case OPTION_OUTPUT_YCBCR_COEFFICIENTS:
 			output_ycbcr_coefficients = optarg;
 			break;
@@ -581,6 +645,18 @@ void parse_flags(Program program, int argc, char * const argv[])
 	if (global_flags.max_input_queue_frames > 10) {
 		fprintf(stderr, "WARNING: --max-input-queue-frames has little effect over 10.\n");
 	}
+	if (global_flags.audio_bus_threads < 0) {
+		fprintf(stderr, "ERROR: --audio-bus-threads can't be negative.\n");
+		exit(1);
+	}
+	if (global_flags.audio_resampling_threads < 0) {
+		fprintf(stderr, "ERROR: --audio-resampling-threads can't be negative.\n");
+		exit(1);
+	}
+	if (global_flags.audio_true_peak_oversampling != 2 && global_flags.audio_true_peak_oversampling != 4) {
+		fprintf(stderr, "ERROR: --audio-true-peak-oversampling must be 2 or 4.\n");
+		exit(1);
+	}
 
 	if (!isinf(global_flags.x264_crf)) {  // CRF mode is selected.
 		if (global_flags.x264_bitrate != -1) {
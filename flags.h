@@ -28,6 +28,7 @@ struct Flags {
 	bool limiter_enabled = true;
 	bool final_makeup_gain_auto = true;
 	bool flush_pbos = true;
+	bool gl_upload_thread = false;
 	std::string stream_mux_name = DEFAULT_STREAM_MUX_NAME;
 	bool stream_coarse_timebase = false;
 	std::string stream_audio_codec_name;  // Blank = use the same as for the recording.
@@ -42,12 +43,19 @@ struct Flags {
 	int x264_vbv_buffer_size = -1;  // In kilobits. 0 = one-frame VBV, -1 = same as <x264_bitrate> (one-second VBV).
 	std::vector<std::string> x264_extra_param;  // In “key[,value]” format.
 	bool enable_alsa_output = true;
+	bool alsa_mmap_capture = false;
+	std::vector<std::string> file_audio_inputs;  // In “FILE[,key=value...]” format; see FileAudioInput::parse_spec().
+	std::vector<std::string> audio_renditions;  // In “FILE,codec=NAME[,bitrate=KBITS]” format; see VideoEncoder.
 	std::map<int, int> default_stream_mapping;
 	bool multichannel_mapping_mode = false;  // Implicitly true if input_mapping_filename is nonempty.
 	std::string input_mapping_filename;  // Empty for none.
 	std::string midi_mapping_filename;  // Empty for none.
 	bool print_video_latency = false;
 	double audio_queue_length_ms = 100.0;
+	int audio_bus_threads = 0;  // Extra threads for processing audio buses in parallel; 0 = none.
+	int audio_resampling_threads = 0;  // Extra threads for resampling audio inputs in parallel; 0 = none.
+	bool audio_metering_thread = true;  // If false, the master meters are updated on the audio thread.
+	int audio_true_peak_oversampling = 4;  // For the master peak meter; 2 or 4.
 	bool ycbcr_rec709_coefficients = false;  // Will be overridden by HDMI/SDI output if ycbcr_auto_coefficients == true.
 	bool ycbcr_auto_coefficients = true;
 	int output_card = -1;
@@ -0,0 +1,167 @@
+// Generates a synthetic log of frame arrivals for replay_frame_log: one input
+// card and one master clock with the same nominal frame rate, but slowly
+// drifting apart, like two real 50 Hz clocks would. (This is the hard case for
+// the queue-dropping code; when the clocks are nearly in sync for a long time,
+// rare bursts of jitter make it hard to pick the right level of conservatism.)
+//
+// Both clocks get a small amount of normally distributed jitter; the input
+// card also gets bursts now and then, where a frame is late by an
+// exponentially distributed amount. Frames never arrive out of order,
+// so the ones behind a late frame come in right after it, like they do
+// when e.g. USB transfers get held up. The output is deterministic for
+// a given set of options, so that runs can be compared across changes.
+
+#include <getopt.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <random>
+
+using namespace std;
+
+struct GenerateConfig {
+	double duration_sec = 3600.0;
+	double frame_rate = 50.0;
+	double drift_ppm = 5.5;  // About one frame per hour at 50 Hz.
+	double input_jitter_ms = 0.3;
+	double output_jitter_ms = 0.1;
+	double burst_probability = 0.001;  // Per input frame.
+	double burst_ms = 10.0;  // Mean extra delay for a burst.
+	unsigned seed = 1;
+};
+
+enum {
+	OPTION_DURATION = 1000,
+	OPTION_FRAME_RATE,
+	OPTION_DRIFT_PPM,
+	OPTION_INPUT_JITTER_MS,
+	OPTION_OUTPUT_JITTER_MS,
+	OPTION_BURST_PROBABILITY,
+	OPTION_BURST_MS,
+	OPTION_SEED,
+	OPTION_HELP,
+};
+
+void usage(const char *argv0)
+{
+	fprintf(stderr, "Usage: %s [OPTION]... > LOG_FILE\n", argv0);
+	fprintf(stderr, "\n");
+	fprintf(stderr, "      --duration=SECONDS          length of the log (default 3600)\n");
+	fprintf(stderr, "      --frame-rate=FPS            nominal frame rate of both clocks (default 50)\n");
+	fprintf(stderr, "      --drift-ppm=PPM             how much slower the input clock runs (default 5.5;\n");
+	fprintf(stderr, "                                    can be negative)\n");
+	fprintf(stderr, "      --input-jitter-ms=MS        standard deviation of input jitter (default 0.3)\n");
+	fprintf(stderr, "      --output-jitter-ms=MS       standard deviation of master clock jitter (default 0.1)\n");
+	fprintf(stderr, "      --burst-probability=P       probability of an input frame being late (default 0.001)\n");
+	fprintf(stderr, "      --burst-ms=MS               average delay of late frames (default 10)\n");
+	fprintf(stderr, "      --seed=NUM                  random seed (default 1)\n");
+}
+
+void parse_options(int argc, char **argv, GenerateConfig *config)
+{
+	static const option long_options[] = {
+		{ "duration", required_argument, 0, OPTION_DURATION },
+		{ "frame-rate", required_argument, 0, OPTION_FRAME_RATE },
+		{ "drift-ppm", required_argument, 0, OPTION_DRIFT_PPM },
+		{ "input-jitter-ms", required_argument, 0, OPTION_INPUT_JITTER_MS },
+		{ "output-jitter-ms", required_argument, 0, OPTION_OUTPUT_JITTER_MS },
+		{ "burst-probability", required_argument, 0, OPTION_BURST_PROBABILITY },
+		{ "burst-ms", required_argument, 0, OPTION_BURST_MS },
+		{ "seed", required_argument, 0, OPTION_SEED },
+		{ "help", no_argument, 0, OPTION_HELP },
+		{ 0, 0, 0, 0 }
+	};
+	for ( ;; ) {
+		int option_index = 0;
+		int c = getopt_long(argc, argv, "", long_options, &option_index);
+		if (c == -1) {
+			break;
+		}
+		switch (c) {
+		case OPTION_DURATION:
+			config->duration_sec = atof(optarg);
+			break;
+		case OPTION_FRAME_RATE:
+			config->frame_rate = atof(optarg);
+			break;
+		case OPTION_DRIFT_PPM:
+			config->drift_ppm = atof(optarg);
+			break;
+		case OPTION_INPUT_JITTER_MS:
+			config->input_jitter_ms = atof(optarg);
+			break;
+		case OPTION_OUTPUT_JITTER_MS:
+			config->output_jitter_ms = atof(optarg);
+			break;
+		case OPTION_BURST_PROBABILITY:
+			config->burst_probability = atof(optarg);
+			break;
+		case OPTION_BURST_MS:
+			config->burst_ms = atof(optarg);
+			break;
+		case OPTION_SEED:
+			config->seed = atoi(optarg);
+			break;
+		case OPTION_HELP:
+			usage(argv[0]);
+			exit(0);
+		default:
+			usage(argv[0]);
+			exit(1);
+		}
+	}
+	if (optind != argc) {
+		usage(argv[0]);
+		exit(1);
+	}
+	if (!(config->duration_sec > 0.0) || !(config->frame_rate > 0.0)) {
+		fprintf(stderr, "--duration and --frame-rate must be positive.\n");
+		exit(1);
+	}
+	if (!(config->input_jitter_ms >= 0.0) || !(config->output_jitter_ms >= 0.0) ||
+	    !(config->burst_probability >= 0.0 && config->burst_probability <= 1.0) ||
+	    !(config->burst_ms > 0.0)) {
+		fprintf(stderr, "Jitter must be nonnegative, and bursts must have a probability and a positive length.\n");
+		exit(1);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	GenerateConfig config;
+	parse_options(argc, argv, &config);
+
+	mt19937 rng(config.seed);
+	normal_distribution<double> input_jitter(0.0, 1e-3 * config.input_jitter_ms);
+	normal_distribution<double> output_jitter(0.0, 1e-3 * config.output_jitter_ms);
+	bernoulli_distribution is_burst(config.burst_probability);
+	exponential_distribution<double> burst_delay(1.0 / (1e-3 * config.burst_ms));
+
+	const double output_frame_duration = 1.0 / config.frame_rate;
+	const double input_frame_duration = output_frame_duration * (1.0 + 1e-6 * config.drift_ppm);
+
+	// Start the input half a frame off from the master clock, and let it
+	// drift from there.
+	double last_in = 0.0, last_out = 0.0;
+	for (size_t i = 0; ; ++i) {
+		double out = max(i * output_frame_duration + fabs(output_jitter(rng)), last_out);
+		if (out > config.duration_sec) {
+			break;
+		}
+		printf("OUT %.6f\n", out);
+		last_out = out;
+	}
+	for (size_t i = 0; ; ++i) {
+		double in = (i + 0.5) * input_frame_duration + fabs(input_jitter(rng));
+		if (is_burst(rng)) {
+			in += burst_delay(rng);
+		}
+		in = max(in, last_in);
+		if (in > config.duration_sec) {
+			break;
+		}
+		printf("IN %.6f\n", in);
+		last_in = in;
+	}
+}
@@ -77,6 +77,7 @@ unique_ptr<Mux> create_mux(HTTPD *httpd, AVOutputFormat *oformat, X264Encoder *x
 }
 
 void video_frame_callback(FFmpegCapture *video, X264Encoder *x264_encoder, AudioEncoder *audio_encoder,
+                          vector<float> *float_samples,
                           int64_t video_pts, AVRational video_timebase,
                           int64_t audio_pts, AVRational audio_timebase,
                           uint16_t timecode,
@@ -99,17 +100,16 @@ void video_frame_callback(FFmpegCapture *video, X264Encoder *x264_encoder, Audio
 
 		// TODO: Reduce some duplication against AudioMixer here.
 		size_t num_samples = audio_frame.len / (audio_format.bits_per_sample / 8);
-		vector<float> float_samples;
-		float_samples.resize(num_samples);
+		float_samples->resize(num_samples);
 		if (audio_format.bits_per_sample == 16) {
 			const int16_t *src = (const int16_t *)audio_frame.data;
-			float *dst = &float_samples[0];
+			float *dst = float_samples->data();
 			for (size_t i = 0; i < num_samples; ++i) {
 				*dst++ = le16toh(*src++) * (1.0f / 32768.0f);
 			}
 		} else if (audio_format.bits_per_sample == 32) {
 			const int32_t *src = (const int32_t *)audio_frame.data;
-			float *dst = &float_samples[0];
+			float *dst = float_samples->data();
 			for (size_t i = 0; i < num_samples; ++i) {
 				*dst++ = le32toh(*src++) * (1.0f / 2147483648.0f);
 			}
@@ -117,7 +117,7 @@ void video_frame_callback(FFmpegCapture *video, X264Encoder *x264_encoder, Audio
 			assert(false);
 		}
 		audio_pts = av_rescale_q(audio_pts, audio_timebase, AVRational{ 1, TIMEBASE });
-		audio_encoder->encode_audio(float_samples, audio_pts);
+		audio_encoder->encode_audio(*float_samples, audio_pts);
         }
 
 	if (video_frame.owner) {
@@ -196,9 +196,10 @@ int main(int argc, char *argv[])
 	x264_encoder->add_mux(http_mux.get());
 	global_x264_encoder = x264_encoder.get();
 
+	vector<float> float_samples;  // Reused between audio frames; only touched by the capture thread.
 	FFmpegCapture video(argv[optind], global_flags.width, global_flags.height);
 	video.set_pixel_format(FFmpegCapture::PixelFormat_NV12);
-	video.set_frame_callback(bind(video_frame_callback, &video, x264_encoder.get(), audio_encoder.get(), _1, _2, _3, _4, _5, _6, _7, _8, _9, _10, _11));
+	video.set_frame_callback(bind(video_frame_callback, &video, x264_encoder.get(), audio_encoder.get(), &float_samples, _1, _2, _3, _4, _5, _6, _7, _8, _9, _10, _11));
 	if (!global_flags.transcode_audio) {
 		video.set_audio_callback(bind(audio_frame_callback, http_mux.get(), _1, _2));
 	}
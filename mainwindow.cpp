@@ -274,8 +274,6 @@ MainWindow::MainWindow()
 		global_flags.enable_quick_cut_keys = ui->quick_cut_enable_action->isChecked();
 	});
 
-	last_audio_level_callback = steady_clock::now() - seconds(1);
-
 	if (!global_flags.midi_mapping_filename.empty()) {
 		MIDIMappingProto midi_mapping;
 		if (!load_midi_mapping_from_file(global_flags.midi_mapping_filename, &midi_mapping)) {
@@ -406,7 +404,16 @@ void MainWindow::mixer_created(Mixer *mixer)
 	// the expanded audio view labels are clickable makes it natural to
 	// click this one as well.
 	connect(ui->peak_display, &ClickableLabel::clicked, this, &MainWindow::reset_meters_button_clicked);
-	mixer->get_audio_mixer()->set_audio_level_callback(bind(&MainWindow::audio_level_callback, this, _1, _2, _3, _4, _5, _6, _7, _8));
+
+	// The meters are somewhat inefficient to update. Only update them
+	// every 100 ms or so (the audio mixer has new levels every 5–20 ms).
+	// Note that this means that the digital peak meters are ever so slightly
+	// too low (each update won't be a faithful representation of the highest
+	// peak since the previous update, since there are frames we won't draw),
+	// but the _peak_ of the peak meters will be correct (it's tracked in
+	// AudioMixer, not here), and that's much more important.
+	connect(&audio_level_timer, &QTimer::timeout, this, &MainWindow::update_audio_levels);
+	audio_level_timer.start(100);
 
 	midi_mapper.refresh_highlights();
 	midi_mapper.refresh_lights();
@@ -878,80 +885,66 @@ void MainWindow::reset_meters_button_clicked()
 	ui->peak_display->setStyleSheet("");
 }
 
-void MainWindow::audio_level_callback(float level_lufs, float peak_db, vector<AudioMixer::BusLevel> bus_levels,
-                                      float global_level_lufs,
-                                      float range_low_lufs, float range_high_lufs,
-                                      float final_makeup_gain_db,
-                                      float correlation)
+void MainWindow::update_audio_levels()
 {
-	steady_clock::time_point now = steady_clock::now();
-
-	// The meters are somewhat inefficient to update. Only update them
-	// every 100 ms or so (we get updates every 5–20 ms). Note that this
-	// means that the digital peak meters are ever so slightly too low
-	// (each update won't be a faithful representation of the highest peak
-	// since the previous update, since there are frames we won't draw),
-	// but the _peak_ of the peak meters will be correct (it's tracked in
-	// AudioMixer, not here), and that's much more important.
-	double last_update_age = duration<double>(now - last_audio_level_callback).count();
-	if (last_update_age < 0.100) {
+	AudioMixer::AudioLevels levels;
+	if (!global_audio_mixer->get_audio_levels(&levels)) {
 		return;
 	}
-	last_audio_level_callback = now;
-
-	post_to_main_thread([=]() {
-		ui->vu_meter->set_level(level_lufs);
-		for (unsigned bus_index = 0; bus_index < bus_levels.size(); ++bus_index) {
-			if (bus_index < audio_miniviews.size()) {
-				const AudioMixer::BusLevel &level = bus_levels[bus_index];
-				Ui::AudioMiniView *miniview = audio_miniviews[bus_index];
-				miniview->peak_meter->set_level(
-					level.current_level_dbfs[0], level.current_level_dbfs[1]);
-				miniview->peak_meter->set_peak(
-					level.peak_level_dbfs[0], level.peak_level_dbfs[1]);
-				set_peak_label(miniview->peak_display_label, level.historic_peak_dbfs);
-
-				Ui::AudioExpandedView *view = audio_expanded_views[bus_index];
-				view->peak_meter->set_level(
-					level.current_level_dbfs[0], level.current_level_dbfs[1]);
-				view->peak_meter->set_peak(
-					level.peak_level_dbfs[0], level.peak_level_dbfs[1]);
-				view->reduction_meter->set_reduction_db(level.compressor_attenuation_db);
-				view->gainstaging_knob->blockSignals(true);
-				view->gainstaging_knob->setValue(lrintf(level.gain_staging_db * 10.0f));
-				view->gainstaging_knob->blockSignals(false);
-				view->gainstaging_db_display->setText(
-					QString("Gain: ") +
-					QString::fromStdString(format_db(level.gain_staging_db, DB_WITH_SIGN)));
-				set_peak_label(view->peak_display_label, level.historic_peak_dbfs);
-
-				midi_mapper.set_has_peaked(bus_index, level.historic_peak_dbfs >= -0.1f);
-			}
+
+	ui->vu_meter->set_level(levels.level_lufs);
+	for (unsigned bus_index = 0; bus_index < levels.num_buses; ++bus_index) {
+		if (bus_index < audio_miniviews.size()) {
+			const AudioMixer::BusLevel &level = levels.bus_levels[bus_index];
+			Ui::AudioMiniView *miniview = audio_miniviews[bus_index];
+			miniview->peak_meter->set_level(
+				level.current_level_dbfs[0], level.current_level_dbfs[1]);
+			miniview->peak_meter->set_peak(
+				level.peak_level_dbfs[0], level.peak_level_dbfs[1]);
+			set_peak_label(miniview->peak_display_label, level.historic_peak_dbfs);
+
+			Ui::AudioExpandedView *view = audio_expanded_views[bus_index];
+			view->peak_meter->set_level(
+				level.current_level_dbfs[0], level.current_level_dbfs[1]);
+			view->peak_meter->set_peak(
+				level.peak_level_dbfs[0], level.peak_level_dbfs[1]);
+			view->reduction_meter->set_reduction_db(level.compressor_attenuation_db);
+			view->gainstaging_knob->blockSignals(true);
+			view->gainstaging_knob->setValue(lrintf(level.gain_staging_db * 10.0f));
+			view->gainstaging_knob->blockSignals(false);
+			view->gainstaging_db_display->setText(
+				QString("Gain: ") +
+				QString::fromStdString(format_db(level.gain_staging_db, DB_WITH_SIGN)));
+			set_peak_label(view->peak_display_label, level.historic_peak_dbfs);
+
+			midi_mapper.set_has_peaked(bus_index, level.historic_peak_dbfs >= -0.1f);
 		}
-		ui->lra_meter->set_levels(global_level_lufs, range_low_lufs, range_high_lufs);
-		ui->correlation_meter->set_correlation(correlation);
+	}
+	ui->lra_meter->set_levels(levels.global_level_lufs, levels.range_low_lufs, levels.range_high_lufs);
+	ui->correlation_meter->set_correlation(levels.correlation);
 
-		ui->peak_display->setText(QString::fromStdString(format_db(peak_db, DB_BARE)));
-		set_peak_label(ui->peak_display, peak_db);
+	ui->peak_display->setText(QString::fromStdString(format_db(levels.peak_db, DB_BARE)));
+	set_peak_label(ui->peak_display, levels.peak_db);
 
-		// NOTE: Will be invisible when using multitrack audio.
+	// NOTE: Will be invisible when using multitrack audio.
+	if (levels.num_buses > 0) {
 		ui->gainstaging_knob->blockSignals(true);
-		ui->gainstaging_knob->setValue(lrintf(bus_levels[0].gain_staging_db * 10.0f));
+		ui->gainstaging_knob->setValue(lrintf(levels.bus_levels[0].gain_staging_db * 10.0f));
 		ui->gainstaging_knob->blockSignals(false);
 		ui->gainstaging_db_display->setText(
-			QString::fromStdString(format_db(bus_levels[0].gain_staging_db, DB_WITH_SIGN)));
+			QString::fromStdString(format_db(levels.bus_levels[0].gain_staging_db, DB_WITH_SIGN)));
+	}
 
-		ui->makeup_gain_knob->blockSignals(true);
-		ui->makeup_gain_knob->setValue(lrintf(final_makeup_gain_db * 10.0f));
-		ui->makeup_gain_knob->blockSignals(false);
-		ui->makeup_gain_db_display->setText(
-			QString::fromStdString(format_db(final_makeup_gain_db, DB_WITH_SIGN)));
-		ui->makeup_gain_db_display_2->setText(
-			QString::fromStdString(format_db(final_makeup_gain_db, DB_WITH_SIGN)));
+	ui->makeup_gain_knob->blockSignals(true);
+	ui->makeup_gain_knob->setValue(lrintf(levels.final_makeup_gain_db * 10.0f));
+	ui->makeup_gain_knob->blockSignals(false);
+	ui->makeup_gain_db_display->setText(
+		QString::fromStdString(format_db(levels.final_makeup_gain_db, DB_WITH_SIGN)));
+	ui->makeup_gain_db_display_2->setText(
+		QString::fromStdString(format_db(levels.final_makeup_gain_db, DB_WITH_SIGN)));
 
-		// Peak labels could have changed.
-		midi_mapper.refresh_lights();
-	});
+	// Peak labels could have changed.
+	midi_mapper.refresh_lights();
 }
 
 void MainWindow::relayout()
@@ -5,6 +5,7 @@
 #include <sys/types.h>
 #include <QMainWindow>
 #include <QString>
+#include <QTimer>
 #include <chrono>
 #include <string>
 #include <vector>
@@ -133,9 +134,9 @@ private:
 	// Called from DiskSpaceEstimator.
 	void report_disk_space(off_t free_bytes, double estimated_seconds_left);
 
-	// Called from the mixer.
-	void audio_level_callback(float level_lufs, float peak_db, std::vector<AudioMixer::BusLevel> bus_levels, float global_level_lufs, float range_low_lufs, float range_high_lufs, float final_makeup_gain_db, float correlation);
-	std::chrono::steady_clock::time_point last_audio_level_callback;
+	// Pulls the levels from the audio mixer every now and then (see audio_level_timer).
+	void update_audio_levels();
+	QTimer audio_level_timer;
 
 	void audio_state_changed();
 
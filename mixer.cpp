@@ -204,99 +204,6 @@ void upload_texture(GLuint tex, GLuint width, GLuint height, GLuint stride, bool
 
 }  // namespace
 
-void JitterHistory::register_metrics(const vector<pair<string, string>> &labels)
-{
-	global_metrics.add("input_underestimated_jitter_frames", labels, &metric_input_underestimated_jitter_frames);
-	global_metrics.add("input_estimated_max_jitter_seconds", labels, &metric_input_estimated_max_jitter_seconds, Metrics::TYPE_GAUGE);
-}
-
-void JitterHistory::unregister_metrics(const vector<pair<string, string>> &labels)
-{
-	global_metrics.remove("input_underestimated_jitter_frames", labels);
-	global_metrics.remove("input_estimated_max_jitter_seconds", labels);
-}
-
-void JitterHistory::frame_arrived(steady_clock::time_point now, int64_t frame_duration, size_t dropped_frames)
-{
-	if (expected_timestamp > steady_clock::time_point::min()) {
-		expected_timestamp += dropped_frames * nanoseconds(frame_duration * 1000000000 / TIMEBASE);
-		double jitter_seconds = fabs(duration<double>(expected_timestamp - now).count());
-		history.push_back(orders.insert(jitter_seconds));
-		if (jitter_seconds > estimate_max_jitter()) {
-			++metric_input_underestimated_jitter_frames;
-		}
-
-		metric_input_estimated_max_jitter_seconds = estimate_max_jitter();
-
-		if (history.size() > history_length) {
-			orders.erase(history.front());
-			history.pop_front();
-		}
-		assert(history.size() <= history_length);
-	}
-	expected_timestamp = now + nanoseconds(frame_duration * 1000000000 / TIMEBASE);
-}
-
-double JitterHistory::estimate_max_jitter() const
-{
-	if (orders.empty()) {
-		return 0.0;
-	}
-	size_t elem_idx = lrint((orders.size() - 1) * percentile);
-	if (percentile <= 0.5) {
-		return *next(orders.begin(), elem_idx) * multiplier;
-	} else {
-		return *prev(orders.end(), orders.size() - elem_idx) * multiplier;
-	}
-}
-
-void QueueLengthPolicy::register_metrics(const vector<pair<string, string>> &labels)
-{
-	global_metrics.add("input_queue_safe_length_frames", labels, &metric_input_queue_safe_length_frames, Metrics::TYPE_GAUGE);
-}
-
-void QueueLengthPolicy::unregister_metrics(const vector<pair<string, string>> &labels)
-{
-	global_metrics.remove("input_queue_safe_length_frames", labels);
-}
-
-void QueueLengthPolicy::update_policy(steady_clock::time_point now,
-                                      steady_clock::time_point expected_next_frame,
-                                      int64_t input_frame_duration,
-                                      int64_t master_frame_duration,
-                                      double max_input_card_jitter_seconds,
-                                      double max_master_card_jitter_seconds)
-{
-	double input_frame_duration_seconds = input_frame_duration / double(TIMEBASE);
-	double master_frame_duration_seconds = master_frame_duration / double(TIMEBASE);
-
-	// Figure out when we can expect the next frame for this card, assuming
-	// worst-case jitter (ie., the frame is maximally late).
-	double seconds_until_next_frame = max(duration<double>(expected_next_frame - now).count() + max_input_card_jitter_seconds, 0.0);
-
-	// How many times are the master card expected to tick in that time?
-	// We assume the master clock has worst-case jitter but not any rate
-	// discrepancy, ie., it ticks as early as possible every time, but not
-	// cumulatively.
-	double frames_needed = (seconds_until_next_frame + max_master_card_jitter_seconds) / master_frame_duration_seconds;
-
-	// As a special case, if the master card ticks faster than the input card,
-	// we expect the queue to drain by itself even without dropping. But if
-	// the difference is small (e.g. 60 Hz master and 59.94 input), it would
-	// go slowly enough that the effect wouldn't really be appreciable.
-	// We account for this by looking at the situation five frames ahead,
-	// assuming everything else is the same.
-	double frames_allowed;
-	if (master_frame_duration < input_frame_duration) {
-		frames_allowed = frames_needed + 5 * (input_frame_duration_seconds - master_frame_duration_seconds) / master_frame_duration_seconds;
-	} else {
-		frames_allowed = frames_needed;
-	}
-
-	safe_queue_length = max<int>(floor(frames_allowed), 0);
-	metric_input_queue_safe_length_frames = safe_queue_length;
-}
-
 Mixer::Mixer(const QSurfaceFormat &format, unsigned num_cards)
 	: httpd(),
 	  num_cards(num_cards),
@@ -491,6 +398,18 @@ Mixer::Mixer(const QSurfaceFormat &format, unsigned num_cards)
 	}
 
 	output_jitter_history.register_metrics({{ "card", "output" }});
+
+	metric_card_mutex_wait_seconds.init_geometric(1e-6, 1.0, 25);
+	global_metrics.add("mixer_card_mutex_wait_seconds", &metric_card_mutex_wait_seconds);
+
+	metric_field_release_lateness_seconds.init_geometric(1e-6, 1.0, 25);
+	global_metrics.add("mixer_field_release_lateness_seconds", &metric_field_release_lateness_seconds);
+
+	if (global_flags.gl_upload_thread) {
+		upload_surface = create_surface(format);
+		metric_upload_wait_seconds.init_geometric(1e-6, 1.0, 25);
+		global_metrics.add("mixer_upload_wait_seconds", &metric_upload_wait_seconds);
+	}
 }
 
 Mixer::~Mixer()
@@ -499,7 +418,7 @@ Mixer::~Mixer()
 
 	for (unsigned card_index = 0; card_index < num_cards + num_video_inputs + num_html_inputs; ++card_index) {
 		{
-			unique_lock<mutex> lock(card_mutex);
+			unique_lock<mutex> lock(cards[card_index].new_frames_mutex);
 			cards[card_index].should_quit = true;  // Unblock thread.
 			cards[card_index].new_frames_changed.notify_all();
 		}
@@ -510,6 +429,26 @@ Mixer::~Mixer()
 		}
 	}
 
+	// Now that no more frames can come in, we can stop the field release
+	// thread, and then the upload thread it might be feeding. The upload
+	// thread empties the frame queues on its way out; see upload_thread_func().
+	if (field_release_thread.joinable()) {
+		{
+			lock_guard<mutex> lock(delayed_frames_mutex);
+			field_release_should_quit = true;
+		}
+		delayed_frames_changed.notify_all();
+		field_release_thread.join();
+	}
+	if (upload_thread.joinable()) {
+		{
+			lock_guard<mutex> lock(upload_queue_mutex);
+			upload_thread_should_quit = true;
+		}
+		upload_queue_changed.notify_all();
+		upload_thread.join();
+	}
+
 	video_encoder.reset(nullptr);
 }
 
@@ -547,7 +486,21 @@ void Mixer::configure_card(unsigned card_index, CaptureInterface *capture, CardT
 	if (card->surface == nullptr) {
 		card->surface = create_surface_with_same_format(mixer_surface);
 	}
-	while (!card->new_frames.empty()) card->new_frames.pop_front();
+	{
+		// Throw away any fields still waiting to be released, and wait
+		// for the field release thread to be done with this card.
+		unique_lock<mutex> lock(delayed_frames_mutex);
+		for (auto it = delayed_frames.begin(); it != delayed_frames.end(); ) {
+			if (it->card_index == card_index) {
+				it = delayed_frames.erase(it);
+				--card->num_delayed_frames;
+			} else {
+				++it;
+			}
+		}
+		delayed_frames_changed.wait(lock, [card]{ return card->num_delayed_frames == 0; });
+	}
+	card->new_frames.clear();  // The old capture is stopped, so we're the only one touching the queue.
 	card->last_timecode = -1;
 	card->capture->set_pixel_format(pixel_format);
 	card->capture->configure_card();
@@ -625,18 +578,18 @@ void Mixer::configure_card(unsigned card_index, CaptureInterface *capture, CardT
 
 void Mixer::set_output_card_internal(int card_index)
 {
-	// We don't really need to take card_mutex, since we're in the mixer
-	// thread and don't mess with any queues (which is the only thing that happens
-	// from other threads), but it's probably the safest in the long run.
-	unique_lock<mutex> lock(card_mutex);
+	// We're in the mixer thread, which is the only one that reconfigures
+	// cards, but other threads (e.g. the UI) can look at them, so take
+	// card_mutex while we switch things around.
+	unique_lock<mutex> lock = lock_card_mutex();
 	if (output_card_index != -1) {
 		// Switch the old card from output to input.
 		CaptureCard *old_card = &cards[output_card_index];
 		old_card->output->end_output();
 
 		// Stop the fake card that we put into place.
-		// This needs to _not_ happen under the mutex, to avoid deadlock
-		// (delivering the last frame needs to take the mutex).
+		// This needs to _not_ happen under the mutex, since it can take
+		// a while, and we don't want to block the UI in the meantime.
 		CaptureInterface *fake_capture = old_card->capture.get();
 		lock.unlock();
 		fake_capture->stop_dequeue_thread();
@@ -753,10 +706,9 @@ void Mixer::bm_frame(unsigned card_index, uint16_t timecode,
 			card_index, dropped_frames, timecode);
 		card->metric_input_dropped_frames_error += dropped_frames;
 
-		bool success;
-		do {
-			success = audio_mixer.add_silence(device, silence_samples, dropped_frames, frame_length);
-		} while (!success);
+		// If the queue is full, the audio thread is far behind, and we drop
+		// the silence (like the audio below) rather than hold up the card.
+		audio_mixer.add_silence(device, silence_samples, dropped_frames, frame_length);
 	}
 
 	if (num_samples > 0) {
@@ -804,18 +756,13 @@ void Mixer::bm_frame(unsigned card_index, uint16_t timecode,
 
 		// Still send on the information that we _had_ a frame, even though it's corrupted,
 		// so that pts can go up accordingly.
-		{
-			unique_lock<mutex> lock(card_mutex);
-			CaptureCard::NewFrame new_frame;
-			new_frame.frame = RefCountedFrame(FrameAllocator::Frame());
-			new_frame.length = frame_length;
-			new_frame.interlaced = false;
-			new_frame.dropped_frames = dropped_frames;
-			new_frame.received_timestamp = video_frame.received_timestamp;
-			card->new_frames.push_back(move(new_frame));
-			card->jitter_history.frame_arrived(video_frame.received_timestamp, frame_length, dropped_frames);
-		}
-		card->new_frames_changed.notify_all();
+		CaptureCard::NewFrame new_frame;
+		new_frame.frame = RefCountedFrame(FrameAllocator::Frame());
+		new_frame.length = frame_length;
+		new_frame.interlaced = false;
+		new_frame.dropped_frames = dropped_frames;
+		new_frame.received_timestamp = video_frame.received_timestamp;
+		release_new_frame(card_index, move(new_frame), steady_clock::now());
 		return;
 	}
 
@@ -848,7 +795,10 @@ void Mixer::bm_frame(unsigned card_index, uint16_t timecode,
 		// Put the actual texture upload in a lambda that is executed in the main thread.
 		// It is entirely possible to do this in the same thread (and it might even be
 		// faster, depending on the GPU and driver), but it appears to be trickling
-		// driver bugs very easily.
+		// driver bugs very easily. With --gl-upload-thread, it is instead executed
+		// on a separate upload thread as soon as possible, so that the mixer thread
+		// does not have to do the uploads for all the cards right before rendering;
+		// that has its own context, and hands the result back with a fence.
 		//
 		// Note that this means we must hold on to the actual frame data in <userdata>
 		// until the upload command is run, but we hold on to <frame> much longer than that
@@ -916,32 +866,117 @@ void Mixer::bm_frame(unsigned card_index, uint16_t timecode,
 			check_error();
 		};
 
+		steady_clock::time_point release_time = steady_clock::now();
 		if (field == 1) {
-			// Don't upload the second field as fast as we can; wait until
+			// Don't release the second field as fast as we can; wait until
 			// the field time has approximately passed. (Otherwise, we could
 			// get timing jitter against the other sources, and possibly also
 			// against the video display, although the latter is not as critical.)
 			// This requires our system clock to be reasonably close to the
 			// video clock, but that's not an unreasonable assumption.
-			steady_clock::time_point second_field_start = frame_upload_start +
-				nanoseconds(frame_length * 1000000000 / TIMEBASE);
-			this_thread::sleep_until(second_field_start);
+			// The field release thread does the waiting, so that we don't
+			// hold up the capture thread for half a frame.
+			release_time = frame_upload_start + nanoseconds(frame_length * 1000000000 / TIMEBASE);
 		}
 
-		{
-			unique_lock<mutex> lock(card_mutex);
-			CaptureCard::NewFrame new_frame;
-			new_frame.frame = frame;
-			new_frame.length = frame_length;
-			new_frame.field = field;
-			new_frame.interlaced = video_format.interlaced;
+		CaptureCard::NewFrame new_frame;
+		new_frame.frame = frame;
+		new_frame.length = frame_length;
+		new_frame.field = field;
+		new_frame.interlaced = video_format.interlaced;
+		new_frame.dropped_frames = dropped_frames;
+		new_frame.received_timestamp = video_frame.received_timestamp;  // Ignore the audio timestamp.
+		if (global_flags.gl_upload_thread) {
+			new_frame.pending_upload = make_shared<PendingUpload>();
+			new_frame.pending_upload->upload_func = upload_func;
+			new_frame.pending_upload->frame = frame;
+		} else {
 			new_frame.upload_func = upload_func;
-			new_frame.dropped_frames = dropped_frames;
-			new_frame.received_timestamp = video_frame.received_timestamp;  // Ignore the audio timestamp.
-			card->new_frames.push_back(move(new_frame));
-			card->jitter_history.frame_arrived(video_frame.received_timestamp, frame_length, dropped_frames);
 		}
-		card->new_frames_changed.notify_all();
+		release_new_frame(card_index, move(new_frame), release_time);
+	}
+}
+
+void Mixer::release_new_frame(unsigned card_index, CaptureCard::NewFrame &&new_frame, steady_clock::time_point release_time)
+{
+	CaptureCard *card = &cards[card_index];
+	{
+		lock_guard<mutex> lock(delayed_frames_mutex);
+		if (card->num_delayed_frames > 0 || release_time > steady_clock::now()) {
+			// Never let a frame overtake an earlier one from the same card.
+			release_time = max(release_time, card->last_release_time);
+			card->last_release_time = release_time;
+
+			DelayedFrame delayed_frame;
+			delayed_frame.release_time = release_time;
+			delayed_frame.card_index = card_index;
+			delayed_frame.new_frame = move(new_frame);
+			auto it = upper_bound(delayed_frames.begin(), delayed_frames.end(), release_time,
+				[](steady_clock::time_point t, const DelayedFrame &df) { return t < df.release_time; });
+			delayed_frames.insert(it, move(delayed_frame));
+			++card->num_delayed_frames;
+			delayed_frames_changed.notify_all();
+			return;
+		}
+	}
+
+	// Nothing is waiting in the field release thread for this card,
+	// so we can push directly (we are still the only producer).
+	push_new_frame(card_index, move(new_frame));
+}
+
+void Mixer::push_new_frame(unsigned card_index, CaptureCard::NewFrame &&new_frame)
+{
+	CaptureCard *card = &cards[card_index];
+
+	// Queue the upload (if any) only after the frame is in the card's queue,
+	// and without keeping a reference of our own; the calling thread must
+	// never hold the last reference to the fence, since it has no OpenGL
+	// context to delete it in.
+	shared_ptr<PendingUpload> upload = new_frame.pending_upload;
+	if (!card->new_frames.push(move(new_frame))) {
+		fprintf(stderr, "Card %u: Input queue is full (is the mixer stuck?), dropping frame\n", card_index);
+		++card->metric_input_dropped_frames_jitter;
+		return;
+	}
+	if (upload != nullptr) {
+		queue_upload(move(upload));
+	}
+
+	// Taking the mutex makes sure we cannot notify between the mixer
+	// checking the queue and going to sleep.
+	unique_lock<mutex> lock(card->new_frames_mutex);
+	card->new_frames_changed.notify_all();
+}
+
+void Mixer::field_release_thread_func()
+{
+	pthread_setname_np(pthread_self(), "FieldRelease");
+
+	unique_lock<mutex> lock(delayed_frames_mutex);
+	while (!field_release_should_quit) {
+		if (delayed_frames.empty()) {
+			delayed_frames_changed.wait(lock);
+			continue;
+		}
+		const steady_clock::time_point release_time = delayed_frames.front().release_time;
+		if (steady_clock::now() < release_time) {
+			delayed_frames_changed.wait_until(lock, release_time);
+			continue;
+		}
+
+		DelayedFrame delayed_frame = move(delayed_frames.front());
+		delayed_frames.pop_front();
+
+		// The card still counts the frame as delayed while we push it,
+		// so that its capture thread does not push concurrently with us.
+		lock.unlock();
+		metric_field_release_lateness_seconds.count_event(duration<double>(steady_clock::now() - release_time).count());
+		push_new_frame(delayed_frame.card_index, move(delayed_frame.new_frame));
+		lock.lock();
+
+		--cards[delayed_frame.card_index].num_delayed_frames;
+		delayed_frames_changed.notify_all();
 	}
 }
 
@@ -953,9 +988,97 @@ void Mixer::bm_hotplug_add(libusb_device *dev)
 
 void Mixer::bm_hotplug_remove(unsigned card_index)
 {
+	unique_lock<mutex> lock(cards[card_index].new_frames_mutex);
 	cards[card_index].new_frames_changed.notify_all();
 }
 
+void Mixer::queue_upload(shared_ptr<PendingUpload> upload)
+{
+	lock_guard<mutex> lock(upload_queue_mutex);
+	upload_queue.push(move(upload));
+	upload_queue_changed.notify_all();
+}
+
+void Mixer::upload_thread_func()
+{
+	pthread_setname_np(pthread_self(), "Mixer_Upload");
+
+	eglBindAPI(EGL_OPENGL_API);
+	QOpenGLContext *context = create_context(upload_surface);
+	if (!make_current(context, upload_surface)) {
+		printf("oops\n");
+		exit(1);
+	}
+
+	for ( ;; ) {
+		shared_ptr<PendingUpload> upload;
+		{
+			unique_lock<mutex> lock(upload_queue_mutex);
+			upload_queue_changed.wait(lock, [this]{ return upload_thread_should_quit || !upload_queue.empty(); });
+			if (upload_thread_should_quit) {
+				break;
+			}
+			upload = move(upload_queue.front());
+			upload_queue.pop();
+		}
+
+		// If we hold the only reference, the frame was dropped from the queue
+		// before we got to it, so nobody is going to wait for the upload.
+		// (Nobody can take a new reference, so this check is not racy.)
+		if (upload.use_count() == 1) {
+			continue;
+		}
+
+		upload->upload_func();
+		if (v210_converter != nullptr) {
+			// The mixer will sample the output of the compute shader as a regular texture.
+			glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+			check_error();
+		}
+		RefCountedGLsync fence(GL_SYNC_GPU_COMMANDS_COMPLETE, /*flags=*/0);
+		check_error();
+		glFlush();  // Make sure the fence is actually submitted, or the mixer could wait forever.
+		check_error();
+
+		lock_guard<mutex> lock(upload->mu);
+		upload->fence = fence;
+		upload->done = true;
+		upload->done_changed.notify_all();
+	}
+
+	// We only quit from ~Mixer(), after the mixer thread, the capture threads
+	// and the field release thread are all gone, so we are the only ones left
+	// touching the frame queues. Empty them while we still have a context,
+	// since they can hold the last references to our fences.
+	{
+		lock_guard<mutex> lock(upload_queue_mutex);
+		upload_queue = queue<shared_ptr<PendingUpload>>();
+	}
+	{
+		lock_guard<mutex> lock(delayed_frames_mutex);
+		delayed_frames.clear();
+	}
+	for (unsigned card_index = 0; card_index < num_cards + num_video_inputs + num_html_inputs; ++card_index) {
+		cards[card_index].new_frames.clear();
+	}
+
+	delete_context(context);
+}
+
+void Mixer::wait_for_upload(PendingUpload *upload)
+{
+	steady_clock::time_point start = steady_clock::now();
+	{
+		unique_lock<mutex> lock(upload->mu);
+		upload->done_changed.wait(lock, [upload]{ return upload->done; });
+	}
+	metric_upload_wait_seconds.count_event(duration<double>(steady_clock::now() - start).count());
+
+	// Only the GPU needs to wait for the upload to actually finish, not us.
+	glWaitSync(upload->fence.get(), /*flags=*/0, GL_TIMEOUT_IGNORED);
+	check_error();
+}
+
 void Mixer::thread_func()
 {
 	pthread_setname_np(pthread_self(), "Mixer_OpenGL");
@@ -1044,6 +1167,9 @@ void Mixer::thread_func()
 			if (new_frame->upload_func) {
 				new_frame->upload_func();
 				new_frame->upload_func = nullptr;
+			} else if (new_frame->pending_upload) {
+				wait_for_upload(new_frame->pending_upload.get());
+				new_frame->pending_upload.reset();
 			}
 		}
 
@@ -1085,38 +1211,28 @@ bool Mixer::input_card_is_master_clock(unsigned card_index, unsigned master_card
 	return (card_index == master_card_index);
 }
 
-void Mixer::trim_queue(CaptureCard *card, size_t safe_queue_length)
+size_t Mixer::update_jitter_history(CaptureCard *card)
 {
-	// Count the number of frames in the queue, including any frames
-	// we dropped. It's hard to know exactly how we should deal with
-	// dropped (corrupted) input frames; they don't help our goal of
-	// avoiding starvation, but they still add to the problem of latency.
-	// Since dropped frames is going to mean a bump in the signal anyway,
-	// we err on the side of having more stable latency instead.
-	unsigned queue_length = 0;
-	for (const CaptureCard::NewFrame &frame : card->new_frames) {
-		queue_length += frame.dropped_frames + 1;
-	}
-
-	// If needed, drop frames until the queue is below the safe limit.
-	// We prefer to drop from the head, because all else being equal,
-	// we'd like more recent frames (less latency).
-	unsigned dropped_frames = 0;
-	while (queue_length > safe_queue_length) {
-		assert(!card->new_frames.empty());
-		assert(queue_length > card->new_frames.front().dropped_frames);
-		queue_length -= card->new_frames.front().dropped_frames;
-
-		if (queue_length <= safe_queue_length) {
-			// No need to drop anything.
-			break;
+	// The jitter history is only touched from the mixer thread, so we feed it
+	// here instead of when the frames arrive. It sees exactly the same
+	// timestamps either way. Frames that come in after this will be dealt
+	// with next time; the caller should not look at them until then,
+	// so that we never drop a frame that the jitter history has not seen.
+	const size_t queue_length_frames = card->new_frames.size();
+	for (size_t i = 0; i < queue_length_frames; ++i) {
+		CaptureCard::NewFrame &frame = card->new_frames.at(i);
+		if (!frame.in_jitter_history) {
+			card->jitter_history.frame_arrived(frame.received_timestamp, frame.length, frame.dropped_frames);
+			frame.in_jitter_history = true;
 		}
-
-		card->new_frames.pop_front();
-		card->new_frames_changed.notify_all();
-		--queue_length;
-		++dropped_frames;
 	}
+	return queue_length_frames;
+}
+
+void Mixer::trim_queue(CaptureCard *card, size_t queue_length_frames, size_t safe_queue_length)
+{
+	unsigned queue_length;
+	unsigned dropped_frames = ::trim_queue(&card->new_frames, queue_length_frames, safe_queue_length, &queue_length);
 
 	card->metric_input_dropped_frames_jitter += dropped_frames;
 	card->metric_input_queue_length_frames = queue_length;
@@ -1129,6 +1245,21 @@ void Mixer::trim_queue(CaptureCard *card, size_t safe_queue_length)
 #endif
 }
 
+unique_lock<mutex> Mixer::lock_card_mutex()
+{
+	// Histogram only supports one writer, so this is only for the mixer thread
+	// (which is also the thread we care about not blocking).
+	unique_lock<mutex> lock(card_mutex, try_to_lock);
+	if (lock.owns_lock()) {
+		metric_card_mutex_wait_seconds.count_event(0.0);
+	} else {
+		steady_clock::time_point start = steady_clock::now();
+		lock.lock();
+		metric_card_mutex_wait_seconds.count_event(duration<double>(steady_clock::now() - start).count());
+	}
+	return lock;
+}
+
 pair<string, string> Mixer::get_channels_json()
 {
 	Channels ret;
@@ -1152,39 +1283,43 @@ Mixer::OutputFrameInfo Mixer::get_one_frame_from_each_card(unsigned master_card_
 {
 	OutputFrameInfo output_frame_info;
 start:
-	unique_lock<mutex> lock(card_mutex, defer_lock);
 	if (master_card_is_output) {
 		// Clocked to the output, so wait for it to be ready for the next frame.
 		cards[master_card_index].output->wait_for_frame(pts_int, &output_frame_info.dropped_frames, &output_frame_info.frame_duration, &output_frame_info.is_preroll, &output_frame_info.frame_timestamp);
-		lock.lock();
 	} else {
 		// Wait for the master card to have a new frame.
 		// TODO: Add a timeout.
 		output_frame_info.is_preroll = false;
-		lock.lock();
-		cards[master_card_index].new_frames_changed.wait(lock, [this, master_card_index]{ return !cards[master_card_index].new_frames.empty() || cards[master_card_index].capture->get_disconnected(); });
+		CaptureCard *master_card = &cards[master_card_index];
+		unique_lock<mutex> lock(master_card->new_frames_mutex);
+		master_card->new_frames_changed.wait(lock, [master_card]{ return !master_card->new_frames.empty() || master_card->capture->get_disconnected(); });
 	}
 
 	if (master_card_is_output) {
+		unique_lock<mutex> lock = lock_card_mutex();
 		handle_hotplugged_cards();
 	} else if (cards[master_card_index].new_frames.empty()) {
 		// We were woken up, but not due to a new frame. Deal with it
 		// and then restart.
 		assert(cards[master_card_index].capture->get_disconnected());
-		handle_hotplugged_cards();
-		lock.unlock();
+		{
+			unique_lock<mutex> lock = lock_card_mutex();
+			handle_hotplugged_cards();
+		}
 		goto start;
 	}
 
+	size_t queue_length_frames[MAX_VIDEO_CARDS];
 	for (unsigned card_index = 0; card_index < num_cards + num_video_inputs + num_html_inputs; ++card_index) {
 		CaptureCard *card = &cards[card_index];
-		if (card->new_frames.empty()) {  // Starvation.
+		queue_length_frames[card_index] = update_jitter_history(card);
+		if (queue_length_frames[card_index] == 0) {  // Starvation.
 			++card->metric_input_duped_frames;
 		} else {
 			new_frames[card_index] = move(card->new_frames.front());
 			has_new_frame[card_index] = true;
-			card->new_frames.pop_front();
-			card->new_frames_changed.notify_all();
+			card->new_frames.pop();
+			--queue_length_frames[card_index];
 		}
 	}
 
@@ -1210,8 +1345,9 @@ start:
 				output_frame_info.frame_duration,
 				card->jitter_history.estimate_max_jitter(),
 				output_jitter_history.estimate_max_jitter());
-			trim_queue(card, min<int>(global_flags.max_input_queue_frames,
-			                          card->queue_length_policy.get_safe_queue_length()));
+			trim_queue(card, queue_length_frames[card_index],
+			           min<int>(global_flags.max_input_queue_frames,
+			                    card->queue_length_policy.get_safe_queue_length()));
 		}
 	}
 
@@ -1316,7 +1452,7 @@ void Mixer::render_one_frame(int64_t duration)
 
 	// Update Y'CbCr settings for all cards.
 	{
-		unique_lock<mutex> lock(card_mutex);
+		unique_lock<mutex> lock = lock_card_mutex();
 		for (unsigned card_index = 0; card_index < num_cards; ++card_index) {
 			YCbCrInterpretation *interpretation = &ycbcr_interpretation[card_index];
 			input_state.ycbcr_coefficients_auto[card_index] = interpretation->ycbcr_coefficients_auto;
@@ -1465,6 +1601,10 @@ void Mixer::audio_thread_func()
 {
 	pthread_setname_np(pthread_self(), "Mixer_Audio");
 
+	// Reused from frame to frame, so that we don't need to allocate
+	// once it is big enough. The consumers below only borrow it.
+	vector<float> samples_out;
+
 	while (!should_quit) {
 		AudioTask task;
 
@@ -1480,10 +1620,11 @@ void Mixer::audio_thread_func()
 
 		ResamplingQueue::RateAdjustmentPolicy rate_adjustment_policy =
 			task.adjust_rate ? ResamplingQueue::ADJUST_RATE : ResamplingQueue::DO_NOT_ADJUST_RATE;
-		vector<float> samples_out = audio_mixer.get_output(
+		audio_mixer.get_output(
 			task.frame_timestamp,
 			task.num_samples,
-			rate_adjustment_policy);
+			rate_adjustment_policy,
+			&samples_out);
 
 		// Send the samples to the sound card, then add them to the output.
 		if (alsa) {
@@ -1493,7 +1634,7 @@ void Mixer::audio_thread_func()
 			const int64_t av_delay = lrint(global_flags.audio_queue_length_ms * 0.001 * TIMEBASE);  // Corresponds to the delay in ResamplingQueue.
 			cards[output_card_index].output->send_audio(task.pts_int + av_delay, samples_out);
 		}
-		video_encoder->add_audio(task.pts_int, move(samples_out));
+		video_encoder->add_audio(task.pts_int, samples_out);
 	}
 }
 
@@ -1511,6 +1652,10 @@ void Mixer::start()
 {
 	mixer_thread = thread(&Mixer::thread_func, this);
 	audio_thread = thread(&Mixer::audio_thread_func, this);
+	field_release_thread = thread(&Mixer::field_release_thread_func, this);
+	if (global_flags.gl_upload_thread) {
+		upload_thread = thread(&Mixer::upload_thread_func, this);
+	}
 }
 
 void Mixer::quit()
@@ -14,6 +14,7 @@
 #include <chrono>
 #include <condition_variable>
 #include <cstddef>
+#include <deque>
 #include <functional>
 #include <map>
 #include <memory>
@@ -31,9 +32,12 @@
 #include "httpd.h"
 #include "input_state.h"
 #include "libusb.h"
+#include "metrics.h"
 #include "pbo_frame_allocator.h"
+#include "queue_length_policy.h"
 #include "ref_counted_frame.h"
 #include "ref_counted_gl_sync.h"
+#include "spsc_queue.h"
 #include "theme.h"
 #include "timebase.h"
 #include "video_encoder.h"
@@ -54,105 +58,6 @@ class ResourcePool;
 class YCbCrInput;
 }  // namespace movit
 
-// A class to estimate the future jitter. Used in QueueLengthPolicy (see below).
-//
-// There are many ways to estimate jitter; I've tested a few ones (and also
-// some algorithms that don't explicitly model jitter) with different
-// parameters on some real-life data in experiments/queue_drop_policy.cpp.
-// This is one based on simple order statistics where I've added some margin in
-// the number of starvation events; I believe that about one every hour would
-// probably be acceptable, but this one typically goes lower than that, at the
-// cost of 2–3 ms extra latency. (If the queue is hard-limited to one frame, it's
-// possible to get ~10 ms further down, but this would mean framedrops every
-// second or so.) The general strategy is: Take the 99.9-percentile jitter over
-// last 5000 frames, multiply by two, and that's our worst-case jitter
-// estimate. The fact that we're not using the max value means that we could
-// actually even throw away very late frames immediately, which means we only
-// get one user-visible event instead of seeing something both when the frame
-// arrives late (duplicate frame) and then again when we drop.
-class JitterHistory {
-private:
-	static constexpr size_t history_length = 5000;
-	static constexpr double percentile = 0.999;
-	static constexpr double multiplier = 2.0;
-
-public:
-	void register_metrics(const std::vector<std::pair<std::string, std::string>> &labels);
-	void unregister_metrics(const std::vector<std::pair<std::string, std::string>> &labels);
-
-	void clear() {
-		history.clear();
-		orders.clear();
-	}
-	void frame_arrived(std::chrono::steady_clock::time_point now, int64_t frame_duration, size_t dropped_frames);
-	std::chrono::steady_clock::time_point get_expected_next_frame() const { return expected_timestamp; }
-	double estimate_max_jitter() const;
-
-private:
-	// A simple O(k) based algorithm for getting the k-th largest or
-	// smallest element from our window; we simply keep the multiset
-	// ordered (insertions and deletions are O(n) as always) and then
-	// iterate from one of the sides. If we had larger values of k,
-	// we could go for a more complicated setup with two sets or heaps
-	// (one increasing and one decreasing) that we keep balanced around
-	// the point, or it is possible to reimplement std::set with
-	// counts in each node. However, since k=5, we don't need this.
-	std::multiset<double> orders;
-	std::deque<std::multiset<double>::iterator> history;
-
-	std::chrono::steady_clock::time_point expected_timestamp = std::chrono::steady_clock::time_point::min();
-
-	// Metrics. There are no direct summaries for jitter, since we already have latency summaries.
-	std::atomic<int64_t> metric_input_underestimated_jitter_frames{0};
-	std::atomic<double> metric_input_estimated_max_jitter_seconds{0.0 / 0.0};
-};
-
-// For any card that's not the master (where we pick out the frames as they
-// come, as fast as we can process), there's going to be a queue. The question
-// is when we should drop frames from that queue (apart from the obvious
-// dropping if the 16-frame queue should become full), especially given that
-// the frame rate could be lower or higher than the master (either subtly or
-// dramatically). We have two (conflicting) demands:
-//
-//   1. We want to avoid starving the queue.
-//   2. We don't want to add more delay than is needed.
-//
-// Our general strategy is to drop as many frames as we can (helping for #2)
-// that we think is safe for #1 given jitter. To this end, we measure the
-// deviation from the expected arrival time for all cards, and use that for
-// continuous jitter estimation.
-//
-// We then drop everything from the queue that we're sure we won't need to
-// serve the output in the time before the next frame arrives. Typically,
-// this means the queue will contain 0 or 1 frames, although more is also
-// possible if the jitter is very high.
-class QueueLengthPolicy {
-public:
-	QueueLengthPolicy() {}
-	void reset(unsigned card_index) {
-		this->card_index = card_index;
-	}
-
-	void register_metrics(const std::vector<std::pair<std::string, std::string>> &labels);
-	void unregister_metrics(const std::vector<std::pair<std::string, std::string>> &labels);
-
-	// Call after picking out a frame, so 0 means starvation.
-	void update_policy(std::chrono::steady_clock::time_point now,
-	                   std::chrono::steady_clock::time_point expected_next_frame,
-			   int64_t input_frame_duration,
-	                   int64_t master_frame_duration,
-	                   double max_input_card_jitter_seconds,
-	                   double max_master_card_jitter_seconds);
-	unsigned get_safe_queue_length() const { return safe_queue_length; }
-
-private:
-	unsigned card_index;  // For debugging and metrics only.
-	unsigned safe_queue_length = 0;  // Can never go below zero.
-
-	// Metrics.
-	std::atomic<int64_t> metric_input_queue_safe_length_frames{1};
-};
-
 class Mixer {
 public:
 	// The surface format is used for offscreen destinations for OpenGL contexts we need.
@@ -437,7 +342,9 @@ private:
 	void audio_thread_func();
 	void release_display_frame(DisplayFrame *frame);
 	double pts() { return double(pts_int) / TIMEBASE; }
-	void trim_queue(CaptureCard *card, size_t safe_queue_length);
+	size_t update_jitter_history(CaptureCard *card);
+	void trim_queue(CaptureCard *card, size_t queue_length_frames, size_t safe_queue_length);
+	std::unique_lock<std::mutex> lock_card_mutex();
 	std::pair<std::string, std::string> get_channels_json();
 	std::pair<std::string, std::string> get_channel_color_http(unsigned channel_idx);
 
@@ -479,8 +386,27 @@ private:
 	// frame rate is integer, will always stay zero.
 	unsigned fractional_samples = 0;
 
+	// Protects reconfiguration of the cards (ie., changing what is in <cards>,
+	// as opposed to the frames flowing through it), and <ycbcr_interpretation>.
+	// The frame queues do not need it; see CaptureCard::new_frames.
 	mutable std::mutex card_mutex;
+	Histogram metric_card_mutex_wait_seconds;  // Only measured on the mixer thread; see lock_card_mutex().
 	bool has_bmusb_thread = false;
+
+	// With --gl-upload-thread, the texture uploads are run on their own thread
+	// (with its own OpenGL context) as soon as the frames come in, instead of
+	// on the mixer thread right before rendering. The mixer thread then only
+	// needs to wait for <fence> on the GPU, which is usually long signaled.
+	struct PendingUpload {
+		std::function<void()> upload_func;
+		RefCountedFrame frame;  // So that the frame data cannot go away before <upload_func> has run.
+
+		std::mutex mu;
+		std::condition_variable done_changed;
+		bool done = false;  // Under <mu>.
+		RefCountedGLsync fence;  // Set by the upload thread before <done>.
+	};
+
 	struct CaptureCard {
 		std::unique_ptr<bmusb::CaptureInterface> capture;
 		bool is_fake_capture;
@@ -505,12 +431,32 @@ private:
 			bool interlaced;
 			unsigned field;  // Which field (0 or 1) of the frame to use. Always 0 for progressive.
 			std::function<void()> upload_func;  // Needs to be called to actually upload the texture to OpenGL.
+			std::shared_ptr<PendingUpload> pending_upload;  // Used instead of <upload_func> with --gl-upload-thread.
 			unsigned dropped_frames = 0;  // Number of dropped frames before this one.
 			std::chrono::steady_clock::time_point received_timestamp = std::chrono::steady_clock::time_point::min();
+			bool in_jitter_history = false;  // Set by the mixer thread; see update_jitter_history().
 		};
-		std::deque<NewFrame> new_frames;
-		bool should_quit = false;
-		std::condition_variable new_frames_changed;  // Set whenever new_frames (or should_quit) is changed.
+
+		// Pushed to by the card's capture thread (in bm_frame()), popped and
+		// trimmed by the mixer thread; nobody else may touch it. The mixer
+		// thread can clear it in configure_card(), since the capture thread
+		// is stopped then. The capacity is much more than we'd ever keep
+		// (the frame allocators don't have that many frames), so if it gets
+		// full, something is stuck and we just drop new frames.
+		SPSCQueue<NewFrame, 64> new_frames;
+
+		// Fields from this card that are waiting in the field release thread,
+		// and the release time of the last one. As long as there are any,
+		// the field release thread is the producer for <new_frames>, not the
+		// capture thread. Under <delayed_frames_mutex>.
+		unsigned num_delayed_frames = 0;
+		std::chrono::steady_clock::time_point last_release_time;
+
+		// Only used for waking up the mixer thread when it waits for this card
+		// (ie., when it is the master card). The mutex protects no data.
+		std::mutex new_frames_mutex;
+		std::condition_variable new_frames_changed;  // Set whenever new_frames gets a new frame (or should_quit is set).
+		bool should_quit = false;  // Under <new_frames_mutex>.
 
 		QueueLengthPolicy queue_length_policy;  // Refers to the "new_frames" queue.
 
@@ -537,7 +483,7 @@ private:
 		std::atomic<int64_t> metric_input_sample_rate_hz{-1};
 	};
 	JitterHistory output_jitter_history;
-	CaptureCard cards[MAX_VIDEO_CARDS];  // Protected by <card_mutex>.
+	CaptureCard cards[MAX_VIDEO_CARDS];  // Reconfiguration protected by <card_mutex>.
 	YCbCrInterpretation ycbcr_interpretation[MAX_VIDEO_CARDS];  // Protected by <card_mutex>.
 	AudioMixer audio_mixer;  // Same as global_audio_mixer (see audio_mixer.h).
 	bool input_card_is_master_clock(unsigned card_index, unsigned master_card_index) const;
@@ -549,6 +495,8 @@ private:
 		std::chrono::steady_clock::time_point frame_timestamp;
 	};
 	OutputFrameInfo get_one_frame_from_each_card(unsigned master_card_index, bool master_card_is_output, CaptureCard::NewFrame new_frames[MAX_VIDEO_CARDS], bool has_new_frame[MAX_VIDEO_CARDS]);
+	void release_new_frame(unsigned card_index, CaptureCard::NewFrame &&new_frame, std::chrono::steady_clock::time_point release_time);  // From the capture thread.
+	void push_new_frame(unsigned card_index, CaptureCard::NewFrame &&new_frame);  // From the producer; see CaptureCard::num_delayed_frames.
 
 	InputState input_state;
 
@@ -588,6 +536,37 @@ private:
 
 	std::thread mixer_thread;
 	std::thread audio_thread;
+
+	// The second field of interlaced frames is released to the mixer about
+	// half a frame after the first (see bm_frame()). Instead of having the
+	// capture threads sleep until then, they hand the field to the field
+	// release thread, which pushes it at the right time. There is never more
+	// than a field or two per card waiting, so a sorted deque is plenty.
+	struct DelayedFrame {
+		std::chrono::steady_clock::time_point release_time;
+		unsigned card_index;
+		CaptureCard::NewFrame new_frame;
+	};
+	void field_release_thread_func();
+	std::thread field_release_thread;
+	std::mutex delayed_frames_mutex;
+	std::condition_variable delayed_frames_changed;
+	std::deque<DelayedFrame> delayed_frames;  // Sorted by release time. Under <delayed_frames_mutex>.
+	bool field_release_should_quit = false;  // Under <delayed_frames_mutex>.
+	Histogram metric_field_release_lateness_seconds;  // Only measured on the field release thread.
+
+	// See PendingUpload. Only used with --gl-upload-thread.
+	void upload_thread_func();
+	void queue_upload(std::shared_ptr<PendingUpload> upload);  // From push_new_frame().
+	void wait_for_upload(PendingUpload *upload);  // From the mixer thread.
+	std::thread upload_thread;
+	QSurface *upload_surface = nullptr;
+	std::mutex upload_queue_mutex;
+	std::condition_variable upload_queue_changed;
+	std::queue<std::shared_ptr<PendingUpload>> upload_queue;  // Under <upload_queue_mutex>.
+	bool upload_thread_should_quit = false;  // Under <upload_queue_mutex>.
+	Histogram metric_upload_wait_seconds;  // Only measured on the mixer thread.
+
 	std::atomic<bool> should_quit{false};
 	std::atomic<bool> should_cut{false};
 
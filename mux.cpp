@@ -51,45 +51,49 @@ struct PacketBefore {
 Mux::Mux(AVFormatContext *avctx, int width, int height, Codec video_codec, const string &video_extradata, const AVCodecParameters *audio_codecpar, int time_base, std::function<void(int64_t)> write_callback, WriteStrategy write_strategy, const vector<MuxMetrics *> &metrics)
 	: write_strategy(write_strategy), avctx(avctx), write_callback(write_callback), metrics(metrics)
 {
-	avstream_video = avformat_new_stream(avctx, nullptr);
-	if (avstream_video == nullptr) {
-		fprintf(stderr, "avformat_new_stream() failed\n");
-		exit(1);
-	}
-	avstream_video->time_base = AVRational{1, time_base};
-	avstream_video->codecpar->codec_type = AVMEDIA_TYPE_VIDEO;
-	if (video_codec == CODEC_H264) {
-		avstream_video->codecpar->codec_id = AV_CODEC_ID_H264;
+	if (video_codec == CODEC_NONE) {
+		avstream_video = nullptr;
 	} else {
-		assert(video_codec == CODEC_NV12);
-		avstream_video->codecpar->codec_id = AV_CODEC_ID_RAWVIDEO;
-		avstream_video->codecpar->codec_tag = avcodec_pix_fmt_to_codec_tag(AV_PIX_FMT_NV12);
-	}
-	avstream_video->codecpar->width = width;
-	avstream_video->codecpar->height = height;
+		avstream_video = avformat_new_stream(avctx, nullptr);
+		if (avstream_video == nullptr) {
+			fprintf(stderr, "avformat_new_stream() failed\n");
+			exit(1);
+		}
+		avstream_video->time_base = AVRational{1, time_base};
+		avstream_video->codecpar->codec_type = AVMEDIA_TYPE_VIDEO;
+		if (video_codec == CODEC_H264) {
+			avstream_video->codecpar->codec_id = AV_CODEC_ID_H264;
+		} else {
+			assert(video_codec == CODEC_NV12);
+			avstream_video->codecpar->codec_id = AV_CODEC_ID_RAWVIDEO;
+			avstream_video->codecpar->codec_tag = avcodec_pix_fmt_to_codec_tag(AV_PIX_FMT_NV12);
+		}
+		avstream_video->codecpar->width = width;
+		avstream_video->codecpar->height = height;
 
-	// Colorspace details. Closely correspond to settings in EffectChain_finalize,
-	// as noted in each comment.
-	// Note that the H.264 stream also contains this information and depending on the
-	// mux, this might simply get ignored. See sps_rbsp().
-	// Note that there's no way to change this per-frame as the H.264 stream
-	// would like to be able to.
-	avstream_video->codecpar->color_primaries = AVCOL_PRI_BT709;  // RGB colorspace (inout_format.color_space).
-	avstream_video->codecpar->color_trc = AVCOL_TRC_IEC61966_2_1;  // Gamma curve (inout_format.gamma_curve).
-	// YUV colorspace (output_ycbcr_format.luma_coefficients).
-	if (global_flags.ycbcr_rec709_coefficients) {
-		avstream_video->codecpar->color_space = AVCOL_SPC_BT709;
-	} else {
-		avstream_video->codecpar->color_space = AVCOL_SPC_SMPTE170M;
-	}
-	avstream_video->codecpar->color_range = AVCOL_RANGE_MPEG;  // Full vs. limited range (output_ycbcr_format.full_range).
-	avstream_video->codecpar->chroma_location = AVCHROMA_LOC_LEFT;  // Chroma sample location. See chroma_offset_0[] in Mixer::subsample_chroma().
-	avstream_video->codecpar->field_order = AV_FIELD_PROGRESSIVE;
+		// Colorspace details. Closely correspond to settings in EffectChain_finalize,
+		// as noted in each comment.
+		// Note that the H.264 stream also contains this information and depending on the
+		// mux, this might simply get ignored. See sps_rbsp().
+		// Note that there's no way to change this per-frame as the H.264 stream
+		// would like to be able to.
+		avstream_video->codecpar->color_primaries = AVCOL_PRI_BT709;  // RGB colorspace (inout_format.color_space).
+		avstream_video->codecpar->color_trc = AVCOL_TRC_IEC61966_2_1;  // Gamma curve (inout_format.gamma_curve).
+		// YUV colorspace (output_ycbcr_format.luma_coefficients).
+		if (global_flags.ycbcr_rec709_coefficients) {
+			avstream_video->codecpar->color_space = AVCOL_SPC_BT709;
+		} else {
+			avstream_video->codecpar->color_space = AVCOL_SPC_SMPTE170M;
+		}
+		avstream_video->codecpar->color_range = AVCOL_RANGE_MPEG;  // Full vs. limited range (output_ycbcr_format.full_range).
+		avstream_video->codecpar->chroma_location = AVCHROMA_LOC_LEFT;  // Chroma sample location. See chroma_offset_0[] in Mixer::subsample_chroma().
+		avstream_video->codecpar->field_order = AV_FIELD_PROGRESSIVE;
 
-	if (!video_extradata.empty()) {
-		avstream_video->codecpar->extradata = (uint8_t *)av_malloc(video_extradata.size());
-		avstream_video->codecpar->extradata_size = video_extradata.size();
-		memcpy(avstream_video->codecpar->extradata, video_extradata.data(), video_extradata.size());
+		if (!video_extradata.empty()) {
+			avstream_video->codecpar->extradata = (uint8_t *)av_malloc(video_extradata.size());
+			avstream_video->codecpar->extradata_size = video_extradata.size();
+			memcpy(avstream_video->codecpar->extradata, video_extradata.data(), video_extradata.size());
+		}
 	}
 
 	avstream_audio = avformat_new_stream(avctx, nullptr);
@@ -153,6 +157,7 @@ void Mux::add_packet(const AVPacket &pkt, int64_t pts, int64_t dts, AVRational t
 		exit(1);
 	}
 	if (pkt.stream_index == 0) {
+		assert(avstream_video != nullptr);
 		pkt_copy.pts = av_rescale_q(pts, timebase, avstream_video->time_base);
 		pkt_copy.dts = av_rescale_q(dts, timebase, avstream_video->time_base);
 		pkt_copy.duration = av_rescale_q(pkt.duration, timebase, avstream_video->time_base);
@@ -160,6 +165,7 @@ void Mux::add_packet(const AVPacket &pkt, int64_t pts, int64_t dts, AVRational t
 		pkt_copy.pts = av_rescale_q(pts, timebase, avstream_audio->time_base);
 		pkt_copy.dts = av_rescale_q(dts, timebase, avstream_audio->time_base);
 		pkt_copy.duration = av_rescale_q(pkt.duration, timebase, avstream_audio->time_base);
+		pkt_copy.stream_index = avstream_audio->index;  // 0 if there is no video stream.
 	} else {
 		assert(false);
 	}
@@ -181,13 +187,13 @@ void Mux::add_packet(const AVPacket &pkt, int64_t pts, int64_t dts, AVRational t
 
 void Mux::write_packet_or_die(const AVPacket &pkt, int64_t unscaled_pts)
 {
+	const bool is_video = (avstream_video != nullptr && pkt.stream_index == avstream_video->index);
 	for (MuxMetrics *metric : metrics) {
-		if (pkt.stream_index == 0) {
+		if (is_video) {
 			metric->metric_video_bytes += pkt.size;
-		} else if (pkt.stream_index == 1) {
-			metric->metric_audio_bytes += pkt.size;
 		} else {
-			assert(false);
+			assert(pkt.stream_index == avstream_audio->index);
+			metric->metric_audio_bytes += pkt.size;
 		}
 	}
 	int64_t old_pos = avctx->pb->pos;
@@ -200,7 +206,7 @@ void Mux::write_packet_or_die(const AVPacket &pkt, int64_t unscaled_pts)
 		metric->metric_written_bytes += avctx->pb->pos - old_pos;
 	}
 
-	if (pkt.stream_index == 0 && write_callback != nullptr) {
+	if (is_video && write_callback != nullptr) {
 		write_callback(unscaled_pts);
 	}
 }
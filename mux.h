@@ -42,6 +42,7 @@ public:
 	enum Codec {
 		CODEC_H264,
 		CODEC_NV12,  // Uncompressed 4:2:0.
+		CODEC_NONE,  // No video stream at all; width, height and video_extradata are ignored.
 	};
 	enum WriteStrategy {
 		// add_packet() will write the packet immediately, unless plugged.
@@ -58,6 +59,8 @@ public:
 	// Takes ownership of avctx. <write_callback> will be called every time
 	// a write has been made to the video stream (id 0), with the pts of
 	// the just-written frame. (write_callback can be nullptr.)
+	// Packets given to add_packet() should have stream_index 0 for video
+	// and 1 for audio, even if video_codec is CODEC_NONE.
 	// Does not take ownership of <metrics>; elements in there, if any,
 	// will be added to.
 	Mux(AVFormatContext *avctx, int width, int height, Codec video_codec, const std::string &video_extradata, const AVCodecParameters *audio_codecpar, int time_base, std::function<void(int64_t)> write_callback, WriteStrategy write_strategy, const std::vector<MuxMetrics *> &metrics);
@@ -100,7 +103,7 @@ private:
 	std::vector<QueuedPacket> packet_queue;
 	std::condition_variable packet_queue_ready;
 
-	AVStream *avstream_video, *avstream_audio;
+	AVStream *avstream_video, *avstream_audio;  // avstream_video is nullptr if there is no video.
 
 	std::function<void(int64_t)> write_callback;
 	std::vector<MuxMetrics *> metrics;
@@ -0,0 +1,150 @@
+#include "queue_length_policy.h"
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+
+#include "metrics.h"
+#include "timebase.h"
+
+using namespace std;
+using namespace std::chrono;
+
+void JitterHistory::register_metrics(const vector<pair<string, string>> &labels)
+{
+	global_metrics.add("input_underestimated_jitter_frames", labels, &metric_input_underestimated_jitter_frames);
+	global_metrics.add("input_estimated_max_jitter_seconds", labels, &metric_input_estimated_max_jitter_seconds, Metrics::TYPE_GAUGE);
+}
+
+void JitterHistory::unregister_metrics(const vector<pair<string, string>> &labels)
+{
+	global_metrics.remove("input_underestimated_jitter_frames", labels);
+	global_metrics.remove("input_estimated_max_jitter_seconds", labels);
+}
+
+void JitterHistory::clear()
+{
+	memset(bucket_counts, 0, sizeof(bucket_counts));
+	top_bucket = 0;
+	history_start = history_size = 0;
+	max_jitter_estimate = 0.0;
+}
+
+void JitterHistory::frame_arrived(steady_clock::time_point now, int64_t frame_duration, size_t dropped_frames)
+{
+	if (expected_timestamp > steady_clock::time_point::min()) {
+		expected_timestamp += dropped_frames * nanoseconds(frame_duration * 1000000000 / TIMEBASE);
+		double jitter_seconds = fabs(duration<double>(expected_timestamp - now).count());
+
+		// Insert the new value. If the window is already full, the oldest
+		// value is evicted only after we've estimated with the new one
+		// (so that we temporarily count history_length + 1 values),
+		// but its slot in <history> is reused right away.
+		size_t evicted_bucket = 0;
+		if (history_size == history_length) {
+			evicted_bucket = history[history_start];
+		}
+		size_t bucket = find_bucket(jitter_seconds);
+		if (history_size == 0 || bucket > top_bucket) {
+			top_bucket = bucket;
+		}
+		++bucket_counts[bucket];
+		history[(history_start + history_size) % history_length] = bucket;
+		++history_size;
+
+		update_estimate();
+		if (jitter_seconds > estimate_max_jitter()) {
+			++metric_input_underestimated_jitter_frames;
+		}
+
+		metric_input_estimated_max_jitter_seconds = estimate_max_jitter();
+
+		if (history_size > history_length) {
+			--bucket_counts[evicted_bucket];
+			while (bucket_counts[top_bucket] == 0) {
+				assert(top_bucket > 0);
+				--top_bucket;
+			}
+			history_start = (history_start + 1) % history_length;
+			--history_size;
+			update_estimate();
+		}
+		assert(history_size <= history_length);
+	}
+	expected_timestamp = now + nanoseconds(frame_duration * 1000000000 / TIMEBASE);
+}
+
+size_t JitterHistory::find_bucket(double jitter_seconds)
+{
+	if (!(jitter_seconds >= min_jitter_seconds)) {
+		return 0;
+	}
+	size_t bucket = floor(log(jitter_seconds / min_jitter_seconds) / log(bucket_growth));
+	return min<size_t>(bucket, num_buckets - 1);
+}
+
+void JitterHistory::update_estimate()
+{
+	if (history_size == 0) {
+		max_jitter_estimate = 0.0;
+		return;
+	}
+
+	// Find the bucket of the element at <elem_idx> in sorted order,
+	// counting from the top (the percentile is always high).
+	size_t elem_idx = lrint((history_size - 1) * percentile);
+	size_t num_above = history_size - 1 - elem_idx;
+	size_t bucket = top_bucket;
+	for (size_t seen = bucket_counts[bucket]; seen <= num_above; seen += bucket_counts[bucket]) {
+		assert(bucket > 0);
+		--bucket;
+	}
+	max_jitter_estimate = min_jitter_seconds * pow(bucket_growth, bucket + 1) * multiplier;
+}
+
+void QueueLengthPolicy::register_metrics(const vector<pair<string, string>> &labels)
+{
+	global_metrics.add("input_queue_safe_length_frames", labels, &metric_input_queue_safe_length_frames, Metrics::TYPE_GAUGE);
+}
+
+void QueueLengthPolicy::unregister_metrics(const vector<pair<string, string>> &labels)
+{
+	global_metrics.remove("input_queue_safe_length_frames", labels);
+}
+
+void QueueLengthPolicy::update_policy(steady_clock::time_point now,
+                                      steady_clock::time_point expected_next_frame,
+                                      int64_t input_frame_duration,
+                                      int64_t master_frame_duration,
+                                      double max_input_card_jitter_seconds,
+                                      double max_master_card_jitter_seconds)
+{
+	double input_frame_duration_seconds = input_frame_duration / double(TIMEBASE);
+	double master_frame_duration_seconds = master_frame_duration / double(TIMEBASE);
+
+	// Figure out when we can expect the next frame for this card, assuming
+	// worst-case jitter (ie., the frame is maximally late).
+	double seconds_until_next_frame = max(duration<double>(expected_next_frame - now).count() + max_input_card_jitter_seconds, 0.0);
+
+	// How many times are the master card expected to tick in that time?
+	// We assume the master clock has worst-case jitter but not any rate
+	// discrepancy, ie., it ticks as early as possible every time, but not
+	// cumulatively.
+	double frames_needed = (seconds_until_next_frame + max_master_card_jitter_seconds) / master_frame_duration_seconds;
+
+	// As a special case, if the master card ticks faster than the input card,
+	// we expect the queue to drain by itself even without dropping. But if
+	// the difference is small (e.g. 60 Hz master and 59.94 input), it would
+	// go slowly enough that the effect wouldn't really be appreciable.
+	// We account for this by looking at the situation five frames ahead,
+	// assuming everything else is the same.
+	double frames_allowed;
+	if (master_frame_duration < input_frame_duration) {
+		frames_allowed = frames_needed + 5 * (input_frame_duration_seconds - master_frame_duration_seconds) / master_frame_duration_seconds;
+	} else {
+		frames_allowed = frames_needed;
+	}
+
+	safe_queue_length = max<int>(floor(frames_allowed), 0);
+	metric_input_queue_safe_length_frames = safe_queue_length;
+}
@@ -0,0 +1,174 @@
+#ifndef _QUEUE_LENGTH_POLICY_H
+#define _QUEUE_LENGTH_POLICY_H 1
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <utility>
+#include <vector>
+
+// A class to estimate the future jitter. Used in QueueLengthPolicy (see below).
+//
+// There are many ways to estimate jitter; I've tested a few ones (and also
+// some algorithms that don't explicitly model jitter) with different
+// parameters on some real-life data in experiments/queue_drop_policy.cpp.
+// (To measure the code that is actually in use, replay a frame log through
+// replay_frame_log instead.)
+// This is one based on simple order statistics where I've added some margin in
+// the number of starvation events; I believe that about one every hour would
+// probably be acceptable, but this one typically goes lower than that, at the
+// cost of 2–3 ms extra latency. (If the queue is hard-limited to one frame, it's
+// possible to get ~10 ms further down, but this would mean framedrops every
+// second or so.) The general strategy is: Take the 99.9-percentile jitter over
+// last 5000 frames, multiply by two, and that's our worst-case jitter
+// estimate. The fact that we're not using the max value means that we could
+// actually even throw away very late frames immediately, which means we only
+// get one user-visible event instead of seeing something both when the frame
+// arrives late (duplicate frame) and then again when we drop.
+class JitterHistory {
+private:
+	static constexpr size_t history_length = 5000;
+	static constexpr double percentile = 0.999;
+	static constexpr double multiplier = 2.0;
+
+	// We don't keep the actual jitter values, only a histogram of them,
+	// with logarithmically spaced buckets; bucket i holds the values from
+	// min_jitter_seconds * bucket_growth^i up to the next bucket. (Everything
+	// below min_jitter_seconds goes into bucket 0, and everything above
+	// the last bucket, about 20 seconds, goes into the last one.)
+	// We then estimate any value by the upper edge of its bucket, so the
+	// estimate is never lower than the exact percentile, and at most 1% higher.
+	static constexpr double min_jitter_seconds = 1e-6;
+	static constexpr double bucket_growth = 1.01;
+	static constexpr size_t num_buckets = 1700;
+
+public:
+	void register_metrics(const std::vector<std::pair<std::string, std::string>> &labels);
+	void unregister_metrics(const std::vector<std::pair<std::string, std::string>> &labels);
+
+	void clear();
+	void frame_arrived(std::chrono::steady_clock::time_point now, int64_t frame_duration, size_t dropped_frames);
+	std::chrono::steady_clock::time_point get_expected_next_frame() const { return expected_timestamp; }
+	double estimate_max_jitter() const { return max_jitter_estimate; }
+
+private:
+	static size_t find_bucket(double jitter_seconds);
+	void update_estimate();
+
+	// Inserting and evicting is O(1), with no allocations. Finding the k-th
+	// largest value means walking down from the highest nonempty bucket;
+	// since k=5 and large jitter values are rare, that is typically only
+	// a few buckets, and never more than num_buckets.
+	unsigned bucket_counts[num_buckets] = { 0 };
+	size_t top_bucket = 0;  // No bucket above this is nonempty.
+
+	// The bucket of each of the last <history_length> values (the oldest
+	// at <history_start>), so that we know what to evict.
+	uint16_t history[history_length];
+	size_t history_start = 0, history_size = 0;
+
+	double max_jitter_estimate = 0.0;  // Cached, since it is asked for more often than it changes.
+
+	std::chrono::steady_clock::time_point expected_timestamp = std::chrono::steady_clock::time_point::min();
+
+	// Metrics. There are no direct summaries for jitter, since we already have latency summaries.
+	std::atomic<int64_t> metric_input_underestimated_jitter_frames{0};
+	std::atomic<double> metric_input_estimated_max_jitter_seconds{0.0 / 0.0};
+};
+
+// For any card that's not the master (where we pick out the frames as they
+// come, as fast as we can process), there's going to be a queue. The question
+// is when we should drop frames from that queue (apart from the obvious
+// dropping if the 16-frame queue should become full), especially given that
+// the frame rate could be lower or higher than the master (either subtly or
+// dramatically). We have two (conflicting) demands:
+//
+//   1. We want to avoid starving the queue.
+//   2. We don't want to add more delay than is needed.
+//
+// Our general strategy is to drop as many frames as we can (helping for #2)
+// that we think is safe for #1 given jitter. To this end, we measure the
+// deviation from the expected arrival time for all cards, and use that for
+// continuous jitter estimation.
+//
+// We then drop everything from the queue that we're sure we won't need to
+// serve the output in the time before the next frame arrives. Typically,
+// this means the queue will contain 0 or 1 frames, although more is also
+// possible if the jitter is very high.
+class QueueLengthPolicy {
+public:
+	QueueLengthPolicy() {}
+	void reset(unsigned card_index) {
+		this->card_index = card_index;
+	}
+
+	void register_metrics(const std::vector<std::pair<std::string, std::string>> &labels);
+	void unregister_metrics(const std::vector<std::pair<std::string, std::string>> &labels);
+
+	// Call after picking out a frame, so 0 means starvation.
+	void update_policy(std::chrono::steady_clock::time_point now,
+	                   std::chrono::steady_clock::time_point expected_next_frame,
+			   int64_t input_frame_duration,
+	                   int64_t master_frame_duration,
+	                   double max_input_card_jitter_seconds,
+	                   double max_master_card_jitter_seconds);
+	unsigned get_safe_queue_length() const { return safe_queue_length; }
+
+private:
+	unsigned card_index;  // For debugging and metrics only.
+	unsigned safe_queue_length = 0;  // Can never go below zero.
+
+	// Metrics.
+	std::atomic<int64_t> metric_input_queue_safe_length_frames{1};
+};
+
+// Drops frames from the front of <queue> until it is no longer than
+// <safe_queue_length>. Only the first <queue_length_frames> frames are
+// considered; any frames after that have come in after the jitter history
+// was last updated, and will be dealt with next time. <Queue> is typically
+// an SPSCQueue; its elements need a <dropped_frames> member, which is the
+// number of input frames that were lost right before them.
+//
+// Returns the number of frames dropped, and sets <*queue_length_out> to the
+// resulting queue length (counted the same way as for the decision; see below).
+template<class Queue>
+unsigned trim_queue(Queue *queue, size_t queue_length_frames, unsigned safe_queue_length, unsigned *queue_length_out)
+{
+	// Count the number of frames in the queue, including any frames
+	// we dropped. It's hard to know exactly how we should deal with
+	// dropped (corrupted) input frames; they don't help our goal of
+	// avoiding starvation, but they still add to the problem of latency.
+	// Since dropped frames is going to mean a bump in the signal anyway,
+	// we err on the side of having more stable latency instead.
+	unsigned queue_length = 0;
+	for (size_t i = 0; i < queue_length_frames; ++i) {
+		queue_length += queue->at(i).dropped_frames + 1;
+	}
+
+	// If needed, drop frames until the queue is below the safe limit.
+	// We prefer to drop from the head, because all else being equal,
+	// we'd like more recent frames (less latency).
+	unsigned dropped_frames = 0;
+	while (queue_length > safe_queue_length) {
+		assert(!queue->empty());
+		assert(queue_length > queue->front().dropped_frames);
+		queue_length -= queue->front().dropped_frames;
+
+		if (queue_length <= safe_queue_length) {
+			// No need to drop anything.
+			break;
+		}
+
+		queue->pop();
+		--queue_length;
+		++dropped_frames;
+	}
+
+	*queue_length_out = queue_length;
+	return dropped_frames;
+}
+
+#endif  // !defined(_QUEUE_LENGTH_POLICY_H)
@@ -1679,7 +1679,7 @@ bool QuickSyncEncoderImpl::begin_frame(int64_t pts, int64_t duration, YCbCrLumaC
 	return true;
 }
 
-void QuickSyncEncoderImpl::add_audio(int64_t pts, vector<float> audio)
+void QuickSyncEncoderImpl::add_audio(int64_t pts, const vector<float> &audio)
 {
 	lock_guard<mutex> lock(file_audio_encoder_mutex);
 	assert(!is_shutdown);
@@ -2082,7 +2082,7 @@ QuickSyncEncoder::QuickSyncEncoder(const std::string &filename, ResourcePool *re
 // Must be defined here because unique_ptr<> destructor needs to know the impl.
 QuickSyncEncoder::~QuickSyncEncoder() {}
 
-void QuickSyncEncoder::add_audio(int64_t pts, vector<float> audio)
+void QuickSyncEncoder::add_audio(int64_t pts, const vector<float> &audio)
 {
 	impl->add_audio(pts, audio);
 }
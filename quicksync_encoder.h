@@ -67,7 +67,7 @@ public:
         ~QuickSyncEncoder();
 
 	void set_stream_mux(Mux *mux);  // Does not take ownership. Must be called unless x264 is used for the stream.
-	void add_audio(int64_t pts, std::vector<float> audio);  // Thread-safe.
+	void add_audio(int64_t pts, const std::vector<float> &audio);  // Thread-safe.
 	bool is_zerocopy() const;  // Thread-safe.
 
 	// See VideoEncoder::begin_frame().
@@ -0,0 +1,400 @@
+// Renders a mix offline, as fast as the CPU allows. Takes an input mapping
+// (as saved from the input mapping dialog), optionally the rest of the mix
+// settings (an AudioMixerSettingsProto in text format; see state.proto),
+// and one audio file for each device in the mapping. Runs them through
+// AudioMixer::get_output() and writes the master bus to a WAV file
+// (32-bit float, stereo, 48 kHz). Prints how much faster than realtime
+// it went, so it can also be used as a throughput benchmark for DSP changes,
+// on real audio instead of benchmark_audio_mixer's white noise.
+//
+// The files are given to the devices in the mapping in order (skipping
+// the silent ones), no matter if the mapping says capture card or ALSA.
+// They are read with FileAudioInput, so raw files can be given as e.g.
+// FILE,rate=44100,channels=2,bits=24 (see FileAudioInput::parse_spec()).
+// Files that end early are padded with silence. By default, the output
+// goes on for the length of the resampling queue (--audio-queue-length-ms
+// in Nageru) after the longest input ends, so that nothing is cut off.
+
+#include <fcntl.h>
+#include <getopt.h>
+#include <google/protobuf/io/zero_copy_stream_impl.h>
+#include <google/protobuf/text_format.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "audio_mixer.h"
+#include "defs.h"
+#include "file_audio_input.h"
+#include "flags.h"
+#include "input_mapping.h"
+#include "resampling_queue.h"
+#include "state.pb.h"
+#include "timebase.h"
+
+using namespace std;
+using namespace std::chrono;
+using namespace google::protobuf;
+
+struct RenderConfig {
+	string mapping_filename;
+	string settings_filename;  // Empty for none.
+	string output_filename;
+	vector<string> input_specs;
+	unsigned frame_size = 800;  // One frame at 60 fps.
+	double duration_sec = -1.0;  // Negative means until the longest input ends.
+	unsigned bus_threads = 0;
+	unsigned resampling_threads = 0;
+};
+
+struct Input {
+	FileAudioInput::Params params;
+	vector<uint8_t> samples;
+	size_t num_frames;
+	bmusb::AudioFormat audio_format;
+};
+
+template<class Proto>
+bool read_text_proto(const string &filename, Proto *proto)
+{
+	int fd = open(filename.c_str(), O_RDONLY);
+	if (fd == -1) {
+		perror(filename.c_str());
+		return false;
+	}
+	io::FileInputStream input(fd);  // Takes ownership of fd.
+	bool ok = TextFormat::Parse(&input, proto);
+	input.Close();
+	if (!ok) {
+		fprintf(stderr, "%s: Could not parse file.\n", filename.c_str());
+	}
+	return ok;
+}
+
+// Like load_input_mapping_from_file(), but we have no devices to match
+// against; every non-silent device just gets the next input, as a capture card.
+bool load_input_mapping(const string &filename, const vector<Input> &inputs, InputMapping *mapping)
+{
+	InputMappingProto mapping_proto;
+	if (!read_text_proto(filename, &mapping_proto)) {
+		return false;
+	}
+
+	vector<DeviceSpec> device_mapping;
+	unsigned num_inputs_used = 0;
+	for (const DeviceSpecProto &device_proto : mapping_proto.device()) {
+		if (device_proto.type() == DeviceSpecProto::SILENCE) {
+			device_mapping.push_back(DeviceSpec{InputSourceType::SILENCE, 0});
+			continue;
+		}
+		if (num_inputs_used == inputs.size()) {
+			fprintf(stderr, "%s: There are more devices than input files.\n", filename.c_str());
+			return false;
+		}
+		fprintf(stderr, "%s -> %s\n", inputs[num_inputs_used].params.filename.c_str(), device_proto.display_name().c_str());
+		device_mapping.push_back(DeviceSpec{InputSourceType::CAPTURE_CARD, num_inputs_used++});
+	}
+	if (num_inputs_used < inputs.size()) {
+		fprintf(stderr, "WARNING: Only the first %u input files are used by the mapping.\n", num_inputs_used);
+	}
+
+	for (const BusProto &bus_proto : mapping_proto.bus()) {
+		if (bus_proto.device_index() < 0 || unsigned(bus_proto.device_index()) >= device_mapping.size()) {
+			fprintf(stderr, "%s: Bus '%s' has an invalid device index.\n", filename.c_str(), bus_proto.name().c_str());
+			return false;
+		}
+		InputMapping::Bus bus;
+		bus.name = bus_proto.name();
+		bus.device = device_mapping[bus_proto.device_index()];
+		bus.source_channel[0] = bus_proto.source_channel_left();
+		bus.source_channel[1] = bus_proto.source_channel_right();
+		if (bus.device.type == InputSourceType::CAPTURE_CARD) {
+			const unsigned num_channels = inputs[bus.device.index].params.num_channels;
+			if (bus.source_channel[0] >= int(num_channels) || bus.source_channel[1] >= int(num_channels)) {
+				fprintf(stderr, "%s: Bus '%s' uses a channel that %s does not have.\n",
+					filename.c_str(), bus.name.c_str(), inputs[bus.device.index].params.filename.c_str());
+				return false;
+			}
+		}
+		mapping->buses.push_back(bus);
+	}
+	if (mapping->buses.empty()) {
+		fprintf(stderr, "%s: No buses.\n", filename.c_str());
+		return false;
+	}
+	return true;
+}
+
+bool apply_settings(const string &filename, AudioMixer *mixer)
+{
+	AudioMixerSettingsProto settings_proto;
+	if (!read_text_proto(filename, &settings_proto)) {
+		return false;
+	}
+	if (unsigned(settings_proto.bus_size()) > mixer->num_buses()) {
+		fprintf(stderr, "%s: There are settings for %d buses, but the mapping has only %u.\n",
+			filename.c_str(), settings_proto.bus_size(), mixer->num_buses());
+		return false;
+	}
+
+	for (unsigned bus_index = 0; bus_index < unsigned(settings_proto.bus_size()); ++bus_index) {
+		const BusSettingsProto &bus_proto = settings_proto.bus(bus_index);
+		AudioMixer::BusSettings settings = AudioMixer::get_default_bus_settings();
+		if (bus_proto.has_fader_volume_db()) settings.fader_volume_db = bus_proto.fader_volume_db();
+		if (bus_proto.has_muted()) settings.muted = bus_proto.muted();
+		if (bus_proto.has_locut_enabled()) settings.locut_enabled = bus_proto.locut_enabled();
+		if (bus_proto.has_eq_bass_db()) settings.eq_level_db[EQ_BAND_BASS] = bus_proto.eq_bass_db();
+		if (bus_proto.has_eq_mid_db()) settings.eq_level_db[EQ_BAND_MID] = bus_proto.eq_mid_db();
+		if (bus_proto.has_eq_treble_db()) settings.eq_level_db[EQ_BAND_TREBLE] = bus_proto.eq_treble_db();
+		if (bus_proto.has_gain_staging_db()) settings.gain_staging_db = bus_proto.gain_staging_db();
+		if (bus_proto.has_level_compressor_enabled()) settings.level_compressor_enabled = bus_proto.level_compressor_enabled();
+		if (bus_proto.has_compressor_threshold_dbfs()) settings.compressor_threshold_dbfs = bus_proto.compressor_threshold_dbfs();
+		if (bus_proto.has_compressor_enabled()) settings.compressor_enabled = bus_proto.compressor_enabled();
+		mixer->set_bus_settings(bus_index, settings);
+	}
+
+	if (settings_proto.has_locut_cutoff_hz()) mixer->set_locut_cutoff(settings_proto.locut_cutoff_hz());
+	if (settings_proto.has_limiter_enabled()) mixer->set_limiter_enabled(settings_proto.limiter_enabled());
+	if (settings_proto.has_limiter_threshold_dbfs()) mixer->set_limiter_threshold_dbfs(settings_proto.limiter_threshold_dbfs());
+	if (settings_proto.has_final_makeup_gain_db()) mixer->set_final_makeup_gain_db(settings_proto.final_makeup_gain_db());
+	if (settings_proto.has_final_makeup_gain_auto()) mixer->set_final_makeup_gain_auto(settings_proto.final_makeup_gain_auto());
+	return true;
+}
+
+void write_le16(uint8_t *ptr, uint16_t x)
+{
+	ptr[0] = x & 0xff;
+	ptr[1] = x >> 8;
+}
+
+void write_le32(uint8_t *ptr, uint32_t x)
+{
+	write_le16(ptr, x & 0xffff);
+	write_le16(ptr + 2, x >> 16);
+}
+
+// A canonical 44-byte header for 32-bit float stereo at OUTPUT_FREQUENCY.
+void make_wav_header(size_t num_floats, uint8_t header[44])
+{
+	const uint32_t data_size = min<size_t>(num_floats * sizeof(float), UINT32_MAX - 36);
+	memcpy(header, "RIFF", 4);
+	write_le32(header + 4, 36 + data_size);
+	memcpy(header + 8, "WAVEfmt ", 8);
+	write_le32(header + 16, 16);
+	write_le16(header + 20, 3);  // WAVE_FORMAT_IEEE_FLOAT.
+	write_le16(header + 22, 2);
+	write_le32(header + 24, OUTPUT_FREQUENCY);
+	write_le32(header + 28, OUTPUT_FREQUENCY * 2 * sizeof(float));
+	write_le16(header + 32, 2 * sizeof(float));
+	write_le16(header + 34, 32);
+	memcpy(header + 36, "data", 4);
+	write_le32(header + 40, data_size);
+}
+
+enum {
+	OPTION_SETTINGS = 1000,
+	OPTION_FRAME_SIZE,
+	OPTION_DURATION,
+	OPTION_BUS_THREADS,
+	OPTION_RESAMPLING_THREADS,
+	OPTION_HELP,
+};
+
+void usage(const char *argv0)
+{
+	fprintf(stderr, "Usage: %s [OPTION]... INPUT_MAPPING OUTPUT_FILE INPUT_FILE...\n", argv0);
+	fprintf(stderr, "\n");
+	fprintf(stderr, "      --settings=FILE             bus settings etc. (AudioMixerSettingsProto in text format)\n");
+	fprintf(stderr, "      --frame-size=SAMPLES        samples per call to get_output() (default 800,\n");
+	fprintf(stderr, "                                    at most 4800)\n");
+	fprintf(stderr, "      --duration=SECONDS          length of output (default: until the longest input ends,\n");
+	fprintf(stderr, "                                    plus the length of the resampling queue)\n");
+	fprintf(stderr, "      --bus-threads=NUM           like --audio-bus-threads in Nageru (default 0)\n");
+	fprintf(stderr, "      --resampling-threads=NUM    like --audio-resampling-threads in Nageru (default 0)\n");
+}
+
+void parse_options(int argc, char **argv, RenderConfig *config)
+{
+	static const option long_options[] = {
+		{ "settings", required_argument, 0, OPTION_SETTINGS },
+		{ "frame-size", required_argument, 0, OPTION_FRAME_SIZE },
+		{ "duration", required_argument, 0, OPTION_DURATION },
+		{ "bus-threads", required_argument, 0, OPTION_BUS_THREADS },
+		{ "resampling-threads", required_argument, 0, OPTION_RESAMPLING_THREADS },
+		{ "help", no_argument, 0, OPTION_HELP },
+		{ 0, 0, 0, 0 }
+	};
+	for ( ;; ) {
+		int option_index = 0;
+		int c = getopt_long(argc, argv, "", long_options, &option_index);
+		if (c == -1) {
+			break;
+		}
+		switch (c) {
+		case OPTION_SETTINGS:
+			config->settings_filename = optarg;
+			break;
+		case OPTION_FRAME_SIZE:
+			config->frame_size = atoi(optarg);
+			if (config->frame_size == 0 || config->frame_size > OUTPUT_FREQUENCY / 10) {
+				// Each frame's worth of input goes into the mixer's input queue
+				// in one go, so it has to fit there. The mixer considers more
+				// than this per frame implausible from a card, too.
+				fprintf(stderr, "--frame-size must be between 1 and %d.\n", OUTPUT_FREQUENCY / 10);
+				exit(1);
+			}
+			break;
+		case OPTION_DURATION:
+			config->duration_sec = atof(optarg);
+			if (!(config->duration_sec > 0.0)) {
+				fprintf(stderr, "--duration must be positive.\n");
+				exit(1);
+			}
+			break;
+		case OPTION_BUS_THREADS:
+			config->bus_threads = atoi(optarg);
+			break;
+		case OPTION_RESAMPLING_THREADS:
+			config->resampling_threads = atoi(optarg);
+			break;
+		case OPTION_HELP:
+			usage(argv[0]);
+			exit(0);
+		default:
+			usage(argv[0]);
+			exit(1);
+		}
+	}
+
+	if (argc - optind < 3) {
+		usage(argv[0]);
+		exit(1);
+	}
+	config->mapping_filename = argv[optind++];
+	config->output_filename = argv[optind++];
+	while (optind < argc) {
+		config->input_specs.push_back(argv[optind++]);
+	}
+	if (config->input_specs.size() > MAX_VIDEO_CARDS) {
+		fprintf(stderr, "Can use at most %d input files.\n", MAX_VIDEO_CARDS);
+		exit(1);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	RenderConfig config;
+	parse_options(argc, argv, &config);
+
+	vector<Input> inputs(config.input_specs.size());
+	size_t longest_input = 0;  // In output samples.
+	for (unsigned i = 0; i < inputs.size(); ++i) {
+		Input *input = &inputs[i];
+		if (!FileAudioInput::parse_spec(config.input_specs[i], &input->params) ||
+		    !FileAudioInput::probe(&input->params) ||
+		    !FileAudioInput::read_samples(input->params, &input->samples)) {
+			exit(1);
+		}
+		const unsigned bytes_per_frame = input->params.num_channels * input->params.bits_per_sample / 8;
+		input->num_frames = input->samples.size() / bytes_per_frame;
+		input->audio_format.bits_per_sample = input->params.bits_per_sample;
+		input->audio_format.num_channels = input->params.num_channels;
+		input->audio_format.sample_rate = input->params.sample_rate;
+		longest_input = max<size_t>(longest_input, uint64_t(input->num_frames) * OUTPUT_FREQUENCY / input->params.sample_rate);
+	}
+
+	InputMapping mapping;
+	if (!load_input_mapping(config.mapping_filename, inputs, &mapping)) {
+		exit(1);
+	}
+
+	// The final makeup gain depends on the loudness measurements, so for the
+	// output to be the same from run to run, they must be made on this thread.
+	global_flags.audio_metering_thread = false;
+	global_flags.audio_bus_threads = config.bus_threads;
+	global_flags.audio_resampling_threads = config.resampling_threads;
+	AudioMixer mixer(inputs.size());
+	mixer.set_input_mapping(mapping);
+	if (!config.settings_filename.empty() && !apply_settings(config.settings_filename, &mixer)) {
+		exit(1);
+	}
+
+	size_t num_output_samples;
+	if (config.duration_sec > 0.0) {
+		num_output_samples = lrint(config.duration_sec * OUTPUT_FREQUENCY);
+	} else {
+		num_output_samples = longest_input + lrint(global_flags.audio_queue_length_ms * 1e-3 * OUTPUT_FREQUENCY);
+	}
+	const unsigned num_frames = (num_output_samples + config.frame_size - 1) / config.frame_size;
+
+	// Pad all the inputs with silence, so that we never need to care
+	// about running out of input in the loop below.
+	for (Input &input : inputs) {
+		const size_t frames_needed = uint64_t(num_frames) * config.frame_size * input.params.sample_rate / OUTPUT_FREQUENCY + 1;
+		const unsigned bytes_per_frame = input.params.num_channels * input.params.bits_per_sample / 8;
+		input.samples.resize(max(input.num_frames, frames_needed) * bytes_per_frame);
+	}
+
+	FILE *fp = fopen(config.output_filename.c_str(), "wb");
+	if (fp == nullptr) {
+		perror(config.output_filename.c_str());
+		exit(1);
+	}
+	uint8_t header[44];
+	make_wav_header(0, header);  // Filled in properly at the end.
+	fwrite(header, sizeof(header), 1, fp);
+
+	const int64_t frame_length = int64_t(config.frame_size) * TIMEBASE / OUTPUT_FREQUENCY;
+	vector<float> output;
+	size_t num_floats_written = 0;
+	steady_clock::time_point start = steady_clock::now();
+	for (unsigned frame_num = 0; frame_num < num_frames; ++frame_num) {
+		steady_clock::time_point ts = steady_clock::time_point::min() +
+			nanoseconds(int64_t(frame_num) * config.frame_size * 1000000000ll / OUTPUT_FREQUENCY);
+
+		for (unsigned card_index = 0; card_index < inputs.size(); ++card_index) {
+			const Input &input = inputs[card_index];
+			const uint64_t rate = input.params.sample_rate;
+			const size_t first_frame = uint64_t(frame_num) * config.frame_size * rate / OUTPUT_FREQUENCY;
+			const size_t end_frame = uint64_t(frame_num + 1) * config.frame_size * rate / OUTPUT_FREQUENCY;
+			const unsigned bytes_per_frame = input.params.num_channels * input.params.bits_per_sample / 8;
+			// The input queue is drained by every get_output(), so if this chunk
+			// does not fit now, it never will.
+			if (!mixer.add_audio(DeviceSpec{InputSourceType::CAPTURE_CARD, card_index},
+			                     &input.samples[first_frame * bytes_per_frame], end_frame - first_frame,
+			                     input.audio_format, frame_length, ts)) {
+				fprintf(stderr, "Input %u: %zu frames of audio do not fit in the mixer's input queue; try a smaller --frame-size.\n",
+					card_index, end_frame - first_frame);
+				exit(1);
+			}
+		}
+
+		mixer.get_output(ts, config.frame_size, ResamplingQueue::ADJUST_RATE, &output);
+
+		// The last frame might be partial.
+		const size_t num_floats = min(output.size(), num_output_samples * 2 - num_floats_written);
+		fwrite(output.data(), num_floats * sizeof(float), 1, fp);
+		num_floats_written += num_floats;
+	}
+	steady_clock::time_point end = steady_clock::now();
+
+	make_wav_header(num_floats_written, header);
+	fseek(fp, 0, SEEK_SET);
+	fwrite(header, sizeof(header), 1, fp);
+	if (fclose(fp) != 0) {
+		perror(config.output_filename.c_str());
+		exit(1);
+	}
+
+	const double elapsed = duration<double>(end - start).count();
+	const double rendered = double(num_floats_written) / (OUTPUT_FREQUENCY * 2);
+	printf("%.1f seconds of audio rendered in %.2f seconds (%.1fx realtime, %.1f%% CPU).\n",
+		rendered, elapsed, rendered / elapsed, 100.0 * elapsed / rendered);
+	return 0;
+}
@@ -0,0 +1,261 @@
+// Replays a log of frame arrivals for one input card and one master clock
+// through the same queue-dropping code that the mixer uses (JitterHistory,
+// QueueLengthPolicy and trim_queue(), called the same way as in
+// Mixer::get_one_frame_from_each_card()), and prints the number of drops
+// and underruns, and the latency distribution. Run it before and after
+// changing any of that code, to see what it does to latency.
+//
+// The log has one event per line, either “IN <seconds>” (a frame arrived
+// from the input card) or “OUT <seconds>” (the master clock ticked);
+// this is the same format as for experiments/queue_drop_policy.cpp,
+// so it can replay real logs like the one mentioned there. generate_frame_log
+// makes synthetic ones.
+
+#include <getopt.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "queue_length_policy.h"
+#include "spsc_queue.h"
+#include "timebase.h"
+
+using namespace std;
+using namespace std::chrono;
+
+struct Event {
+	enum { IN, OUT } direction;
+	double t;
+};
+
+struct ReplayFrame {
+	steady_clock::time_point received_timestamp;
+	unsigned dropped_frames = 0;  // Always zero here; only needed for trim_queue().
+	bool in_jitter_history = false;
+};
+
+struct ReplayConfig {
+	string log_filename;
+	int64_t input_frame_duration = TIMEBASE / 50;
+	int64_t output_frame_duration = TIMEBASE / 50;
+	unsigned max_input_queue_frames = 6;  // Same default as in Nageru.
+	double skip_seconds = 0.0;
+};
+
+enum {
+	OPTION_INPUT_FRAME_RATE = 1000,
+	OPTION_OUTPUT_FRAME_RATE,
+	OPTION_MAX_INPUT_QUEUE_FRAMES,
+	OPTION_SKIP,
+	OPTION_HELP,
+};
+
+void usage(const char *argv0)
+{
+	fprintf(stderr, "Usage: %s [OPTION]... LOG_FILE\n", argv0);
+	fprintf(stderr, "\n");
+	fprintf(stderr, "      --input-frame-rate=FPS      nominal frame rate of the input card (default 50)\n");
+	fprintf(stderr, "      --output-frame-rate=FPS     nominal frame rate of the master clock (default 50)\n");
+	fprintf(stderr, "      --max-input-queue-frames=FRAMES  like in Nageru (default 6)\n");
+	fprintf(stderr, "      --skip=SECONDS              run the first SECONDS of the log, but leave them\n");
+	fprintf(stderr, "                                    out of the statistics (default 0)\n");
+}
+
+int64_t parse_frame_rate(const char *option, const char *str)
+{
+	double fps = atof(str);
+	if (!(fps > 0.0)) {
+		fprintf(stderr, "--%s must be positive.\n", option);
+		exit(1);
+	}
+	return lrint(TIMEBASE / fps);
+}
+
+void parse_options(int argc, char **argv, ReplayConfig *config)
+{
+	static const option long_options[] = {
+		{ "input-frame-rate", required_argument, 0, OPTION_INPUT_FRAME_RATE },
+		{ "output-frame-rate", required_argument, 0, OPTION_OUTPUT_FRAME_RATE },
+		{ "max-input-queue-frames", required_argument, 0, OPTION_MAX_INPUT_QUEUE_FRAMES },
+		{ "skip", required_argument, 0, OPTION_SKIP },
+		{ "help", no_argument, 0, OPTION_HELP },
+		{ 0, 0, 0, 0 }
+	};
+	for ( ;; ) {
+		int option_index = 0;
+		int c = getopt_long(argc, argv, "", long_options, &option_index);
+		if (c == -1) {
+			break;
+		}
+		switch (c) {
+		case OPTION_INPUT_FRAME_RATE:
+			config->input_frame_duration = parse_frame_rate("input-frame-rate", optarg);
+			break;
+		case OPTION_OUTPUT_FRAME_RATE:
+			config->output_frame_duration = parse_frame_rate("output-frame-rate", optarg);
+			break;
+		case OPTION_MAX_INPUT_QUEUE_FRAMES:
+			if (atoi(optarg) < 1) {
+				fprintf(stderr, "--max-input-queue-frames must be at least 1.\n");
+				exit(1);
+			}
+			config->max_input_queue_frames = atoi(optarg);
+			break;
+		case OPTION_SKIP:
+			config->skip_seconds = atof(optarg);
+			break;
+		case OPTION_HELP:
+			usage(argv[0]);
+			exit(0);
+		default:
+			usage(argv[0]);
+			exit(1);
+		}
+	}
+
+	if (argc - optind != 1) {
+		usage(argv[0]);
+		exit(1);
+	}
+	config->log_filename = argv[optind];
+}
+
+vector<Event> read_log(const string &filename)
+{
+	FILE *fp = fopen(filename.c_str(), "r");
+	if (fp == nullptr) {
+		perror(filename.c_str());
+		exit(1);
+	}
+	vector<Event> events;
+	for ( ;; ) {
+		char dir[256];
+		double t;
+		int ret = fscanf(fp, "%255s %lf", dir, &t);
+		if (ret == EOF) {
+			break;
+		}
+		if (ret != 2 || (strcmp(dir, "IN") != 0 && strcmp(dir, "OUT") != 0)) {
+			fprintf(stderr, "%s: Unreadable line after %zu events\n", filename.c_str(), events.size());
+			exit(1);
+		}
+		events.push_back(Event{dir[0] == 'I' ? Event::IN : Event::OUT, t});
+	}
+	fclose(fp);
+
+	stable_sort(events.begin(), events.end(), [](const Event &a, const Event &b) { return a.t < b.t; });
+	return events;
+}
+
+double percentile(const vector<double> &sorted_values, double p)
+{
+	if (sorted_values.empty()) {
+		return 0.0 / 0.0;
+	}
+	return sorted_values[lrint(p * (sorted_values.size() - 1))];
+}
+
+int main(int argc, char **argv)
+{
+	ReplayConfig config;
+	parse_options(argc, argv, &config);
+
+	vector<Event> events = read_log(config.log_filename);
+	if (events.empty()) {
+		fprintf(stderr, "%s: No events\n", config.log_filename.c_str());
+		exit(1);
+	}
+
+	// Same capacity as CaptureCard::new_frames.
+	SPSCQueue<ReplayFrame, 64> queue;
+	JitterHistory input_jitter_history, output_jitter_history;
+	QueueLengthPolicy queue_length_policy;
+	queue_length_policy.reset(0);
+
+	const steady_clock::time_point base = steady_clock::now();
+	const double first_t = events[0].t;
+	const double stats_start_t = first_t + config.skip_seconds;
+	size_t num_ticks = 0, num_underruns = 0, num_drops = 0, num_full_drops = 0;
+	vector<double> latencies_ms;
+
+	for (const Event &event : events) {
+		const steady_clock::time_point now = base + nanoseconds(llrint((event.t - first_t) * 1e9));
+		const bool counts = (event.t >= stats_start_t);
+		if (event.direction == Event::IN) {
+			ReplayFrame frame;
+			frame.received_timestamp = now;
+			if (!queue.push(move(frame)) && counts) {
+				++num_full_drops;
+			}
+			continue;
+		}
+
+		// The master clock ticked; do what the mixer does for each non-master card.
+		size_t queue_length_frames = queue.size();
+		for (size_t i = 0; i < queue_length_frames; ++i) {
+			ReplayFrame &frame = queue.at(i);
+			if (!frame.in_jitter_history) {
+				input_jitter_history.frame_arrived(frame.received_timestamp, config.input_frame_duration, frame.dropped_frames);
+				frame.in_jitter_history = true;
+			}
+		}
+
+		bool has_new_frame = false;
+		if (counts) {
+			++num_ticks;
+		}
+		if (queue_length_frames == 0) {
+			if (counts) {
+				++num_underruns;
+			}
+		} else {
+			if (counts) {
+				latencies_ms.push_back(1e3 * duration<double>(now - queue.front().received_timestamp).count());
+			}
+			queue.pop();
+			--queue_length_frames;
+			has_new_frame = true;
+		}
+
+		output_jitter_history.frame_arrived(now, config.output_frame_duration, 0);
+
+		if (has_new_frame) {
+			// Note that the mixer gives the master card's frame length as the
+			// input frame length, so we do the same.
+			queue_length_policy.update_policy(
+				now,
+				input_jitter_history.get_expected_next_frame(),
+				config.output_frame_duration,
+				config.output_frame_duration,
+				input_jitter_history.estimate_max_jitter(),
+				output_jitter_history.estimate_max_jitter());
+			unsigned queue_length;
+			unsigned dropped_frames = trim_queue(&queue, queue_length_frames,
+				min(config.max_input_queue_frames, queue_length_policy.get_safe_queue_length()),
+				&queue_length);
+			if (counts) {
+				num_drops += dropped_frames;
+			}
+		}
+	}
+
+	sort(latencies_ms.begin(), latencies_ms.end());
+	double latency_sum_ms = 0.0;
+	for (double latency_ms : latencies_ms) {
+		latency_sum_ms += latency_ms;
+	}
+
+	printf("%zu ticks of the master clock, %zu frames left in queue at end\n", num_ticks, queue.size());
+	printf("Underruns:    %6zu\n", num_underruns);
+	printf("Drops:        %6zu (%zu more because the queue was full)\n", num_drops, num_full_drops);
+	printf("Latency (ms): mean %.2f, p50 %.2f, p90 %.2f, p99 %.2f, p99.9 %.2f, max %.2f\n",
+		latencies_ms.empty() ? 0.0 / 0.0 : latency_sum_ms / latencies_ms.size(),
+		percentile(latencies_ms, 0.5), percentile(latencies_ms, 0.9), percentile(latencies_ms, 0.99),
+		percentile(latencies_ms, 0.999), percentile(latencies_ms, 1.0));
+}
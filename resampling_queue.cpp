@@ -37,6 +37,12 @@ ResamplingQueue::ResamplingQueue(unsigned card_num, unsigned freq_in, unsigned f
 {
 	vresampler.setup(ratio, num_channels, /*hlen=*/32);
 
+	// Make room for the expected delay plus a full second of slack (for jitter,
+	// frames arriving in bursts, and the time before the first output), so that
+	// the buffer never needs to grow during normal operation.
+	buffer.resize(lrint((expected_delay_seconds + 1.0) * freq_in) * num_channels);
+	wrapped_sample.resize(num_channels);
+
 	// Prime the resampler so there's no more delay.
 	vresampler.inp_count = vresampler.inpsize() / 2 - 1;
         vresampler.out_count = 1048576;
@@ -49,6 +55,24 @@ void ResamplingQueue::add_input_samples(steady_clock::time_point ts, const float
 		return;
 	}
 
+	// Only whole samples go into the buffer. (We are the only writer,
+	// so the free space can only grow between here and the write.)
+	const ssize_t room_samples = buffer.free_space() / num_channels;
+	if (num_samples > room_samples) {
+		fprintf(stderr, "Card %u: Resampling queue overflow, dropping %d input samples\n",
+			card_num, int(num_samples - room_samples));
+		num_samples = room_samples;
+
+		// The timestamp no longer corresponds to the end of what we have
+		// in the queue, so don't use it for rate estimation.
+		rate_adjustment_policy = DO_NOT_ADJUST_RATE;
+	}
+
+	// Write the samples before updating the timing state, so that the consumer
+	// never sees a sample count that is larger than what is actually in the buffer.
+	buffer.write(samples, num_samples * num_channels);
+
+	lock_guard<mutex> lock(input_point_mutex);
 	bool good_sample = (rate_adjustment_policy == ADJUST_RATE);
 	if (good_sample && a1.good_sample) {
 		a0 = a1;
@@ -64,13 +88,23 @@ void ResamplingQueue::add_input_samples(steady_clock::time_point ts, const float
 		current_estimated_freq_in = min(current_estimated_freq_in, 1.2 * freq_in);
 		current_estimated_freq_in = max(current_estimated_freq_in, 0.8 * freq_in);
 	}
-
-	buffer.insert(buffer.end(), samples, samples + num_samples * num_channels);
 }
 
 bool ResamplingQueue::get_output_samples(steady_clock::time_point ts, float *samples, ssize_t num_samples, ResamplingQueue::RateAdjustmentPolicy rate_adjustment_policy)
 {
 	assert(num_samples > 0);
+
+	// Take a snapshot of the timing state, so that we don't need to hold
+	// the lock while the producer is adding new samples.
+	InputPoint a0, a1;
+	double current_estimated_freq_in;
+	{
+		lock_guard<mutex> lock(input_point_mutex);
+		a0 = this->a0;
+		a1 = this->a1;
+		current_estimated_freq_in = this->current_estimated_freq_in;
+	}
+
 	if (a1.input_samples_received == 0) {
 		// No data yet, just return zeros.
 		memset(samples, 0, num_samples * num_channels * sizeof(float));
@@ -103,14 +137,12 @@ bool ResamplingQueue::get_output_samples(steady_clock::time_point ts, float *sam
 			// so that we don't need a long period to stabilize at the beginning.
 			if (err < 0.0) {
 				int delay_samples_to_add = lrintf(-err);
-				for (ssize_t i = 0; i < delay_samples_to_add * num_channels; ++i) {
-					buffer.push_front(0.0f);
-				}
+				pending_silence_samples += delay_samples_to_add;
 				total_consumed_samples -= delay_samples_to_add;  // Equivalent to increasing input_samples_received on a0 and a1.
 				err += delay_samples_to_add;
 			} else if (err > 0.0) {
 				int delay_samples_to_remove = min<int>(lrintf(err), buffer.size() / num_channels);
-				buffer.erase(buffer.begin(), buffer.begin() + delay_samples_to_remove * num_channels);
+				buffer.consume(delay_samples_to_remove * num_channels);
 				total_consumed_samples += delay_samples_to_remove;
 				err -= delay_samples_to_remove;
 			}
@@ -154,6 +186,20 @@ bool ResamplingQueue::get_output_samples(steady_clock::time_point ts, float *sam
 	vresampler.out_data = samples;
 	vresampler.out_count = num_samples;
 	while (vresampler.out_count > 0) {
+		if (pending_silence_samples > 0) {
+			// A null input pointer makes the resampler read zeros.
+			vresampler.inp_count = pending_silence_samples;
+			vresampler.inp_data = nullptr;
+
+			int err = vresampler.process();
+			assert(err == 0);
+
+			size_t consumed_samples = pending_silence_samples - vresampler.inp_count;
+			total_consumed_samples += consumed_samples;
+			pending_silence_samples -= consumed_samples;
+			continue;
+		}
+
 		if (buffer.empty()) {
 			// This should never happen unless delay is set way too low,
 			// or we're dropping a lot of data.
@@ -167,22 +213,29 @@ bool ResamplingQueue::get_output_samples(steady_clock::time_point ts, float *sam
 			return false;
 		}
 
-		float inbuf[1024];
-		size_t num_input_samples = sizeof(inbuf) / (sizeof(float) * num_channels);
-		if (num_input_samples * num_channels > buffer.size()) {
-			num_input_samples = buffer.size() / num_channels;
+		// Let the resampler read straight out of the buffer. Everything up to
+		// the end of the storage goes in one call, so this loop normally
+		// runs once or twice per output frame.
+		const float *inp_data;
+		size_t num_input_samples = buffer.peek_span(&inp_data) / num_channels;
+		if (num_input_samples == 0) {
+			// The next sample is split across the end of the storage
+			// (which can only happen when the number of channels does not
+			// divide the capacity, i.e., for anything but a power of two),
+			// so it needs to be copied out.
+			num_input_samples = buffer.peek(wrapped_sample.data(), num_channels) / num_channels;
+			inp_data = wrapped_sample.data();
 		}
-		copy(buffer.begin(), buffer.begin() + num_input_samples * num_channels, inbuf);
 
 		vresampler.inp_count = num_input_samples;
-		vresampler.inp_data = inbuf;
+		vresampler.inp_data = const_cast<float *>(inp_data);  // Only read from.
 
 		int err = vresampler.process();
 		assert(err == 0);
 
 		size_t consumed_samples = num_input_samples - vresampler.inp_count;
 		total_consumed_samples += consumed_samples;
-		buffer.erase(buffer.begin(), buffer.begin() + consumed_samples * num_channels);
+		buffer.consume(consumed_samples * num_channels);
 	}
 	return true;
 }
@@ -13,6 +13,12 @@
 // (typically measured in milliseconds, although more is fine) and the algorithm works to
 // provide exactly that.
 //
+// add_input_samples() and get_output_samples() can be called concurrently
+// from two different threads (one producer and one consumer); the samples
+// themselves are handed over through a lock-free ring buffer, and only the
+// small amount of timing state used for rate estimation is under a mutex.
+// Any other use needs external locking.
+//
 // A/V sync is a much harder problem than one would intuitively assume. This implementation
 // is based on a 2012 paper by Fons Adriaensen, “Controlling adaptive resampling”
 // (http://kokkinizita.linuxaudio.org/papers/adapt-resamp.pdf). The paper gives an algorithm
@@ -41,10 +47,12 @@
 #include <sys/types.h>
 #include <zita-resampler/vresampler.h>
 #include <chrono>
-#include <deque>
 #include <memory>
+#include <mutex>
+#include <vector>
 
 #include "defs.h"
+#include "ring_buffer.h"
 
 class ResamplingQueue {
 public:
@@ -86,11 +94,13 @@ private:
 		// we will not use it for updateing current_estimated_freq_in.
 		bool good_sample = false;
 	};
-	InputPoint a0, a1;
+	InputPoint a0, a1;  // Under input_point_mutex.
 
 	// The current rate at which we seem to get input samples, in Hz.
 	// For an ideal input, identical to freq_in.
-	double current_estimated_freq_in;
+	double current_estimated_freq_in;  // Under input_point_mutex.
+
+	std::mutex input_point_mutex;
 
 	ssize_t total_consumed_samples = 0;
 
@@ -109,9 +119,18 @@ private:
 	// changing the resampling ratio to compensate.
 	const double expected_delay;
 
-	// Input samples not yet fed into the resampler.
-	// TODO: Use a circular buffer instead, for efficiency.
-	std::deque<float> buffer;
+	// Input samples not yet fed into the resampler. Written by
+	// add_input_samples() and read by get_output_samples().
+	RingBuffer<float> buffer;
+
+	// Silence to be fed into the resampler before anything in <buffer>,
+	// in samples (not floats). Only touched by get_output_samples().
+	size_t pending_silence_samples = 0;
+
+	// Room for one sample (all channels) that straddles the end of <buffer>'s
+	// storage, and thus cannot be read in place. Only touched by
+	// get_output_samples().
+	std::vector<float> wrapped_sample;
 };
 
 #endif  // !defined(_RESAMPLING_QUEUE_H)
@@ -0,0 +1,141 @@
+#include "ring_buffer.h"
+
+#include <string.h>
+#include <algorithm>
+
+using namespace std;
+
+template<class T>
+void RingBuffer<T>::resize(size_t min_capacity)
+{
+	size_t new_capacity = 1;
+	while (new_capacity < min_capacity) {
+		new_capacity *= 2;
+	}
+	if (new_capacity == capacity) {
+		return;
+	}
+
+	// Keep the newest elements that fit.
+	const size_t old_size = size();
+	const size_t elements_to_keep = min(old_size, new_capacity);
+	unique_ptr<T[]> new_buf(new T[new_capacity]);
+	if (elements_to_keep > 0) {
+		consume(old_size - elements_to_keep);
+		peek(new_buf.get(), elements_to_keep);
+	}
+
+	buf = move(new_buf);
+	capacity = new_capacity;
+	read_pos.store(0, memory_order_release);
+	write_pos.store(elements_to_keep, memory_order_release);
+}
+
+template<class T>
+size_t RingBuffer<T>::write(const T *data, size_t num_elements)
+{
+	const size_t rp = read_pos.load(memory_order_acquire);
+	const size_t wp = write_pos.load(memory_order_relaxed);
+	num_elements = min(num_elements, capacity - (wp - rp));
+	if (num_elements == 0) {
+		return 0;
+	}
+
+	copy_in(wp, data, num_elements);
+	write_pos.store(wp + num_elements, memory_order_release);
+	return num_elements;
+}
+
+template<class T>
+bool RingBuffer<T>::write_both(const T *data1, size_t num_elements1, const T *data2, size_t num_elements2)
+{
+	const size_t rp = read_pos.load(memory_order_acquire);
+	const size_t wp = write_pos.load(memory_order_relaxed);
+	if (capacity - (wp - rp) < num_elements1 + num_elements2) {
+		return false;
+	}
+
+	copy_in(wp, data1, num_elements1);
+	copy_in(wp + num_elements1, data2, num_elements2);
+	write_pos.store(wp + num_elements1 + num_elements2, memory_order_release);
+	return true;
+}
+
+template<class T>
+void RingBuffer<T>::copy_in(size_t pos, const T *data, size_t num_elements)
+{
+	const size_t start = pos & (capacity - 1);
+	const size_t first_part = min(num_elements, capacity - start);
+	memcpy(&buf[start], data, first_part * sizeof(T));
+	memcpy(&buf[0], data + first_part, (num_elements - first_part) * sizeof(T));
+}
+
+template<class T>
+size_t RingBuffer<T>::write_zeros(size_t num_elements)
+{
+	const size_t rp = read_pos.load(memory_order_acquire);
+	const size_t wp = write_pos.load(memory_order_relaxed);
+	num_elements = min(num_elements, capacity - (wp - rp));
+	if (num_elements == 0) {
+		return 0;
+	}
+
+	const size_t start = wp & (capacity - 1);
+	const size_t first_part = min(num_elements, capacity - start);
+	memset(&buf[start], 0, first_part * sizeof(T));
+	memset(&buf[0], 0, (num_elements - first_part) * sizeof(T));
+
+	write_pos.store(wp + num_elements, memory_order_release);
+	return num_elements;
+}
+
+template<class T>
+size_t RingBuffer<T>::peek(T *data, size_t num_elements) const
+{
+	const size_t rp = read_pos.load(memory_order_relaxed);
+	const size_t wp = write_pos.load(memory_order_acquire);
+	num_elements = min(num_elements, wp - rp);
+	if (num_elements == 0) {
+		return 0;
+	}
+
+	const size_t start = rp & (capacity - 1);
+	const size_t first_part = min(num_elements, capacity - start);
+	memcpy(data, &buf[start], first_part * sizeof(T));
+	memcpy(data + first_part, &buf[0], (num_elements - first_part) * sizeof(T));
+	return num_elements;
+}
+
+template<class T>
+size_t RingBuffer<T>::read(T *data, size_t num_elements)
+{
+	return consume(peek(data, num_elements));
+}
+
+template<class T>
+size_t RingBuffer<T>::consume(size_t num_elements)
+{
+	const size_t rp = read_pos.load(memory_order_relaxed);
+	const size_t wp = write_pos.load(memory_order_acquire);
+	num_elements = min(num_elements, wp - rp);
+	read_pos.store(rp + num_elements, memory_order_release);
+	return num_elements;
+}
+
+template<class T>
+size_t RingBuffer<T>::peek_span(const T **data) const
+{
+	const size_t rp = read_pos.load(memory_order_relaxed);
+	const size_t wp = write_pos.load(memory_order_acquire);
+	if (wp == rp) {
+		*data = nullptr;
+		return 0;
+	}
+
+	const size_t start = rp & (capacity - 1);
+	*data = &buf[start];
+	return min(wp - rp, capacity - start);
+}
+
+template class RingBuffer<float>;
+template class RingBuffer<uint8_t>;
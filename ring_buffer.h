@@ -0,0 +1,82 @@
+#ifndef _RING_BUFFER_H
+#define _RING_BUFFER_H 1
+
+// A fixed-capacity circular buffer of plain old data (typically interleaved
+// audio samples, or raw bytes). One producer thread and one consumer thread can use it
+// concurrently without any locking; data moves in and out in whole blocks
+// with memcpy() (two of them if the block wraps around the end of the storage).
+//
+// The buffer never grows by itself. If the producer tries to write more than
+// there is room for, only the part that fits is written, and it is up to the
+// caller to decide what to do about the rest. resize() changes the capacity,
+// but is _not_ thread-safe; nobody else can touch the buffer while it runs.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+
+template<class T>
+class RingBuffer {
+public:
+	RingBuffer() {}
+	explicit RingBuffer(size_t min_capacity) { resize(min_capacity); }
+
+	// Rounds the capacity up to the nearest power of two. Existing contents
+	// are kept if they fit; if not, the oldest elements are thrown away.
+	void resize(size_t min_capacity);
+	size_t get_capacity() const { return capacity; }
+
+	// Number of elements available for reading. Can be called from either side,
+	// but if called from the producer, it can only be taken as an upper bound
+	// (and conversely, from the consumer, only as a lower bound).
+	size_t size() const
+	{
+		return write_pos.load(std::memory_order_acquire) - read_pos.load(std::memory_order_acquire);
+	}
+	bool empty() const { return size() == 0; }
+
+	// Producer side. Returns the number of elements actually written.
+	size_t free_space() const { return capacity - size(); }
+	size_t write(const T *data, size_t num_elements);
+	size_t write_zeros(size_t num_elements);
+
+	// Producer side. Writes two blocks (e.g. a header and its payload) that
+	// become visible to the consumer at the same time, so that it can never
+	// see (or consume) only the first one. Writes nothing and returns false
+	// unless both fit.
+	bool write_both(const T *data1, size_t num_elements1, const T *data2, size_t num_elements2);
+
+	// Consumer side. peek() copies out up to <num_elements> without consuming
+	// them; read() is peek() followed by consume(). All return the number
+	// of elements actually copied or consumed.
+	size_t peek(T *data, size_t num_elements) const;
+	size_t read(T *data, size_t num_elements);
+	size_t consume(size_t num_elements);
+
+	// Consumer side, without copying: Points <data> at the oldest elements
+	// in the storage itself, and returns how many of them are contiguous
+	// there (zero if the buffer is empty). If the contents wrap around the end
+	// of the storage, the rest can be had by calling again after consume().
+	// The span stays valid until it is consumed.
+	size_t peek_span(const T **data) const;
+
+private:
+	// Copies <num_elements> into the storage starting at the (unmasked)
+	// position <pos>, wrapping around as needed. Does not publish anything.
+	void copy_in(size_t pos, const T *data, size_t num_elements);
+
+	std::unique_ptr<T[]> buf;
+	size_t capacity = 0;  // Always zero or a power of two.
+
+	// Monotonically increasing; the actual position in <buf> is
+	// the value modulo <capacity>. read_pos is only written by the consumer,
+	// and write_pos is only written by the producer.
+	std::atomic<size_t> read_pos{0}, write_pos{0};
+};
+
+// The implementation is in ring_buffer.cpp; these are the types we use.
+extern template class RingBuffer<float>;
+extern template class RingBuffer<uint8_t>;
+
+#endif  // !defined(_RING_BUFFER_H)
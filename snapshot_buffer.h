@@ -0,0 +1,72 @@
+#ifndef _SNAPSHOT_BUFFER_H
+#define _SNAPSHOT_BUFFER_H 1
+
+// A value that one thread updates now and then, and that any number of other
+// threads can read whenever they please, all without locking. The writer never
+// waits for anybody, and does not allocate. It's meant for things like level
+// meters, where the readers only care about the latest value, and at their
+// own pace.
+//
+// There are two copies of the value (a seqlock for each): The writer always
+// writes to the one that was not published last, so readers are rarely in its
+// way. If the writer has written both copies while a reader was copying out
+// one of them, the reader notices and tries again.
+//
+// T must be trivially copyable.
+
+#include <stdint.h>
+#include <atomic>
+
+template<class T>
+class SnapshotBuffer {
+public:
+	// Writer side; only one thread can publish at any given time.
+	// Calls fill(T *) to fill in the new value in place (so that large
+	// values don't need to be copied around). Note that it gets whatever
+	// was published the time before last, not a clean value.
+	template<class Func>
+	void publish(Func &&fill)
+	{
+		const unsigned index = 1 - latest.load(std::memory_order_relaxed);
+		Copy &copy = copies[index];
+		const uint64_t seq = copy.seq.load(std::memory_order_relaxed);
+		copy.seq.store(seq + 1, std::memory_order_relaxed);  // Odd; being written.
+		std::atomic_thread_fence(std::memory_order_release);
+		fill(&copy.value);
+		copy.seq.store(seq + 2, std::memory_order_release);
+		latest.store(index, std::memory_order_release);
+		published.store(true, std::memory_order_release);
+	}
+
+	// Reader side. Returns false (and leaves <value> alone) if nothing
+	// has been published yet.
+	bool read(T *value) const
+	{
+		if (!published.load(std::memory_order_acquire)) {
+			return false;
+		}
+		for ( ;; ) {
+			const Copy &copy = copies[latest.load(std::memory_order_acquire)];
+			const uint64_t seq_before = copy.seq.load(std::memory_order_acquire);
+			if (seq_before & 1) {
+				continue;
+			}
+			*value = copy.value;
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (copy.seq.load(std::memory_order_relaxed) == seq_before) {
+				return true;
+			}
+		}
+	}
+
+private:
+	struct Copy {
+		std::atomic<uint64_t> seq{0};
+		T value{};
+	};
+	Copy copies[2];
+	std::atomic<unsigned> latest{0};
+	std::atomic<bool> published{false};
+};
+
+#endif  // !defined(_SNAPSHOT_BUFFER_H)
@@ -0,0 +1,83 @@
+#ifndef _SPSC_QUEUE_H
+#define _SPSC_QUEUE_H 1
+
+// A bounded, lock-free queue of objects for exactly one producer thread
+// and one consumer thread. (RingBuffer is the same idea for plain samples.)
+// The producer can only push to the back; the consumer can look at
+// any element and pop from the front. Popped elements are reset to T(),
+// so that e.g. references they hold are released right away, and not
+// when the slot happens to be reused.
+//
+// All the elements live inside the queue, so <Capacity> (which must be
+// a power of two) should not be too large.
+
+#include <assert.h>
+#include <stddef.h>
+#include <atomic>
+#include <utility>
+
+template<class T, size_t Capacity>
+class SPSCQueue {
+public:
+	static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+	// Producer only. Returns false (leaving <elem> untouched) if the queue is full.
+	bool push(T &&elem)
+	{
+		const size_t pos = write_pos.load(std::memory_order_relaxed);
+		if (pos - read_pos.load(std::memory_order_acquire) == Capacity) {
+			return false;
+		}
+		elems[pos & (Capacity - 1)] = std::move(elem);
+		write_pos.store(pos + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Consumer only. The producer might push more at any time,
+	// so the size can only go up behind your back, never down.
+	size_t size() const
+	{
+		return write_pos.load(std::memory_order_acquire) - read_pos.load(std::memory_order_relaxed);
+	}
+	bool empty() const { return size() == 0; }
+
+	// Consumer only. Index 0 is the front; <index> must be less than size().
+	T &at(size_t index)
+	{
+		assert(index < size());
+		return elems[(read_pos.load(std::memory_order_relaxed) + index) & (Capacity - 1)];
+	}
+	T &front() { return at(0); }
+
+	// Consumer only.
+	void pop()
+	{
+		assert(!empty());
+		const size_t pos = read_pos.load(std::memory_order_relaxed);
+		elems[pos & (Capacity - 1)] = T();
+		read_pos.store(pos + 1, std::memory_order_release);
+	}
+
+	// Consumer only.
+	void clear()
+	{
+		while (!empty()) pop();
+	}
+
+	static constexpr size_t capacity() { return Capacity; }
+
+private:
+	T elems[Capacity];
+
+	// These only ever increase; we mask them when indexing into <elems>.
+	// Padded so that they end up on separate cache lines, since they are
+	// written by different threads. (We cannot use alignas(64); the queue
+	// lives inside objects that are allocated with plain new, which does not
+	// honor extended alignment before C++17.)
+	std::atomic<size_t> read_pos{0};
+	char pad1[64 - sizeof(std::atomic<size_t>)];
+	std::atomic<size_t> write_pos{0};
+	char pad2[64 - sizeof(std::atomic<size_t>)];
+};
+
+#endif  // !defined(_SPSC_QUEUE_H)
@@ -1,6 +1,9 @@
 #include "stereocompressor.h"
 
 #include <assert.h>
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
 #include <algorithm>
 #include <cmath>
 
@@ -75,31 +78,253 @@ inline float compressor_knee(float x, float threshold, float inv_threshold, floa
 	}
 }
 
+struct Coefficients {
+	float attack_increment, release_increment, peak_increment;
+	float inv_ratio_minus_one, inv_threshold;
+};
+
+Coefficients compute_coefficients(float sample_rate, float threshold, float ratio, float attack_time, float release_time)
+{
+	Coefficients c;
+	c.attack_increment = float(pow(2.0f, 1.0f / (attack_time * sample_rate + 1)));
+	if (attack_time == 0.0f) c.attack_increment = 100000;  // For instant attack reaction.
+
+	c.release_increment = float(pow(2.0f, -1.0f / (release_time * sample_rate + 1)));
+	c.peak_increment = float(pow(2.0f, -1.0f / (0.003f * sample_rate + 1)));
+
+	c.inv_ratio_minus_one = 1.0f / ratio - 1.0f;
+	if (ratio > 63) c.inv_ratio_minus_one = -1.0f;  // Infinite ratio.
+	c.inv_threshold = 1.0f / threshold;
+	return c;
+}
+
+#ifdef __SSE2__
+
+// SIMD versions of fastpow() and compressor_knee(). Every operation is done
+// in exactly the same order as in the scalar versions, so that the results
+// are bit-exact the same. Both pieces of the piecewise ln() approximation
+// are computed and the right one picked afterwards, and similarly for the knee.
+
+inline __m128 select_sse(__m128 mask, __m128 a, __m128 b)
+{
+	return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+// c0 + (c1 + (c2 + c3 * x) * x) * x
+inline __m128 poly3_sse(__m128 x, float c0, float c1, float c2, float c3)
+{
+	__m128 t = _mm_add_ps(_mm_set1_ps(c2), _mm_mul_ps(_mm_set1_ps(c3), x));
+	t = _mm_add_ps(_mm_set1_ps(c1), _mm_mul_ps(t, x));
+	return _mm_add_ps(_mm_set1_ps(c0), _mm_mul_ps(t, x));
+}
+
+inline __m128 fastpow_sse(__m128 x, __m128 y)
+{
+	const __m128 lo = _mm_cmplt_ps(x, _mm_set1_ps(6.0f));
+	const __m128 ln_nom = select_sse(lo,
+		poly3_sse(x, -0.059237648f, -0.0165117771f, 0.06818859075f, 0.007560968243f),
+		poly3_sse(x, -0.005430534f, 0.00633589178f, 0.0006319155549f, 0.4789541675e-5f));
+	const __m128 ln_den = select_sse(lo,
+		poly3_sse(x, 0.0202509098f, 0.08419174188f, 0.03647189417f, 0.001642577975f),
+		poly3_sse(x, 0.0064785099f, 0.003219629109f, 0.0001531823694f, 0.6884656640e-6f));
+	const __m128 v = _mm_div_ps(_mm_mul_ps(y, ln_nom), ln_den);
+	const __m128 exp_nom = poly3_sse(v, 0.2195097621f, 0.08546059868f, 0.01208501759f, 0.0006173448113f);
+
+	// 0.2194980791f + (-0.1343051968f + (0.03556072737f - 0.006174398513f * v) * v) * v
+	__m128 exp_den = _mm_sub_ps(_mm_set1_ps(0.03556072737f), _mm_mul_ps(_mm_set1_ps(0.006174398513f), v));
+	exp_den = _mm_add_ps(_mm_set1_ps(-0.1343051968f), _mm_mul_ps(exp_den, v));
+	exp_den = _mm_add_ps(_mm_set1_ps(0.2194980791f), _mm_mul_ps(exp_den, v));
+
+	return _mm_div_ps(exp_nom, exp_den);
+}
+
+// Replaces each compression level in <levels> with the corresponding gain.
+void compute_gains_sse(float *levels, size_t num_samples, float threshold, float inv_threshold, float inv_ratio_minus_one, float postgain)
+{
+	size_t i = 0;
+	for ( ; i + 4 <= num_samples; i += 4) {
+		const __m128 x = _mm_load_ps(levels + i);
+		const __m128 compressed = _mm_mul_ps(_mm_set1_ps(postgain),
+			fastpow_sse(_mm_mul_ps(x, _mm_set1_ps(inv_threshold)), _mm_set1_ps(inv_ratio_minus_one)));
+		_mm_store_ps(levels + i, select_sse(_mm_cmpgt_ps(x, _mm_set1_ps(threshold)), compressed, _mm_set1_ps(postgain)));
+	}
+	for ( ; i < num_samples; ++i) {
+		levels[i] = compressor_knee(levels[i], threshold, inv_threshold, inv_ratio_minus_one, postgain);
+	}
+}
+
+// Same, with eight at a time.
+
+__attribute__((target("avx")))
+inline __m256 select_avx(__m256 mask, __m256 a, __m256 b)
+{
+	return _mm256_or_ps(_mm256_and_ps(mask, a), _mm256_andnot_ps(mask, b));
+}
+
+__attribute__((target("avx")))
+inline __m256 poly3_avx(__m256 x, float c0, float c1, float c2, float c3)
+{
+	__m256 t = _mm256_add_ps(_mm256_set1_ps(c2), _mm256_mul_ps(_mm256_set1_ps(c3), x));
+	t = _mm256_add_ps(_mm256_set1_ps(c1), _mm256_mul_ps(t, x));
+	return _mm256_add_ps(_mm256_set1_ps(c0), _mm256_mul_ps(t, x));
+}
+
+__attribute__((target("avx")))
+inline __m256 fastpow_avx(__m256 x, __m256 y)
+{
+	const __m256 lo = _mm256_cmp_ps(x, _mm256_set1_ps(6.0f), _CMP_LT_OQ);
+	const __m256 ln_nom = select_avx(lo,
+		poly3_avx(x, -0.059237648f, -0.0165117771f, 0.06818859075f, 0.007560968243f),
+		poly3_avx(x, -0.005430534f, 0.00633589178f, 0.0006319155549f, 0.4789541675e-5f));
+	const __m256 ln_den = select_avx(lo,
+		poly3_avx(x, 0.0202509098f, 0.08419174188f, 0.03647189417f, 0.001642577975f),
+		poly3_avx(x, 0.0064785099f, 0.003219629109f, 0.0001531823694f, 0.6884656640e-6f));
+	const __m256 v = _mm256_div_ps(_mm256_mul_ps(y, ln_nom), ln_den);
+	const __m256 exp_nom = poly3_avx(v, 0.2195097621f, 0.08546059868f, 0.01208501759f, 0.0006173448113f);
+
+	__m256 exp_den = _mm256_sub_ps(_mm256_set1_ps(0.03556072737f), _mm256_mul_ps(_mm256_set1_ps(0.006174398513f), v));
+	exp_den = _mm256_add_ps(_mm256_set1_ps(-0.1343051968f), _mm256_mul_ps(exp_den, v));
+	exp_den = _mm256_add_ps(_mm256_set1_ps(0.2194980791f), _mm256_mul_ps(exp_den, v));
+
+	return _mm256_div_ps(exp_nom, exp_den);
+}
+
+__attribute__((target("avx")))
+void compute_gains_avx(float *levels, size_t num_samples, float threshold, float inv_threshold, float inv_ratio_minus_one, float postgain)
+{
+	size_t i = 0;
+	for ( ; i + 8 <= num_samples; i += 8) {
+		const __m256 x = _mm256_load_ps(levels + i);
+		const __m256 compressed = _mm256_mul_ps(_mm256_set1_ps(postgain),
+			fastpow_avx(_mm256_mul_ps(x, _mm256_set1_ps(inv_threshold)), _mm256_set1_ps(inv_ratio_minus_one)));
+		_mm256_store_ps(levels + i, select_avx(_mm256_cmp_ps(x, _mm256_set1_ps(threshold), _CMP_GT_OQ), compressed, _mm256_set1_ps(postgain)));
+	}
+	compute_gains_sse(levels + i, num_samples - i, threshold, inv_threshold, inv_ratio_minus_one, postgain);
+}
+
+typedef void ComputeGainsFunc(float *levels, size_t num_samples, float threshold, float inv_threshold, float inv_ratio_minus_one, float postgain);
+
+ComputeGainsFunc *pick_compute_gains()
+{
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx")) {
+		return compute_gains_avx;
+	} else {
+		return compute_gains_sse;
+	}
+}
+
+// For each stereo sample, max(|L|, |R|).
+void find_stereo_peaks(const float *left, const float *right, size_t num_samples, float *peaks)
+{
+	const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffffu));
+	size_t i = 0;
+	for ( ; i + 4 <= num_samples; i += 4) {
+		const __m128 l = _mm_and_ps(_mm_loadu_ps(left + i), abs_mask);
+		const __m128 r = _mm_and_ps(_mm_loadu_ps(right + i), abs_mask);
+		_mm_store_ps(peaks + i, _mm_max_ps(l, r));
+	}
+	for ( ; i < num_samples; ++i) {
+		peaks[i] = max(fabs(left[i]), fabs(right[i]));
+	}
+}
+
+void apply_stereo_gains(float *left, float *right, const float *gains, size_t num_samples)
+{
+	size_t i = 0;
+	for ( ; i + 4 <= num_samples; i += 4) {
+		const __m128 g = _mm_load_ps(gains + i);
+		_mm_storeu_ps(left + i, _mm_mul_ps(_mm_loadu_ps(left + i), g));
+		_mm_storeu_ps(right + i, _mm_mul_ps(_mm_loadu_ps(right + i), g));
+	}
+	for ( ; i < num_samples; ++i) {
+		left[i] *= gains[i];
+		right[i] *= gains[i];
+	}
+}
+
+#endif  // defined(__SSE2__)
+
 }  // namespace
 
-void StereoCompressor::process(float *buf, size_t num_samples, float threshold, float ratio,
+void StereoCompressor::process(float *left, float *right, size_t num_samples, float threshold, float ratio,
 	    float attack_time, float release_time, float makeup_gain)
 {
-	float attack_increment = float(pow(2.0f, 1.0f / (attack_time * sample_rate + 1)));
-	if (attack_time == 0.0f) attack_increment = 100000;  // For instant attack reaction.
+#ifndef __SSE2__
+	process_plain(left, right, num_samples, threshold, ratio, attack_time, release_time, makeup_gain);
+#else
+	static ComputeGainsFunc * const compute_gains = pick_compute_gains();
+	const Coefficients c = compute_coefficients(sample_rate, threshold, ratio, attack_time, release_time);
+
+	if (c.inv_ratio_minus_one >= 0.0) {
+		// No compression, just makeup gain; nothing to gain from blocking.
+		process_plain(left, right, num_samples, threshold, ratio, attack_time, release_time, makeup_gain);
+		return;
+	}
 
-	const float release_increment = float(pow(2.0f, -1.0f / (release_time * sample_rate + 1)));
-	const float peak_increment = float(pow(2.0f, -1.0f / (0.003f * sample_rate + 1)));
+	// The blocks are small enough that everything stays in L1.
+	static constexpr size_t block_size = 64;
+	alignas(32) float peaks[block_size];
+	alignas(32) float gains[block_size];
 
-	float inv_ratio_minus_one = 1.0f / ratio - 1.0f;
-	if (ratio > 63) inv_ratio_minus_one = -1.0f;  // Infinite ratio.
-	float inv_threshold = 1.0f / threshold;
+	float peak_level = this->peak_level;
+	float compr_level = this->compr_level;
+
+	for (size_t start = 0; start < num_samples; start += block_size) {
+		const size_t n = min(block_size, num_samples - start);
+		float *block_left = left + start;
+		float *block_right = right + start;
+
+		find_stereo_peaks(block_left, block_right, n, peaks);
+
+		// The envelope follower is inherently serial, but without the knee,
+		// it's cheap. This is the same as in process_plain(), just with
+		// the two channels' peaks already folded together.
+		for (size_t i = 0; i < n; ++i) {
+			if (peaks[i] > peak_level) peak_level = peaks[i];
+
+			// Written so that the compiler can do it without branches;
+			// attack and release would otherwise be hard to predict.
+			const float attacked = min(compr_level * c.attack_increment, peak_level);
+			const float released = max(compr_level * c.release_increment, 0.0001f);
+			compr_level = (peak_level > compr_level) ? attacked : released;
+			gains[i] = compr_level;
+
+			peak_level = max(peak_level * c.peak_increment, 0.0001f);
+		}
+
+		compute_gains(gains, n, threshold, c.inv_threshold, c.inv_ratio_minus_one, makeup_gain);
+		apply_stereo_gains(block_left, block_right, gains, n);
+	}
+
+	// Store attenuation level for debug/visualization.
+	scalefactor = compressor_knee(compr_level, threshold, c.inv_threshold, c.inv_ratio_minus_one, 1.0f);
+
+	this->peak_level = peak_level;
+	this->compr_level = compr_level;
+#endif
+}
+
+void StereoCompressor::process_plain(float *left, float *right, size_t num_samples, float threshold, float ratio,
+	    float attack_time, float release_time, float makeup_gain)
+{
+	const Coefficients c = compute_coefficients(sample_rate, threshold, ratio, attack_time, release_time);
+	const float attack_increment = c.attack_increment;
+	const float release_increment = c.release_increment;
+	const float peak_increment = c.peak_increment;
+	const float inv_ratio_minus_one = c.inv_ratio_minus_one;
+	const float inv_threshold = c.inv_threshold;
 
-	float *left_ptr = buf;
-	float *right_ptr = buf + 1;
+	float *left_ptr = left;
+	float *right_ptr = right;
 
 	if (inv_ratio_minus_one >= 0.0) {
 		for (size_t i = 0; i < num_samples; ++i) {
 			*left_ptr *= makeup_gain;
-			left_ptr += 2;
+			++left_ptr;
 
 			*right_ptr *= makeup_gain;
-			right_ptr += 2;
+			++right_ptr;
 		}
 		return;
 	}
@@ -120,10 +345,10 @@ void StereoCompressor::process(float *buf, size_t num_samples, float threshold,
 		float scalefactor_with_gain = compressor_knee(compr_level, threshold, inv_threshold, inv_ratio_minus_one, makeup_gain);
 
 		*left_ptr *= scalefactor_with_gain;
-		left_ptr += 2;
+		++left_ptr;
 
 		*right_ptr *= scalefactor_with_gain;
-		right_ptr += 2;
+		++right_ptr;
 
 		peak_level = max(peak_level * peak_increment, 0.0001f);
 	}
@@ -22,11 +22,23 @@ public:
 		scalefactor = 0.0f;
 	}
 
-	// Process <num_samples> interleaved stereo data in-place.
-	// Attack and release times are in seconds.
-	void process(float *buf, size_t num_samples, float threshold, float ratio,
+	// Process <num_samples> samples of stereo data in-place, with the two
+	// channels in separate buffers. Attack and release times are in seconds.
+	//
+	// Works in small blocks: the peak detection and the gain curve are
+	// computed with SSE (or AVX, if the CPU has it), while the attack/release
+	// envelope runs sample by sample exactly like in process_plain().
+	// The result is bit-exact the same as process_plain() (unless the compiler
+	// has been told to fuse multiply-adds, in which case the two can differ
+	// by normal float rounding in the gain).
+	void process(float *left, float *right, size_t num_samples, float threshold, float ratio,
 	             float attack_time, float release_time, float makeup_gain);
 
+	// The straightforward, one-sample-at-a-time version of process().
+	// Mostly useful as a reference for testing.
+	void process_plain(float *left, float *right, size_t num_samples, float threshold, float ratio,
+	                   float attack_time, float release_time, float makeup_gain);
+
 	// Last level estimated (after attack/decay applied).
 	float get_level() { return compr_level; }
 
@@ -0,0 +1,187 @@
+#include "true_peak.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <cmath>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_KERNELS 1
+#endif
+
+using namespace std;
+
+namespace {
+
+constexpr unsigned num_taps = TruePeakDetector::num_taps;
+
+// The interpolation filter from ITU-R BS.1770-4, Annex 2, one row per phase.
+// The rows are in the order 0, 2, 1, 3, so that 2x oversampling can use
+// the first two (which are evenly spaced), and the taps are reversed,
+// so that output n is the dot product of a row with in[n..n + num_taps - 1].
+const float coeffs[4][num_taps] = {
+	{ -0.0083007812500f, 0.0148925781250f, -0.0266113281250f, 0.0476074218750f, -0.1022949218750f, 0.9721679687500f,
+	  0.1373291015625f, -0.0594482421875f, 0.0332031250000f, -0.0196533203125f, 0.0109863281250f, 0.0017089843750f },
+	{ -0.0291748046875f, 0.0292968750000f, -0.0517578125000f, 0.0891113281250f, -0.1665039062500f, 0.4650878906250f,
+	  0.7797851562500f, -0.2003173828125f, 0.1015625000000f, -0.0582275390625f, 0.0330810546875f, -0.0189208984375f },
+	{ -0.0189208984375f, 0.0330810546875f, -0.0582275390625f, 0.1015625000000f, -0.2003173828125f, 0.7797851562500f,
+	  0.4650878906250f, -0.1665039062500f, 0.0891113281250f, -0.0517578125000f, 0.0292968750000f, -0.0291748046875f },
+	{ 0.0017089843750f, 0.0109863281250f, -0.0196533203125f, 0.0332031250000f, -0.0594482421875f, 0.1373291015625f,
+	  0.9721679687500f, -0.1022949218750f, 0.0476074218750f, -0.0266113281250f, 0.0148925781250f, -0.0083007812500f },
+};
+
+// All the kernels take <num_outputs> + num_taps - 1 samples in <in>,
+// and return the largest absolute value of the first <num_phases> phases
+// of the interpolated signal for the last <num_outputs> of them.
+
+template<unsigned num_phases>
+float find_true_peak_plain(const float *in, size_t num_outputs)
+{
+	float peak = 0.0f;
+	for (size_t n = 0; n < num_outputs; ++n) {
+		for (unsigned phase = 0; phase < num_phases; ++phase) {
+			float sum = 0.0f;
+			for (unsigned j = 0; j < num_taps; ++j) {
+				sum += coeffs[phase][j] * in[n + j];
+			}
+			peak = max(peak, fabs(sum));
+		}
+	}
+	return peak;
+}
+
+#ifdef HAVE_X86_KERNELS
+
+__attribute__((target("sse2")))
+inline float horizontal_max_sse2(__m128 m)
+{
+	__m128 tmp = _mm_shuffle_ps(m, m, _MM_SHUFFLE(1, 0, 3, 2));
+	m = _mm_max_ps(m, tmp);
+	tmp = _mm_shuffle_ps(m, m, _MM_SHUFFLE(2, 3, 0, 1));
+	m = _mm_max_ps(m, tmp);
+	return _mm_cvtss_f32(m);
+}
+
+// Four outputs at a time, with the same order of operations as the plain version.
+// The loops need to be unrolled for the sums and coefficients to stay
+// in registers, which GCC won't do by itself at -O2.
+template<unsigned num_phases>
+__attribute__((target("sse2")))
+float find_true_peak_sse2(const float *in, size_t num_outputs)
+{
+	const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+	__m128 peak = _mm_setzero_ps();
+	size_t n = 0;
+	for ( ; n + 4 <= num_outputs; n += 4) {
+		__m128 sum[num_phases];
+		for (unsigned phase = 0; phase < num_phases; ++phase) {
+			sum[phase] = _mm_setzero_ps();
+		}
+#pragma GCC unroll 12
+		for (unsigned j = 0; j < num_taps; ++j) {
+			const __m128 x = _mm_loadu_ps(in + n + j);
+#pragma GCC unroll 4
+			for (unsigned phase = 0; phase < num_phases; ++phase) {
+				sum[phase] = _mm_add_ps(sum[phase], _mm_mul_ps(_mm_set1_ps(coeffs[phase][j]), x));
+			}
+		}
+		for (unsigned phase = 0; phase < num_phases; ++phase) {
+			peak = _mm_max_ps(peak, _mm_and_ps(sum[phase], abs_mask));
+		}
+	}
+	return max(horizontal_max_sse2(peak), find_true_peak_plain<num_phases>(in + n, num_outputs - n));
+}
+
+// Eight outputs at a time, with fused multiply-add.
+template<unsigned num_phases>
+__attribute__((target("avx2,fma")))
+float find_true_peak_avx2(const float *in, size_t num_outputs)
+{
+	const __m256 abs_mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+	__m256 peak = _mm256_setzero_ps();
+	size_t n = 0;
+	for ( ; n + 8 <= num_outputs; n += 8) {
+		__m256 sum[num_phases];
+		for (unsigned phase = 0; phase < num_phases; ++phase) {
+			sum[phase] = _mm256_setzero_ps();
+		}
+#pragma GCC unroll 12
+		for (unsigned j = 0; j < num_taps; ++j) {
+			const __m256 x = _mm256_loadu_ps(in + n + j);
+#pragma GCC unroll 4
+			for (unsigned phase = 0; phase < num_phases; ++phase) {
+				sum[phase] = _mm256_fmadd_ps(_mm256_set1_ps(coeffs[phase][j]), x, sum[phase]);
+			}
+		}
+		for (unsigned phase = 0; phase < num_phases; ++phase) {
+			peak = _mm256_max_ps(peak, _mm256_and_ps(sum[phase], abs_mask));
+		}
+	}
+	const __m128 peak4 = _mm_max_ps(_mm256_castps256_ps128(peak), _mm256_extractf128_ps(peak, 1));
+	return max(horizontal_max_sse2(peak4), find_true_peak_plain<num_phases>(in + n, num_outputs - n));
+}
+
+#endif  // defined(HAVE_X86_KERNELS)
+
+typedef float TruePeakFunc(const float *in, size_t num_outputs);
+
+struct TruePeakFuncs {
+	TruePeakFunc *oversample2x, *oversample4x;
+};
+
+TruePeakFuncs pick_true_peak_funcs()
+{
+#ifdef HAVE_X86_KERNELS
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+		return TruePeakFuncs{ find_true_peak_avx2<2>, find_true_peak_avx2<4> };
+	}
+	if (__builtin_cpu_supports("sse2")) {
+		return TruePeakFuncs{ find_true_peak_sse2<2>, find_true_peak_sse2<4> };
+	}
+#endif
+	return TruePeakFuncs{ find_true_peak_plain<2>, find_true_peak_plain<4> };
+}
+
+}  // namespace
+
+float TruePeakDetector::process(const float *samples, size_t num_samples)
+{
+	static const TruePeakFuncs funcs = pick_true_peak_funcs();
+	TruePeakFunc *func = (oversampling == 2) ? funcs.oversample2x : funcs.oversample4x;
+
+	// The kernels want the history and the new samples in one array,
+	// so copy them in a block at a time.
+	constexpr size_t block_size = 256;
+	float buf[num_taps - 1 + block_size];
+	memcpy(buf, history, sizeof(history));
+
+	float peak = 0.0f;
+	for (size_t i = 0; i < num_samples; i += block_size) {
+		const size_t samples_this_block = min(num_samples - i, block_size);
+		memcpy(buf + num_taps - 1, samples + i, samples_this_block * sizeof(float));
+		const float block_peak = func(buf, samples_this_block);
+
+#if 0
+		// Self-test. Only the AVX2 version can differ from the reference,
+		// and only by rounding.
+		TruePeakFunc *reference_func = (oversampling == 2) ? find_true_peak_plain<2> : find_true_peak_plain<4>;
+		const float reference_peak = reference_func(buf, samples_this_block);
+		if (fabs(block_peak - reference_peak) > 1e-6f * max(1.0f, reference_peak)) {
+			fprintf(stderr, "Error: True peak is %f; should be %f.\n", block_peak, reference_peak);
+			abort();
+		}
+#endif
+
+		peak = max(peak, block_peak);
+		memmove(buf, buf + samples_this_block, (num_taps - 1) * sizeof(float));
+	}
+	memcpy(history, buf, sizeof(history));
+	return peak;
+}
+
+void TruePeakDetector::reset()
+{
+	fill(history, history + num_taps - 1, 0.0f);
+}
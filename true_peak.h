@@ -0,0 +1,42 @@
+#ifndef _TRUE_PEAK_H
+#define _TRUE_PEAK_H 1
+
+// True-peak measurement for a single channel, ie., an estimate of the peak
+// of the reconstructed analog signal, which can be higher than any of the
+// samples. Works by oversampling with the 48-tap polyphase FIR filter from
+// ITU-R BS.1770-4, Annex 2, and taking the largest absolute value. The
+// oversampled signal is never stored; each vector of interpolated values
+// goes straight into a running maximum.
+//
+// 4x oversampling is what BS.1770 specifies. 2x uses every other phase of
+// the same filter, for about half the cost; for sines, it reads at most about
+// 1.2 dB low, against 0.3 dB for 4x (and 3 dB for just the sample peak).
+//
+// There are SSE2 and AVX2 (with FMA) versions, chosen at runtime depending
+// on what the CPU supports. The SSE2 version gives bit-exact the same result
+// as the plain C++ fallback; the AVX2 one differs by rounding only.
+
+#include <stddef.h>
+
+class TruePeakDetector {
+public:
+	static constexpr unsigned num_taps = 12;  // Per phase.
+
+	// <oversampling> must be 2 or 4.
+	explicit TruePeakDetector(unsigned oversampling = 4) : oversampling(oversampling) { reset(); }
+
+	// Returns the true peak (linear, not dB) of the given samples,
+	// continuing the signal from the last call. Does not allocate.
+	float process(const float *samples, size_t num_samples);
+
+	// Forgets the previous samples, ie., as if they were all zero.
+	void reset();
+
+private:
+	unsigned oversampling;
+
+	// The last num_taps - 1 input samples, oldest first.
+	float history[num_taps - 1];
+};
+
+#endif  // !defined(_TRUE_PEAK_H)
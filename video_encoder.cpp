@@ -2,16 +2,20 @@
 
 #include <assert.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <time.h>
 #include <unistd.h>
 #include <string>
 #include <thread>
 
 extern "C" {
+#include <libavutil/error.h>
 #include <libavutil/mem.h>
 }
 
 #include "audio_encoder.h"
+#include "audio_encoder_service.h"
 #include "defs.h"
 #include "ffmpeg_raii.h"
 #include "flags.h"
@@ -53,10 +57,14 @@ VideoEncoder::VideoEncoder(ResourcePool *resource_pool, QSurface *surface, const
 {
 	oformat = av_guess_format(global_flags.stream_mux_name.c_str(), nullptr, nullptr);
 	assert(oformat != nullptr);
+	audio_encoder_service.reset(new AudioEncoderService);
 	if (global_flags.stream_audio_codec_name.empty()) {
-		stream_audio_encoder.reset(new AudioEncoder(AUDIO_OUTPUT_CODEC_NAME, DEFAULT_AUDIO_OUTPUT_BIT_RATE, oformat));
+		stream_audio_encoder = audio_encoder_service->add_rendition("http", AUDIO_OUTPUT_CODEC_NAME, DEFAULT_AUDIO_OUTPUT_BIT_RATE, oformat);
 	} else {
-		stream_audio_encoder.reset(new AudioEncoder(global_flags.stream_audio_codec_name, global_flags.stream_audio_codec_bitrate, oformat));
+		stream_audio_encoder = audio_encoder_service->add_rendition("http", global_flags.stream_audio_codec_name, global_flags.stream_audio_codec_bitrate, oformat);
+	}
+	for (const string &spec : global_flags.audio_renditions) {
+		open_audio_rendition(spec);
 	}
 	if (global_flags.x264_video_to_http || global_flags.x264_video_to_disk) {
 		x264_encoder.reset(new X264Encoder(oformat));
@@ -135,7 +143,7 @@ void VideoEncoder::change_x264_bitrate(unsigned rate_kbit)
 	x264_encoder->change_bitrate(rate_kbit);
 }
 
-void VideoEncoder::add_audio(int64_t pts, std::vector<float> audio)
+void VideoEncoder::add_audio(int64_t pts, const std::vector<float> &audio)
 {
 	// Take only qs_audio_mu, since add_audio() is thread safe
 	// (we can only conflict with do_cut(), which takes qs_audio_mu)
@@ -144,7 +152,7 @@ void VideoEncoder::add_audio(int64_t pts, std::vector<float> audio)
 		lock_guard<mutex> lock(qs_audio_mu);
 		quicksync_encoder->add_audio(pts, audio);
 	}
-	stream_audio_encoder->encode_audio(audio, pts + quicksync_encoder->global_delay());
+	audio_encoder_service->encode_audio(audio, pts + quicksync_encoder->global_delay());
 }
 
 bool VideoEncoder::is_zerocopy() const
@@ -199,6 +207,57 @@ void VideoEncoder::open_output_stream()
 	stream_mux_metrics.init({{ "destination", "http" }});
 }
 
+// Parses “FILE,codec=NAME[,bitrate=KBITS]”, and sets up a rendition
+// that writes to an audio-only file.
+void VideoEncoder::open_audio_rendition(const string &spec)
+{
+	size_t pos = spec.find(',');
+	const string filename = spec.substr(0, pos);
+	string codec_name;
+	int bit_rate = DEFAULT_AUDIO_OUTPUT_BIT_RATE;
+	while (pos != string::npos) {
+		const size_t start = pos + 1;
+		pos = spec.find(',', start);
+		const string option = spec.substr(start, pos == string::npos ? string::npos : pos - start);
+		if (option.compare(0, 6, "codec=") == 0) {
+			codec_name = option.substr(6);
+		} else if (option.compare(0, 8, "bitrate=") == 0) {
+			bit_rate = atoi(option.c_str() + 8) * 1000;
+		} else {
+			fprintf(stderr, "--audio-rendition=%s: Unknown option '%s'\n", spec.c_str(), option.c_str());
+			exit(1);
+		}
+	}
+	if (filename.empty() || codec_name.empty()) {
+		fprintf(stderr, "--audio-rendition=%s: Need both a file name and a codec\n", spec.c_str());
+		exit(1);
+	}
+
+	AVFormatContext *avctx = avformat_alloc_context();
+	avctx->oformat = av_guess_format(NULL, filename.c_str(), NULL);
+	if (avctx->oformat == nullptr) {
+		fprintf(stderr, "%s: Could not guess the mux from the file name\n", filename.c_str());
+		exit(1);
+	}
+	assert(filename.size() < sizeof(avctx->filename) - 1);
+	strcpy(avctx->filename, filename.c_str());
+
+	AudioEncoder *audio_encoder = audio_encoder_service->add_rendition(filename, codec_name, bit_rate, avctx->oformat);
+
+	string url = "file:" + filename;
+	int ret = avio_open2(&avctx->pb, url.c_str(), AVIO_FLAG_WRITE, &avctx->interrupt_callback, NULL);
+	if (ret < 0) {
+		char tmp[AV_ERROR_MAX_STRING_SIZE];
+		fprintf(stderr, "%s: avio_open2() failed: %s\n", filename.c_str(), av_make_error_string(tmp, sizeof(tmp), ret));
+		exit(1);
+	}
+
+	// Packets come from the rendition's own thread, so there is no need to write in the background.
+	audio_rendition_muxes.emplace_back(new Mux(avctx, /*width=*/0, /*height=*/0, Mux::CODEC_NONE, /*video_extradata=*/"",
+		audio_encoder->get_codec_parameters().get(), TIMEBASE, /*write_callback=*/nullptr, Mux::WRITE_FOREGROUND, {}));
+	audio_encoder->add_mux(audio_rendition_muxes.back().get());
+}
+
 int VideoEncoder::write_packet2_thunk(void *opaque, uint8_t *buf, int buf_size, AVIODataMarkerType type, int64_t time)
 {
 	VideoEncoder *video_encoder = (VideoEncoder *)opaque;
@@ -24,6 +24,7 @@ extern "C" {
 #include "ref_counted_gl_sync.h"
 
 class AudioEncoder;
+class AudioEncoderService;
 class DiskSpaceEstimator;
 class HTTPD;
 class Mux;
@@ -41,7 +42,7 @@ public:
 	VideoEncoder(movit::ResourcePool *resource_pool, QSurface *surface, const std::string &va_display, int width, int height, HTTPD *httpd, DiskSpaceEstimator *disk_space_estimator);
 	~VideoEncoder();
 
-	void add_audio(int64_t pts, std::vector<float> audio);
+	void add_audio(int64_t pts, const std::vector<float> &audio);
 
 	bool is_zerocopy() const;
 
@@ -75,6 +76,7 @@ public:
 
 private:
 	void open_output_stream();
+	void open_audio_rendition(const std::string &spec);
 	static int write_packet2_thunk(void *opaque, uint8_t *buf, int buf_size, AVIODataMarkerType type, int64_t time);
 	int write_packet2(uint8_t *buf, int buf_size, AVIODataMarkerType type, int64_t time);
 
@@ -91,7 +93,11 @@ private:
 	bool seen_sync_markers = false;
 
 	std::unique_ptr<Mux> stream_mux;  // To HTTP.
-	std::unique_ptr<AudioEncoder> stream_audio_encoder;
+	std::vector<std::unique_ptr<Mux>> audio_rendition_muxes;  // From --audio-rendition.
+
+	// Must be declared after (ie., destroyed before) all the muxes it sends to.
+	std::unique_ptr<AudioEncoderService> audio_encoder_service;
+	AudioEncoder *stream_audio_encoder;  // Owned by <audio_encoder_service>.
 	std::unique_ptr<X264Encoder> x264_encoder;  // nullptr if not using x264.
 
 	std::string stream_mux_header;
@@ -0,0 +1,106 @@
+#include "worker_pool.h"
+
+#include <pthread.h>
+#include <stdio.h>
+
+using namespace std;
+
+WorkerPool::WorkerPool(unsigned num_threads, const string &thread_name)
+	: thread_name(thread_name)
+{
+	for (unsigned i = 0; i < num_threads; ++i) {
+		workers.emplace_back(&WorkerPool::worker_thread_func, this, i);
+	}
+}
+
+WorkerPool::~WorkerPool()
+{
+	{
+		lock_guard<mutex> lock(mu);
+		should_quit = true;
+	}
+	batch_started.notify_all();
+	for (thread &worker : workers) {
+		worker.join();
+	}
+}
+
+void WorkerPool::run_jobs(unsigned num_jobs, JobFunc *func, void *context)
+{
+	if (num_jobs == 0) {
+		return;
+	}
+	if (workers.empty() || num_jobs == 1) {
+		for (unsigned i = 0; i < num_jobs; ++i) {
+			func(context, i);
+		}
+		return;
+	}
+
+	{
+		lock_guard<mutex> lock(mu);
+		job_func = func;
+		job_context = context;
+		this->num_jobs = num_jobs;
+		next_job = 0;
+		++generation;
+	}
+	batch_started.notify_all();
+
+	do_jobs(num_jobs, func, context);
+
+	unique_lock<mutex> lock(mu);
+	batch_done.wait(lock, [this]{ return num_active_workers == 0; });
+	job_func = nullptr;
+	job_context = nullptr;
+}
+
+void WorkerPool::do_jobs(unsigned num_jobs, JobFunc *func, void *context)
+{
+	for ( ;; ) {
+		unsigned job_index = next_job.fetch_add(1);
+		if (job_index >= num_jobs) {
+			break;
+		}
+		func(context, job_index);
+	}
+}
+
+void WorkerPool::worker_thread_func(unsigned worker_index)
+{
+	char name[16];
+	snprintf(name, sizeof(name), "%s_%u", thread_name.c_str(), worker_index);
+	pthread_setname_np(pthread_self(), name);
+
+	unsigned last_generation = 0;
+	for ( ;; ) {
+		JobFunc *func;
+		void *context;
+		unsigned num_jobs;
+		{
+			unique_lock<mutex> lock(mu);
+			batch_started.wait(lock, [this, last_generation]{
+				return should_quit || generation != last_generation;
+			});
+			if (should_quit) {
+				return;
+			}
+			last_generation = generation;
+			if (job_func == nullptr) {
+				// We woke up too late; the batch is already done.
+				continue;
+			}
+			func = job_func;
+			context = job_context;
+			num_jobs = this->num_jobs;
+			++num_active_workers;
+		}
+
+		do_jobs(num_jobs, func, context);
+
+		lock_guard<mutex> lock(mu);
+		if (--num_active_workers == 0) {
+			batch_done.notify_all();
+		}
+	}
+}
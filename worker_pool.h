@@ -0,0 +1,68 @@
+#ifndef _WORKER_POOL_H
+#define _WORKER_POOL_H 1
+
+// A small, fixed pool of threads for fanning a batch of independent jobs
+// out across cores, for when a single thread needs to get through the
+// batch as quickly as possible (e.g. all the audio buses for one frame).
+// The calling thread takes part in the work too, and run() does not return
+// until every job is done. Nothing is allocated per call, so it is safe to
+// use from the audio path.
+//
+// Only one thread can be in run() at any given time.
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+class WorkerPool {
+public:
+	// <thread_name> is used for the worker threads (with “_” and a number
+	// appended). Thread names are cut off after 15 characters, so keep it
+	// to 12 or less, or the workers cannot be told apart.
+	WorkerPool(unsigned num_threads, const std::string &thread_name);
+	~WorkerPool();
+
+	unsigned get_num_threads() const { return workers.size(); }
+
+	// Calls func(i) for every i in [0, num_jobs), in no particular order
+	// and on no particular thread.
+	template<class Func>
+	void run(unsigned num_jobs, Func &&func)
+	{
+		typedef typename std::remove_reference<Func>::type FuncType;
+		run_jobs(num_jobs, [](void *context, unsigned job_index) {
+			(*static_cast<FuncType *>(context))(job_index);
+		}, const_cast<void *>(static_cast<const void *>(&func)));
+	}
+
+private:
+	typedef void JobFunc(void *context, unsigned job_index);
+
+	void run_jobs(unsigned num_jobs, JobFunc *func, void *context);
+	void do_jobs(unsigned num_jobs, JobFunc *func, void *context);
+	void worker_thread_func(unsigned worker_index);
+
+	std::string thread_name;
+	std::vector<std::thread> workers;
+
+	std::mutex mu;
+	std::condition_variable batch_started, batch_done;
+
+	// The current batch. All under <mu>, except <next_job>, which is handed
+	// out atomically. A worker counts as active from when it picks up a batch
+	// until it has run out of jobs from it; run() waits until there are no
+	// active workers left, so a worker can never straddle two batches.
+	unsigned generation = 0;
+	JobFunc *job_func = nullptr;
+	void *job_context = nullptr;
+	unsigned num_jobs = 0;
+	std::atomic<unsigned> next_job{0};
+	unsigned num_active_workers = 0;
+	bool should_quit = false;
+};
+
+#endif  // !defined(_WORKER_POOL_H)